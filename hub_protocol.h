@@ -0,0 +1,108 @@
+#ifndef HUB_PROTOCOL_H
+#define HUB_PROTOCOL_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include "treasure.h"
+
+/* Monitor -> hub responses are a stream of length-prefixed frames.  Every
+   response ends with a FRAME_END whose payload is an int32 status (0 = ok). */
+#define FRAME_TEXT      1   /* free-form text, printed as is */
+#define FRAME_ERROR     2   /* error message text */
+#define FRAME_HUNT      3   /* uint32 treasure count [+ HuntStats] + hunt id bytes */
+#define FRAME_TREASURE  4   /* one Treasure record */
+#define FRAME_END       5   /* int32 status */
+#define FRAME_EXPORT    6   /* raw Treasure records, a whole number per frame */
+#define FRAME_HUNT_STATS 7  /* HuntStats + hunt id bytes */
+#define FRAME_USER_TREASURE 8 /* one Treasure record + hunt id bytes */
+#define FRAME_WATCH     9   /* uint32 WATCH_* event + Treasure + hunt id bytes, sent
+                               unprompted under the tag of the watch request */
+#define FRAME_TOTALS    10  /* FrameTotals [+ name bytes]: a shard's share of a
+                               summary line, added up by the hub */
+#define FRAME_SKETCH    11  /* HuntSketch + uint32 hunts + uint32 scanned: a shard's
+                               merged sketch for "approx all" */
+
+#define FRAME_MAX_PAYLOAD 65536
+#define EXPORT_CHUNK_SIZE (FRAME_MAX_PAYLOAD - FRAME_MAX_PAYLOAD % sizeof(Treasure))
+
+/* FRAME_WATCH events */
+#define WATCH_ADDED     1   /* a record was appended */
+#define WATCH_REMOVED   2   /* a treasure is gone; only its ID is set */
+#define WATCH_ENDED     3   /* the subscription closed: the hunt went away, it was
+                               unwatched, or its monitor stopped */
+
+/* FrameHeader.flags */
+#define HUNT_ARCHIVED   0x1 /* FRAME_HUNT: hunt is stored as an archive */
+#define HUNT_STATS      0x2 /* FRAME_HUNT: a HuntStats block follows the count */
+
+/* FrameTotals.kind */
+#define TOTALS_SEARCH   1   /* matches */
+#define TOTALS_USER     2   /* treasures, hunts, score; the username follows */
+#define TOTALS_SCORE    3   /* score in hundredths, hunts; one per hunt scored by
+                               "calculate_score all", the hunt id follows */
+
+typedef struct __attribute__((packed)) {
+    uint32_t kind;
+    int64_t values[3];
+} FrameTotals;
+
+/* With N monitors (treasure_hub HUB_MONITORS) a hunt belongs to monitor
+   hunt_shard(hunt_id, N): jump consistent hashing (Lamping and Veach) of
+   the FNV-1a hash of its id, so going from N to N + 1 monitors moves only
+   1 / (N + 1) of the hunts. */
+static inline int hunt_shard(const char *hunt_id, int shards) {
+    uint64_t key = 14695981039346656037ULL;
+    for (const char *p = hunt_id; *p; p++)
+        key = (key ^ (unsigned char)*p) * 1099511628211ULL;
+    int64_t bucket = -1, next = 0;
+    while (next < shards) {
+        bucket = next;
+        key = key * 2862933555777941757ULL + 1;
+        next = (int64_t)((bucket + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+    }
+    return (int)bucket;
+}
+
+typedef struct __attribute__((packed)) {
+    uint32_t length;        /* payload bytes following the header */
+    uint16_t type;
+    uint16_t flags;
+    uint32_t tag;           /* request the frame belongs to */
+} FrameHeader;
+
+static inline int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Returns 1 when len bytes were read, 0 on EOF before any byte, -1 on error
+   or a short stream. */
+static inline int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, p + done, len - done);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            return done == 0 ? 0 : -1;
+        done += n;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,1930 @@
+#ifndef HUNT_STORE_H
+#define HUNT_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include "treasure.h"
+
+/* snprintf for file paths: fails with ENAMETOOLONG instead of handing back
+   a truncated path. */
+static inline __attribute__((format(printf, 3, 4)))
+int path_format(char *path, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(path, size, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/* Cold hunts can be packed into a single "<hunt_id>.tha" archive next to the
+   hunt directories:
+
+     ArchiveHeader | BlockEntry[block_count] | packed blocks... | packed log
+
+   Every block holds up to ARCHIVE_BLOCK_RECORDS records compressed with a
+   byte-run codec and carries the CRC32C of its uncompressed bytes, so
+   readers can stream records out block by block without restoring. */
+#define ARCHIVE_SUFFIX ".tha"
+#define ARCHIVE_MAGIC "THA1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_RECORDS 256
+
+typedef struct __attribute__((packed)) {
+    uint64_t offset;
+    uint32_t raw_length;
+    uint32_t packed_length;
+    uint32_t crc;
+} BlockEntry;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t block_records;
+    uint64_t record_count;
+    uint32_t block_count;
+    BlockEntry log_block;
+    uint32_t crc;           /* over header (crc = 0) and block table */
+} ArchiveHeader;
+
+static uint32_t crc32c_table[8][256];
+
+static inline void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xff];
+}
+
+/* Slicing-by-8 fallback for CPUs without the crc32 instruction. */
+static inline uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        word ^= crc;
+        crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff] ^
+              crc32c_table[5][(word >> 16) & 0xff] ^ crc32c_table[4][(word >> 24) & 0xff] ^
+              crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff] ^
+              crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+/* CRC32C (Castagnoli) of buf continuing from crc; start a new one with 0.
+   Uses the SSE4.2 instruction when the CPU has it. */
+static inline uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    static int mode;        /* 0 unknown, 1 hardware, 2 table */
+    if (!mode) {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2"))
+            mode = 1;
+#endif
+        if (!mode) {
+            crc32c_init_table();
+            mode = 2;
+        }
+    }
+#if defined(__x86_64__)
+    if (mode == 1)
+        return ~crc32c_hw(~crc, buf, len);
+#endif
+    return ~crc32c_sw(~crc, buf, len);
+}
+
+/* Byte-run codec: a control byte c < 128 is followed by c + 1 literal bytes,
+   c >= 128 by one byte repeated c - 125 times (3..130). Worst case output is
+   len + len / 128 + 1 bytes. */
+static inline size_t block_pack(const unsigned char *in, size_t len, unsigned char *out) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && run < 130 && in[i + run] == in[i])
+            run++;
+        if (run >= 3) {
+            out[o++] = (unsigned char)(run + 125);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        size_t start = i, lit = 0;
+        while (i < len && lit < 128) {
+            if (i + 2 < len && in[i] == in[i + 1] && in[i] == in[i + 2])
+                break;
+            i++;
+            lit++;
+        }
+        out[o++] = (unsigned char)(lit - 1);
+        memcpy(out + o, in + start, lit);
+        o += lit;
+    }
+    return o;
+}
+
+static inline int block_unpack(const unsigned char *in, size_t len, unsigned char *out, size_t out_len) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        unsigned c = in[i++];
+        if (c < 128) {
+            if (i + c + 1 > len || o + c + 1 > out_len)
+                return -1;
+            memcpy(out + o, in + i, c + 1);
+            i += c + 1;
+            o += c + 1;
+        } else {
+            size_t run = c - 125;
+            if (i >= len || o + run > out_len)
+                return -1;
+            memset(out + o, in[i++], run);
+            o += run;
+        }
+    }
+    return o == out_len ? 0 : -1;
+}
+
+static inline size_t block_pack_bound(size_t len) {
+    return len + len / 128 + 1;
+}
+
+/* Reads one packed block at entry->offset, unpacks and verifies it into
+   out (entry->raw_length bytes). Returns -1 with errno = EIO on damage. */
+static inline int archive_read_block(int fd, const BlockEntry *entry, unsigned char *out) {
+    unsigned char *packed = malloc(entry->packed_length ? entry->packed_length : 1);
+    if (!packed)
+        return -1;
+
+    ssize_t n = pread(fd, packed, entry->packed_length, entry->offset);
+    int ok = n == (ssize_t)entry->packed_length &&
+             block_unpack(packed, entry->packed_length, out, entry->raw_length) == 0 &&
+             crc32c(0, out, entry->raw_length) == entry->crc;
+    free(packed);
+    if (!ok) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+/* Opens "<hunt_id>.tha", validating the header and block table. The caller
+   frees *blocks. */
+static inline int archive_open(const char *hunt_id, ArchiveHeader *header, BlockEntry **blocks) {
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s%s", hunt_id, ARCHIVE_SUFFIX) == -1)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    if (read(fd, header, sizeof(*header)) != sizeof(*header) ||
+        memcmp(header->magic, ARCHIVE_MAGIC, 4) != 0 ||
+        header->version != ARCHIVE_VERSION ||
+        header->record_size != sizeof(Treasure) ||
+        header->block_records == 0) {
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+
+    size_t table_size = header->block_count * sizeof(BlockEntry);
+    *blocks = malloc(table_size ? table_size : 1);
+    if (!*blocks || read(fd, *blocks, table_size) != (ssize_t)table_size) {
+        free(*blocks);
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+
+    uint32_t stored = header->crc;
+    header->crc = 0;
+    uint32_t crc = crc32c(crc32c(0, header, sizeof(*header)), *blocks, table_size);
+    header->crc = stored;
+    if (crc != stored) {
+        free(*blocks);
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+    return fd;
+}
+
+/* Optional sharded backend: once "shards/" exists (treasure_manager
+   init_shards), new hunts are stored in a fixed set of shard files instead of
+   one directory each. shards/hunts.tbl is an open-addressing hash table of
+   HuntSlots; every ShardRecord carries its hunt's slot and generation, so
+   creating or deleting a hunt only touches its slot. Directory hunts keep
+   working and take precedence over a sharded hunt of the same name. */
+#define SHARD_DIR "shards"
+#define SHARD_TABLE SHARD_DIR "/hunts.tbl"
+#define SHARD_LOG SHARD_DIR "/logged_hunts"
+#define SHARD_TABLE_MAGIC "HTB1"
+#define HUNT_ID_LEN 64
+
+#define SLOT_EMPTY 0
+#define SLOT_LIVE 1
+#define SLOT_DELETED 2
+
+#define SHARD_RECORD_REMOVED 0x1
+#define SHARD_READ_RECORDS 64
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint32_t shard_count;
+    uint32_t slot_count;
+} ShardTableHeader;
+
+typedef struct __attribute__((packed)) {
+    char hunt_id[HUNT_ID_LEN];
+    uint32_t state;
+    uint32_t generation;
+    uint32_t record_count;
+} HuntSlot;
+
+typedef struct __attribute__((packed)) {
+    uint32_t slot;
+    uint32_t generation;
+    uint32_t flags;
+    Treasure treasure;
+} ShardRecord;
+
+static inline uint32_t hunt_hash(const char *hunt_id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)hunt_id; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+static inline off_t shard_slot_offset(uint32_t slot) {
+    return sizeof(ShardTableHeader) + (off_t)slot * sizeof(HuntSlot);
+}
+
+static inline int shard_path(char *path, size_t size, const ShardTableHeader *header, const char *hunt_id) {
+    return path_format(path, size, "%s/shard-%03u.dat", SHARD_DIR, hunt_hash(hunt_id) % header->shard_count);
+}
+
+static inline int shard_table_open(int flags, ShardTableHeader *header) {
+    int fd = open(SHARD_TABLE, flags);
+    if (fd == -1)
+        return -1;
+    if (pread(fd, header, sizeof(*header), 0) != sizeof(*header) ||
+        memcmp(header->magic, SHARD_TABLE_MAGIC, 4) != 0 ||
+        header->shard_count == 0 || header->slot_count == 0) {
+        close(fd);
+        errno = EIO;
+        return -1;
+    }
+    return fd;
+}
+
+/* Probes the table for hunt_id. Returns the slot index of the live entry
+   (filling *slot), or -1. When free_slot is given it receives the first
+   reusable slot on the probe path, or -1 if the table is full. */
+static inline long shard_find(int fd, const ShardTableHeader *header, const char *hunt_id,
+                              HuntSlot *slot, long *free_slot) {
+    if (free_slot)
+        *free_slot = -1;
+
+    uint32_t start = hunt_hash(hunt_id) % header->slot_count;
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+        uint32_t index = (start + i) % header->slot_count;
+        HuntSlot current;
+        if (pread(fd, &current, sizeof(current), shard_slot_offset(index)) != sizeof(current))
+            return -1;
+
+        if (current.state == SLOT_EMPTY) {
+            if (free_slot && *free_slot == -1)
+                *free_slot = index;
+            return -1;
+        }
+        if (current.state == SLOT_DELETED) {
+            if (free_slot && *free_slot == -1)
+                *free_slot = index;
+            continue;
+        }
+        if (strncmp(current.hunt_id, hunt_id, HUNT_ID_LEN) == 0) {
+            if (slot)
+                *slot = current;
+            return index;
+        }
+    }
+    return -1;
+}
+
+/* Sequential record reader over a hunt, whichever way it is stored. */
+typedef struct {
+    int fd;
+    int archived;
+    ArchiveHeader header;
+    BlockEntry *blocks;
+    uint32_t next_block;
+    Treasure *records;
+    size_t record_count;
+    size_t record_pos;
+    int sharded;
+    uint32_t slot;
+    uint32_t generation;
+    ShardRecord *shard_records;
+} RecordStream;
+
+static inline int store_open_plain(const char *path, int flags) {
+    return open(path, flags, 0644);
+}
+
+static inline void store_close_plain(int fd) {
+    close(fd);
+}
+
+/* I/O hooks: the monitor accounts the bytes streamed through store_read, the
+   treasure_manager daemon keeps hunt files open across requests through
+   store_open/store_close. */
+static ssize_t (*store_read)(int fd, void *buf, size_t count) = read;
+static int (*store_open)(const char *path, int flags) = store_open_plain;
+static void (*store_close)(int fd) = store_close_plain;
+
+static inline int hunt_is_archived(const char *hunt_id) {
+    char path[PATH_MAX];
+    return path_format(path, sizeof(path), "%s%s", hunt_id, ARCHIVE_SUFFIX) == 0 && access(path, F_OK) == 0;
+}
+
+static inline int record_stream_open_shard(RecordStream *rs, const char *hunt_id) {
+    ShardTableHeader header;
+    int table_fd = shard_table_open(O_RDONLY, &header);
+    if (table_fd == -1) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    HuntSlot slot;
+    long index = shard_find(table_fd, &header, hunt_id, &slot, NULL);
+    close(table_fd);
+    if (index == -1) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    if (shard_path(path, sizeof(path), &header, hunt_id) == -1)
+        return -1;
+    rs->fd = open(path, O_RDONLY);
+    if (rs->fd == -1 && errno != ENOENT)
+        return -1;
+
+    rs->sharded = 1;
+    rs->slot = index;
+    rs->generation = slot.generation;
+    rs->shard_records = malloc(SHARD_READ_RECORDS * sizeof(ShardRecord));
+    if (!rs->shard_records) {
+        if (rs->fd != -1)
+            close(rs->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static inline int record_stream_open(RecordStream *rs, const char *hunt_id) {
+    memset(rs, 0, sizeof(*rs));
+
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1)
+        return -1;
+    rs->fd = store_open(path, O_RDONLY);
+    if (rs->fd != -1 || errno != ENOENT)
+        return rs->fd == -1 ? -1 : 0;
+
+    rs->fd = archive_open(hunt_id, &rs->header, &rs->blocks);
+    if (rs->fd == -1 && errno == ENOENT)
+        return record_stream_open_shard(rs, hunt_id);
+    if (rs->fd == -1)
+        return -1;
+    rs->archived = 1;
+    rs->records = malloc((size_t)rs->header.block_records * sizeof(Treasure));
+    if (!rs->records) {
+        free(rs->blocks);
+        close(rs->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns 1 and fills *t, 0 at the end, -1 on a read error or a damaged
+   block (errno = EIO). */
+static inline int record_stream_next(RecordStream *rs, Treasure *t) {
+    if (rs->sharded) {
+        while (1) {
+            while (rs->record_pos < rs->record_count) {
+                const ShardRecord *r = &rs->shard_records[rs->record_pos++];
+                if (r->slot == rs->slot && r->generation == rs->generation &&
+                    !(r->flags & SHARD_RECORD_REMOVED)) {
+                    *t = r->treasure;
+                    return 1;
+                }
+            }
+            if (rs->fd == -1)
+                return 0;
+            ssize_t n = store_read(rs->fd, rs->shard_records, SHARD_READ_RECORDS * sizeof(ShardRecord));
+            if (n == 0)
+                return 0;
+            if (n < 0 || n % sizeof(ShardRecord) != 0) {
+                if (n >= 0)
+                    errno = EIO;
+                return -1;
+            }
+            rs->record_count = n / sizeof(ShardRecord);
+            rs->record_pos = 0;
+        }
+    }
+
+    if (!rs->archived) {
+        ssize_t n = store_read(rs->fd, t, sizeof(*t));
+        if (n == 0)
+            return 0;
+        if (n != sizeof(*t)) {
+            if (n >= 0)
+                errno = EIO;
+            return -1;
+        }
+        return 1;
+    }
+
+    if (rs->record_pos == rs->record_count) {
+        if (rs->next_block == rs->header.block_count)
+            return 0;
+        const BlockEntry *entry = &rs->blocks[rs->next_block++];
+        if (entry->raw_length % sizeof(Treasure) != 0 ||
+            entry->raw_length > rs->header.block_records * sizeof(Treasure) ||
+            archive_read_block(rs->fd, entry, (unsigned char *)rs->records) == -1) {
+            errno = EIO;
+            return -1;
+        }
+        rs->record_count = entry->raw_length / sizeof(Treasure);
+        rs->record_pos = 0;
+        if (rs->record_count == 0)
+            return 0;
+    }
+    *t = rs->records[rs->record_pos++];
+    return 1;
+}
+
+static inline void record_stream_close(RecordStream *rs) {
+    if (rs->fd != -1 && !rs->archived && !rs->sharded)
+        store_close(rs->fd);
+    else if (rs->fd != -1)
+        close(rs->fd);
+    free(rs->blocks);
+    free(rs->records);
+    free(rs->shard_records);
+    rs->fd = -1;
+    rs->blocks = NULL;
+    rs->records = NULL;
+    rs->shard_records = NULL;
+}
+
+/* hunt.meta describes a directory hunt's treasures.dat so readers can
+   avoid scanning it. It is only trusted while source_ino still names the
+   record file it was written for (rewrites replace the file).
+
+   After "sort" the first sorted_count records are ordered by treasure_id;
+   later appends form an unsorted tail that the next rewrite merges in.
+   The stats block is kept up to date by every add and recomputed after
+   rewrites; it is current when stats.records matches the file. */
+#define META_FILE "hunt.meta"
+#define META_MAGIC "HMT1"
+#define META_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_ino;
+    uint64_t sorted_count;
+    HuntStats stats;
+} HuntMeta;
+
+static inline void hunt_stats_add(HuntStats *s, const Treasure *t, int new_user) {
+    if (s->records == 0) {
+        s->min_value = s->max_value = t->value;
+        s->min_latitude = s->max_latitude = t->latitude;
+        s->min_longitude = s->max_longitude = t->longitude;
+    } else {
+        if (t->value < s->min_value)
+            s->min_value = t->value;
+        if (t->value > s->max_value)
+            s->max_value = t->value;
+        if (t->latitude < s->min_latitude)
+            s->min_latitude = t->latitude;
+        if (t->latitude > s->max_latitude)
+            s->max_latitude = t->latitude;
+        if (t->longitude < s->min_longitude)
+            s->min_longitude = t->longitude;
+        if (t->longitude > s->max_longitude)
+            s->max_longitude = t->longitude;
+    }
+    s->records++;
+    s->total_value += t->value;
+    if (new_user)
+        s->distinct_users++;
+}
+
+/* Reads the meta of a hunt whose record file has stat st; -1 when it is
+   missing or describes another version of the file. */
+static inline int hunt_meta_read(const char *hunt_id, HuntMeta *meta, const struct stat *st) {
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, META_FILE) == -1)
+        return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    ssize_t n = read(fd, meta, sizeof(*meta));
+    close(fd);
+
+    if (n != sizeof(*meta) || memcmp(meta->magic, META_MAGIC, 4) != 0 || meta->version != META_VERSION ||
+        meta->source_ino != (uint64_t)st->st_ino ||
+        meta->sorted_count > (uint64_t)st->st_size / sizeof(Treasure)) {
+        errno = ESTALE;
+        return -1;
+    }
+    return 0;
+}
+
+/* Position of the first record in the sorted prefix with an ID >= id
+   (sorted_count when there is none), or -1 on a read error. */
+static inline int64_t sorted_lower_bound(int fd, uint64_t sorted_count, int32_t id) {
+    uint64_t lo = 0, hi = sorted_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int32_t mid_id;
+        if (pread(fd, &mid_id, sizeof(mid_id), mid * sizeof(Treasure) + offsetof(Treasure, treasure_id)) !=
+            sizeof(mid_id))
+            return -1;
+        if (mid_id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Looks id up in a sorted hunt: binary search over the prefix, then a scan
+   of the tail. Returns 1 when found, 0 when not, -1 on error. */
+static inline int sorted_find(int fd, const struct stat *st, const HuntMeta *meta, int32_t id, Treasure *t) {
+    int64_t pos = sorted_lower_bound(fd, meta->sorted_count, id);
+    if (pos == -1)
+        return -1;
+    if ((uint64_t)pos < meta->sorted_count) {
+        if (pread(fd, t, sizeof(*t), pos * sizeof(Treasure)) != sizeof(*t))
+            return -1;
+        if (t->treasure_id == id)
+            return 1;
+    }
+
+    Treasure tail[64];
+    uint64_t total = st->st_size / sizeof(Treasure);
+    for (uint64_t i = meta->sorted_count; i < total; ) {
+        size_t want = total - i < 64 ? total - i : 64;
+        ssize_t n = pread(fd, tail, want * sizeof(Treasure), i * sizeof(Treasure));
+        if (n <= 0)
+            return n == 0 ? 0 : -1;
+        for (size_t k = 0; k < n / sizeof(Treasure); k++) {
+            if (tail[k].treasure_id == id) {
+                *t = tail[k];
+                return 1;
+            }
+        }
+        i += n / sizeof(Treasure);
+    }
+    return 0;
+}
+
+/* Open-addressing hash set of non-zero 64-bit keys, kept at most half
+   full so lookups stay O(1). It lives in memory, or in a file mapped with
+   key_set_open/key_set_save; the header then records which version of a
+   hunt's records the set was built from (source_ino and records for
+   directory hunts, generation and records for sharded ones). */
+#define KEY_SET_MAGIC "TKS1"
+#define KEY_SET_MIN_CAPACITY 1024
+
+typedef struct {
+    char magic[4];
+    uint32_t capacity;      /* slots, a power of two */
+    uint64_t count;
+    uint64_t source_ino;
+    uint64_t records;
+    uint32_t generation;
+    uint32_t reserved;
+} KeySetHeader;
+
+typedef struct {
+    KeySetHeader *header;
+    uint64_t *slots;        /* 0 marks an empty slot */
+    size_t size;
+    int mapped;
+    char path[PATH_MAX];
+} KeySet;
+
+static inline uint64_t treasure_key(int32_t treasure_id) {
+    return (uint64_t)(uint32_t)treasure_id | (1ULL << 32);
+}
+
+static inline uint64_t user_key(const char *username) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < USERNAME_LEN && username[i]; i++)
+        h = (h ^ (unsigned char)username[i]) * 1099511628211ULL;
+    return h ? h : 1;
+}
+
+static inline int key_set_init(KeySet *set, uint32_t capacity) {
+    set->size = sizeof(KeySetHeader) + (size_t)capacity * sizeof(uint64_t);
+    set->header = calloc(1, set->size);
+    if (!set->header)
+        return -1;
+    memcpy(set->header->magic, KEY_SET_MAGIC, 4);
+    set->header->capacity = capacity;
+    set->slots = (uint64_t *)(set->header + 1);
+    set->mapped = 0;
+    return 0;
+}
+
+static inline void key_set_free(KeySet *set) {
+    if (!set->header)
+        return;
+    if (set->mapped)
+        munmap(set->header, set->size);
+    else
+        free(set->header);
+    set->header = NULL;
+}
+
+/* The slot holding key, or the empty slot where it would go. */
+static inline uint64_t *key_set_probe(const KeySet *set, uint64_t key) {
+    uint32_t mask = set->header->capacity - 1;
+    uint64_t x = key * 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = (uint32_t)(x >> 32) & mask;; i = (i + 1) & mask) {
+        if (set->slots[i] == 0 || set->slots[i] == key)
+            return &set->slots[i];
+    }
+}
+
+static inline int key_set_contains(const KeySet *set, uint64_t key) {
+    return *key_set_probe(set, key) != 0;
+}
+
+/* Writes an in-memory set to set->path (through a temporary file and a
+   rename) and switches it over to the mapped file. */
+static inline int key_set_save(KeySet *set) {
+    char temp_path[PATH_MAX];
+    if (path_format(temp_path, sizeof(temp_path), "%s.tmp", set->path) == -1)
+        return -1;
+
+    int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return -1;
+    const char *p = (const char *)set->header;
+    size_t left = set->size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) {
+            close(fd);
+            unlink(temp_path);
+            return -1;
+        }
+        p += n;
+        left -= n;
+    }
+    if (rename(temp_path, set->path) == -1) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+
+    void *map = mmap(NULL, set->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    free(set->header);
+    set->header = map;
+    set->slots = (uint64_t *)(set->header + 1);
+    set->mapped = 1;
+    return 0;
+}
+
+static inline int key_set_open(KeySet *set, const char *path) {
+    set->header = NULL;
+    if (path_format(set->path, sizeof(set->path), "%s", path) == -1)
+        return -1;
+
+    int fd = open(path, O_RDWR);
+    if (fd == -1)
+        return -1;
+
+    KeySetHeader header;
+    struct stat st;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || fstat(fd, &st) == -1 ||
+        memcmp(header.magic, KEY_SET_MAGIC, 4) != 0 || header.capacity == 0 ||
+        (header.capacity & (header.capacity - 1)) != 0 ||
+        (size_t)st.st_size != sizeof(header) + (size_t)header.capacity * sizeof(uint64_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    set->header = map;
+    set->slots = (uint64_t *)(set->header + 1);
+    set->size = st.st_size;
+    set->mapped = 1;
+    return 0;
+}
+
+/* Returns 1 when key was added, 0 when it was already present, -1 on error.
+   The table doubles (and is saved again, if file backed) once half full. */
+static inline int key_set_insert(KeySet *set, uint64_t key) {
+    uint64_t *slot = key_set_probe(set, key);
+    if (*slot != 0)
+        return 0;
+
+    if ((set->header->count + 1) * 2 > set->header->capacity) {
+        KeySet bigger;
+        snprintf(bigger.path, sizeof(bigger.path), "%s", set->path);
+        if (key_set_init(&bigger, set->header->capacity * 2) == -1)
+            return -1;
+        KeySetHeader *h = bigger.header;
+        h->source_ino = set->header->source_ino;
+        h->records = set->header->records;
+        h->generation = set->header->generation;
+        for (uint32_t i = 0; i < set->header->capacity; i++) {
+            if (set->slots[i] == 0)
+                continue;
+            *key_set_probe(&bigger, set->slots[i]) = set->slots[i];
+            h->count++;
+        }
+
+        int mapped = set->mapped;
+        key_set_free(set);
+        *set = bigger;
+        if (mapped && key_set_save(set) == -1)
+            return -1;
+        slot = key_set_probe(set, key);
+    }
+
+    *slot = key;
+    set->header->count++;
+    return 1;
+}
+
+/* Summary of any hunt by a full scan, for hunts without a current
+   hunt.meta (archived and sharded hunts, or a stale meta). */
+static inline int hunt_stats_scan(const char *hunt_id, HuntStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1)
+        return -1;
+
+    KeySet users;
+    users.path[0] = '\0';
+    if (key_set_init(&users, KEY_SET_MIN_CAPACITY) == -1) {
+        record_stream_close(&rs);
+        return -1;
+    }
+
+    Treasure t;
+    int result;
+    while ((result = record_stream_next(&rs, &t)) == 1)
+        hunt_stats_add(stats, &t, key_set_insert(&users, user_key(t.username)) == 1);
+    key_set_free(&users);
+    record_stream_close(&rs);
+    return result == -1 ? -1 : 0;
+}
+
+/* A hunt's summary: straight from hunt.meta when it is current, otherwise
+   by scanning the records. */
+static inline int hunt_stats_get(const char *hunt_id, HuntStats *stats) {
+    char path[PATH_MAX];
+    struct stat st;
+    HuntMeta meta;
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == 0 && stat(path, &st) == 0 && hunt_meta_read(hunt_id, &meta, &st) == 0 &&
+        meta.stats.records == (uint64_t)st.st_size / sizeof(Treasure)) {
+        *stats = meta.stats;
+        return 0;
+    }
+    return hunt_stats_scan(hunt_id, stats);
+}
+
+/* Global user index: user_index/bucket-NNN.idx holds, for every user
+   hashing to that bucket, one entry per treasure they added anywhere. Adds
+   append to a bucket; rewriting or removing a hunt replaces the buckets
+   that held its entries through a temporary file and a rename, with
+   writers serialized by user_index/lock. Entries point at a record by
+   position and are only believed when the record found there still
+   matches, so entries an interrupted rewrite left behind are skipped by
+   readers and dropped by "reindex_users". */
+#define USER_INDEX_DIR "user_index"
+#define USER_INDEX_BUCKETS 256
+#define USER_ENTRY_SHARDED 0x1
+
+typedef struct __attribute__((packed)) {
+    char username[USERNAME_LEN];
+    char hunt_id[HUNT_ID_LEN];
+    uint64_t source;        /* treasures.dat inode, or slot generation when sharded */
+    uint64_t position;      /* record index in treasures.dat or in the shard file */
+    int32_t treasure_id;
+    uint32_t flags;
+} UserIndexEntry;
+
+static inline uint32_t user_index_bucket(const char *username) {
+    return (uint32_t)(user_key(username) % USER_INDEX_BUCKETS);
+}
+
+static inline int user_index_path(char *path, size_t size, uint32_t bucket) {
+    return path_format(path, size, "%s/bucket-%03u.idx", USER_INDEX_DIR, bucket);
+}
+
+/* Reads the record an entry points at and checks that it is still the one
+   the entry was written for. Returns 1 and fills *t when it is. */
+static inline int user_entry_resolve(const UserIndexEntry *e, Treasure *t) {
+    char path[PATH_MAX];
+    if (e->flags & USER_ENTRY_SHARDED) {
+        ShardTableHeader header;
+        HuntSlot slot;
+        int table_fd = shard_table_open(O_RDONLY, &header);
+        if (table_fd == -1)
+            return 0;
+        long index = shard_find(table_fd, &header, e->hunt_id, &slot, NULL);
+        close(table_fd);
+        if (index == -1 || slot.generation != e->source)
+            return 0;
+
+        ShardRecord r;
+        int fd = shard_path(path, sizeof(path), &header, e->hunt_id) == -1 ? -1 : open(path, O_RDONLY);
+        if (fd == -1)
+            return 0;
+        ssize_t n = pread(fd, &r, sizeof(r), e->position * sizeof(ShardRecord));
+        close(fd);
+        if (n != sizeof(r) || (long)r.slot != index || r.generation != slot.generation ||
+            (r.flags & SHARD_RECORD_REMOVED))
+            return 0;
+        *t = r.treasure;
+    } else {
+        struct stat st;
+        int fd = path_format(path, sizeof(path), "%.*s/%s", HUNT_ID_LEN, e->hunt_id, RECORD_FILE) == -1 ? -1 :
+                 open(path, O_RDONLY);
+        if (fd == -1)
+            return 0;
+        ssize_t n = -1;
+        if (fstat(fd, &st) == 0 && (uint64_t)st.st_ino == e->source)
+            n = pread(fd, t, sizeof(*t), e->position * sizeof(Treasure));
+        close(fd);
+        if (n != sizeof(*t))
+            return 0;
+    }
+    return t->treasure_id == e->treasure_id &&
+           strncmp(t->username, e->username, USERNAME_LEN) == 0;
+}
+
+/* Calls fn for every hunt: directory hunts, then archived ones when
+   include_archived is set, then live sharded hunts. Stops at the first
+   nonzero return of fn and returns it. */
+static inline int for_each_hunt(int (*fn)(const char *hunt_id, void *arg), void *arg, int include_archived) {
+    DIR *dir = opendir(".");
+    if (!dir)
+        return -1;
+    struct dirent *entry;
+    int result = 0;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        char path[512];
+        struct stat st;
+        size_t len = strlen(entry->d_name);
+        size_t suffix = strlen(ARCHIVE_SUFFIX);
+        if (entry->d_name[0] == '.')
+            continue;
+        if (include_archived && len > suffix && len - suffix < 256 &&
+            strcmp(entry->d_name + len - suffix, ARCHIVE_SUFFIX) == 0) {
+            char hunt_id[256];
+            memcpy(hunt_id, entry->d_name, len - suffix);
+            hunt_id[len - suffix] = '\0';
+            result = fn(hunt_id, arg);
+            continue;
+        }
+        if (path_format(path, sizeof(path), "%s/%s", entry->d_name, RECORD_FILE) == 0 &&
+            stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            result = fn(entry->d_name, arg);
+    }
+    closedir(dir);
+
+    ShardTableHeader header;
+    int fd = result == 0 ? shard_table_open(O_RDONLY, &header) : -1;
+    if (fd == -1)
+        return result;
+    HuntSlot slot;
+    for (uint32_t i = 0; i < header.slot_count && result == 0; i++) {
+        if (pread(fd, &slot, sizeof(slot), shard_slot_offset(i)) != sizeof(slot))
+            break;
+        if (slot.state == SLOT_LIVE)
+            result = fn(slot.hunt_id, arg);
+    }
+    close(fd);
+    return result;
+}
+
+/* Clue search index: clues.idx (shards/<hunt>.clues for sharded hunts)
+   maps every token of the clue texts, a lowercased run of letters and
+   digits kept as a 64-bit hash, to the sorted IDs of the treasures whose
+   clue contains it:
+
+     ClueIndexHeader | ClueToken[token_count] | int32 ids[posting_count] | CluePair[log_count]
+
+   add appends its (token, id) pairs to the log at the end instead of
+   rebuilding the table; the manager rebuilds the file in bulk once the log
+   grows and whenever the records are rewritten. */
+#define CLUE_INDEX_FILE "clues.idx"
+#define CLUE_INDEX_MAGIC "TCI1"
+#define CLUE_MAX_TOKENS 64      /* distinct tokens indexed per clue */
+#define CLUE_QUERY_TERMS 32
+
+typedef struct {
+    char magic[4];
+    uint32_t token_count;
+    uint64_t posting_count;
+    uint64_t log_count;
+    uint64_t source_ino;
+    uint64_t records;           /* records covered, log included */
+    uint32_t generation;
+    uint32_t reserved;
+} ClueIndexHeader;
+
+typedef struct {
+    uint64_t token;
+    uint64_t first;             /* index of the token's first posting */
+    uint32_t count;
+    uint32_t reserved;
+} ClueToken;
+
+typedef struct __attribute__((packed)) {
+    uint64_t token;
+    int32_t treasure_id;
+} CluePair;
+
+typedef struct {
+    ClueIndexHeader header;     /* as checked at open; adds may move the file's copy on */
+    void *map;
+    const ClueToken *tokens;
+    const int32_t *ids;
+    const CluePair *log;
+    size_t size;
+} ClueIndex;
+
+/* Terms of one OR group must all appear in a clue; the query matches when
+   any group does. */
+typedef struct {
+    uint64_t terms[CLUE_QUERY_TERMS];
+    uint32_t group[CLUE_QUERY_TERMS];
+    size_t count;
+} ClueQuery;
+
+static inline int clue_index_path(char *path, size_t size, const char *hunt_id, int sharded) {
+    if (sharded)
+        return path_format(path, size, "%s/%s.clues", SHARD_DIR, hunt_id);
+    return path_format(path, size, "%s/%s", hunt_id, CLUE_INDEX_FILE);
+}
+
+static inline int clue_char(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* Splits text into distinct token hashes; returns how many were stored. */
+static inline size_t clue_tokenize(const char *text, size_t len, uint64_t *tokens, size_t max) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < len && text[i]) {
+        if (!clue_char(text[i])) {
+            i++;
+            continue;
+        }
+        uint64_t h = 14695981039346656037ULL;
+        for (; i < len && clue_char(text[i]); i++) {
+            unsigned char c = text[i];
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            h = (h ^ c) * 1099511628211ULL;
+        }
+        h = h ? h : 1;
+
+        size_t j = 0;
+        while (j < count && tokens[j] != h)
+            j++;
+        if (j == count && count < max)
+            tokens[count++] = h;
+    }
+    return count;
+}
+
+/* Words are ANDed; the word OR starts a new group and AND is optional.
+   Returns -1 when the query has no searchable term. */
+static inline int clue_query_parse(const char *text, ClueQuery *q) {
+    q->count = 0;
+    uint32_t group = 0;
+    int group_used = 0;
+    const char *p = text;
+    while (*p) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        size_t len = strcspn(p, " \t");
+        if (len == 0)
+            break;
+        if (len == 2 && strncmp(p, "OR", 2) == 0) {
+            if (group_used)
+                group++;
+            group_used = 0;
+        } else if (!(len == 3 && strncmp(p, "AND", 3) == 0)) {
+            size_t n = clue_tokenize(p, len, q->terms + q->count, CLUE_QUERY_TERMS - q->count);
+            for (size_t i = 0; i < n; i++)
+                q->group[q->count + i] = group;
+            q->count += n;
+            group_used |= n > 0;
+        }
+        p += len;
+    }
+    return q->count > 0 ? 0 : -1;
+}
+
+static inline int clue_query_match(const ClueQuery *q, const uint64_t *tokens, size_t n) {
+    for (size_t i = 0; i < q->count;) {
+        uint32_t group = q->group[i];
+        int all = 1;
+        for (; i < q->count && q->group[i] == group; i++) {
+            size_t j = 0;
+            while (j < n && tokens[j] != q->terms[i])
+                j++;
+            all &= j < n;
+        }
+        if (all)
+            return 1;
+    }
+    return 0;
+}
+
+static inline int compare_int32(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts ids and drops repeats; returns the new count. */
+static inline size_t id_list_unique(int32_t *ids, size_t n) {
+    if (n == 0)
+        return 0;
+    qsort(ids, n, sizeof(int32_t), compare_int32);
+    size_t out = 1;
+    for (size_t i = 1; i < n; i++) {
+        if (ids[i] != ids[out - 1])
+            ids[out++] = ids[i];
+    }
+    return out;
+}
+
+/* The record file version a hunt's sidecars are stamped with. */
+static inline int hunt_version(const char *hunt_id, int *sharded, uint64_t *ino, uint64_t *records,
+                               uint32_t *generation) {
+    char path[PATH_MAX];
+    struct stat st;
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1)
+        return -1;
+    if (stat(path, &st) == 0) {
+        *sharded = 0;
+        *ino = st.st_ino;
+        *records = st.st_size / sizeof(Treasure);
+        *generation = 0;
+        return 0;
+    }
+
+    ShardTableHeader header;
+    HuntSlot slot;
+    int fd = shard_table_open(O_RDONLY, &header);
+    if (fd == -1)
+        return -1;
+    long index = shard_find(fd, &header, hunt_id, &slot, NULL);
+    close(fd);
+    if (index == -1)
+        return -1;
+    *sharded = 1;
+    *ino = 0;
+    *records = slot.record_count;
+    *generation = slot.generation;
+    return 0;
+}
+
+/* Maps a clue index; fails unless it is well formed and covers exactly the
+   given version of the records. */
+static inline int clue_index_open(ClueIndex *ci, const char *path, uint64_t ino, uint64_t records,
+                                  uint32_t generation, int sharded) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    ClueIndexHeader h;
+    if (fstat(fd, &st) == -1 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+        memcmp(h.magic, CLUE_INDEX_MAGIC, 4) != 0 || h.records != records ||
+        (sharded ? h.generation != generation : h.source_ino != ino) ||
+        (uint64_t)st.st_size < sizeof(h) + h.token_count * sizeof(ClueToken) +
+                               h.posting_count * sizeof(int32_t) + h.log_count * sizeof(CluePair)) {
+        close(fd);
+        errno = ESTALE;
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    ci->header = h;
+    ci->map = map;
+    ci->size = st.st_size;
+    ci->tokens = (const ClueToken *)((const char *)map + sizeof(h));
+    ci->ids = (const int32_t *)(ci->tokens + h.token_count);
+    ci->log = (const CluePair *)(ci->ids + h.posting_count);
+    return 0;
+}
+
+static inline void clue_index_close(ClueIndex *ci) {
+    munmap(ci->map, ci->size);
+}
+
+/* Sorted IDs of the treasures whose clue has token (table plus log). */
+static inline int32_t *clue_postings(const ClueIndex *ci, uint64_t token, size_t *count) {
+    const ClueToken *found = NULL;
+    size_t lo = 0, hi = ci->header.token_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ci->tokens[mid].token < token) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < ci->header.token_count && ci->tokens[lo].token == token)
+        found = &ci->tokens[lo];
+
+    size_t base = found ? found->count : 0, extra = 0;
+    for (uint64_t i = 0; i < ci->header.log_count; i++)
+        extra += ci->log[i].token == token;
+
+    int32_t *ids = malloc((base + extra + 1) * sizeof(int32_t));
+    if (!ids)
+        return NULL;
+    if (found)
+        memcpy(ids, ci->ids + found->first, base * sizeof(int32_t));
+    size_t n = base;
+    for (uint64_t i = 0; i < ci->header.log_count && extra > 0; i++) {
+        if (ci->log[i].token == token)
+            ids[n++] = ci->log[i].treasure_id;
+    }
+    *count = extra ? id_list_unique(ids, n) : n;
+    return ids;
+}
+
+static inline int clue_search_index(const ClueIndex *ci, const ClueQuery *q, int32_t **ids, size_t *count) {
+    int32_t *result = NULL;
+    size_t result_count = 0;
+    for (size_t i = 0; i < q->count;) {
+        uint32_t group = q->group[i];
+        int32_t *matches = NULL;
+        size_t match_count = 0;
+        for (; i < q->count && q->group[i] == group; i++) {
+            if (matches && match_count == 0)
+                continue;
+            size_t n;
+            int32_t *postings = clue_postings(ci, q->terms[i], &n);
+            if (!postings) {
+                free(matches);
+                free(result);
+                return -1;
+            }
+            if (!matches) {
+                matches = postings;
+                match_count = n;
+                continue;
+            }
+            size_t a = 0, b = 0, out = 0;
+            while (a < match_count && b < n) {
+                if (matches[a] < postings[b]) {
+                    a++;
+                } else if (matches[a] > postings[b]) {
+                    b++;
+                } else {
+                    matches[out++] = matches[a++];
+                    b++;
+                }
+            }
+            match_count = out;
+            free(postings);
+        }
+
+        int32_t *grown = realloc(result, (result_count + match_count + 1) * sizeof(int32_t));
+        if (!grown) {
+            free(matches);
+            free(result);
+            return -1;
+        }
+        result = grown;
+        memcpy(result + result_count, matches, match_count * sizeof(int32_t));
+        result_count += match_count;
+        free(matches);
+    }
+    *ids = result;
+    *count = id_list_unique(result, result_count);
+    return 0;
+}
+
+static inline int clue_search_scan(const char *hunt_id, const ClueQuery *q, int32_t **ids, size_t *count) {
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1)
+        return -1;
+
+    size_t capacity = 64, n = 0;
+    int32_t *result = malloc(capacity * sizeof(int32_t));
+    Treasure t;
+    int status = 0;
+    while (result && (status = record_stream_next(&rs, &t)) == 1) {
+        uint64_t tokens[CLUE_MAX_TOKENS];
+        size_t token_count = clue_tokenize(t.clue, CLUE_LEN, tokens, CLUE_MAX_TOKENS);
+        if (!clue_query_match(q, tokens, token_count))
+            continue;
+        if (n == capacity) {
+            int32_t *grown = realloc(result, capacity * 2 * sizeof(int32_t));
+            if (!grown)
+                break;
+            result = grown;
+            capacity *= 2;
+        }
+        result[n++] = t.treasure_id;
+    }
+    record_stream_close(&rs);
+    if (!result || status != 0) {
+        free(result);
+        return -1;
+    }
+    *ids = result;
+    *count = id_list_unique(result, n);
+    return 0;
+}
+
+/* Treasure IDs of a hunt whose clue matches q, in ascending order. Served
+   from the clue index when it is current, otherwise by scanning the
+   records. Returns 1 when the index was used, 0 after a scan, -1 on error. */
+static inline int clue_search(const char *hunt_id, const ClueQuery *q, int32_t **ids, size_t *count) {
+    int sharded;
+    uint64_t ino, records;
+    uint32_t generation;
+    if (hunt_version(hunt_id, &sharded, &ino, &records, &generation) == 0) {
+        char path[PATH_MAX];
+        ClueIndex ci;
+        if (clue_index_path(path, sizeof(path), hunt_id, sharded) == 0 &&
+            clue_index_open(&ci, path, ino, records, generation, sharded) == 0) {
+            int result = clue_search_index(&ci, q, ids, count);
+            clue_index_close(&ci);
+            return result == -1 ? -1 : 1;
+        }
+    }
+    return clue_search_scan(hunt_id, q, ids, count) == -1 ? -1 : 0;
+}
+
+/* Record checksums: treasures.crc holds one CRC32C per block of
+   CHECKSUM_BLOCK_RECORDS records of treasures.dat (the last block may be
+   partial), stamped like the other sidecars with the inode and record
+   count it covers:
+
+     ChecksumHeader | uint32 crc[(records + 63) / 64]
+
+   add extends the CRC of the last block (CRC32C chains across appends);
+   every rewrite rebuilds the file with the hunt's other sidecars.
+   "fsck --salvage" moves the records of damaged blocks to DAMAGED_FILE. */
+#define CHECKSUM_FILE "treasures.crc"
+#define DAMAGED_FILE "treasures.damaged"
+#define CHECKSUM_MAGIC "TCK1"
+#define CHECKSUM_BLOCK_RECORDS 64
+
+typedef struct {
+    char magic[4];
+    uint32_t block_records;
+    uint64_t source_ino;
+    uint64_t records;
+} ChecksumHeader;
+
+static inline uint32_t checksum_blocks(uint64_t records) {
+    return (records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+}
+
+static inline int checksum_path(char *path, size_t size, const char *hunt_id) {
+    return path_format(path, size, "%s/%s", hunt_id, CHECKSUM_FILE);
+}
+
+/* Loads the block checksums of a hunt when they were written for the file
+   with inode ino; *header tells how many records they cover (fewer than
+   the file holds when an add was interrupted). Returns NULL otherwise. */
+static inline uint32_t *checksum_load(const char *hunt_id, uint64_t ino, ChecksumHeader *header) {
+    char path[PATH_MAX];
+    if (checksum_path(path, sizeof(path), hunt_id) == -1)
+        return NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    uint32_t *crcs = NULL;
+    if (read(fd, header, sizeof(*header)) == sizeof(*header) &&
+        memcmp(header->magic, CHECKSUM_MAGIC, 4) == 0 &&
+        header->block_records == CHECKSUM_BLOCK_RECORDS && header->source_ino == ino) {
+        size_t size = checksum_blocks(header->records) * sizeof(uint32_t);
+        crcs = malloc(size ? size : 1);
+        if (crcs && read(fd, crcs, size) != (ssize_t)size) {
+            free(crcs);
+            crcs = NULL;
+        }
+    }
+    close(fd);
+    return crcs;
+}
+
+/* Scoring rules of a hunt (see score_calculator.c): <hunt>/scoring.rules
+   for directory hunts, <hunt>.rules next to the archive for hunts without
+   a directory. archive and restore move the file between the two. */
+#define RULES_FILE "scoring.rules"
+#define RULES_SUFFIX ".rules"
+
+static inline int rules_path(char *path, size_t size, const char *hunt_id) {
+    struct stat st;
+    if (stat(hunt_id, &st) == 0 && S_ISDIR(st.st_mode))
+        return path_format(path, size, "%s/%s", hunt_id, RULES_FILE);
+    return path_format(path, size, "%s%s", hunt_id, RULES_SUFFIX);
+}
+
+/* Insertion times: treasures.ts keeps, for every block of
+   TIME_BLOCK_RECORDS records of treasures.dat, the time each record was
+   added (seconds since the epoch, 0 when unknown) with its treasure ID,
+   plus the block's earliest and latest time, so that time-windowed
+   queries read only the blocks whose range overlaps the window:
+
+     TimesHeader | TimeBlock[(records + 63) / 64]
+
+   Unlike the other sidecars the times cannot be derived from the records.
+   add fills in the last block; rewrites carry the times over by treasure
+   ID, and records of hunts older than the file get theirs from the
+   "Added treasure ID" entries of logged_hunt. */
+#define TIMES_FILE "treasures.ts"
+#define TIMES_MAGIC "TTS1"
+#define TIME_BLOCK_RECORDS 64
+
+typedef struct {
+    char magic[4];
+    uint32_t block_records;
+    uint64_t source_ino;
+    uint64_t records;
+} TimesHeader;
+
+typedef struct {
+    int64_t min, max;               /* over the known times; min > max when none */
+    int64_t added[TIME_BLOCK_RECORDS];
+    int32_t ids[TIME_BLOCK_RECORDS];
+} TimeBlock;
+
+/* Records added in [since, until]; records of unknown time never match. */
+typedef struct {
+    int64_t since, until;
+} TimeWindow;
+
+typedef struct {
+    uint64_t blocks;        /* blocks in the hunt */
+    uint64_t blocks_read;   /* blocks whose records had to be read */
+} TimeScanStats;
+
+static inline int times_path(char *path, size_t size, const char *hunt_id) {
+    return path_format(path, size, "%s/%s", hunt_id, TIMES_FILE);
+}
+
+static inline void time_block_init(TimeBlock *b) {
+    memset(b, 0, sizeof(*b));
+    b->min = INT64_MAX;
+    b->max = INT64_MIN;
+}
+
+static inline void time_block_set(TimeBlock *b, unsigned slot, int32_t id, int64_t added) {
+    b->ids[slot] = id;
+    b->added[slot] = added;
+    if (added != 0) {
+        if (added < b->min)
+            b->min = added;
+        if (added > b->max)
+            b->max = added;
+    }
+}
+
+/* Parses a time argument: seconds since the epoch, "now", an age such as
+   "-90s", "-30m", "-1h" or "-7d", or a local "YYYY-MM-DD[THH:MM[:SS]]". */
+static inline int parse_time_arg(const char *arg, int64_t *out) {
+    char *end;
+    time_t now = time(NULL);
+    if (strcmp(arg, "now") == 0) {
+        *out = now;
+        return 0;
+    }
+    if (arg[0] == '-') {
+        long long n = strtoll(arg + 1, &end, 10);
+        int unit = *end == 's' ? 1 : *end == 'm' ? 60 : *end == 'h' ? 3600 : *end == 'd' ? 86400 : 0;
+        if (end == arg + 1 || n < 0 || unit == 0 || end[1] != '\0')
+            return -1;
+        *out = now - n * unit;
+        return 0;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int consumed = 0;
+    if (sscanf(arg, "%d-%d-%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &consumed) == 3 && consumed > 0) {
+        const char *rest = arg + consumed;
+        if (*rest == 'T' || *rest == ' ') {
+            int fields = sscanf(rest + 1, "%d:%d:%d%n", &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed);
+            if (fields < 2)
+                return -1;
+            if (fields == 2)
+                sscanf(rest + 1, "%d:%d%n", &tm.tm_hour, &tm.tm_min, &consumed);
+            rest += 1 + consumed;
+        }
+        if (*rest != '\0')
+            return -1;
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        time_t t = mktime(&tm);
+        if (t == (time_t)-1)
+            return -1;
+        *out = t;
+        return 0;
+    }
+
+    long long seconds = strtoll(arg, &end, 10);
+    if (end == arg || *end != '\0')
+        return -1;
+    *out = seconds;
+    return 0;
+}
+
+/* Formats t as local "YYYY-MM-DD HH:MM:SS" ("unknown" for 0). */
+static inline const char *format_time(int64_t t, char *buf, size_t size) {
+    time_t seconds = t;
+    struct tm tm;
+    if (t == 0 || !localtime_r(&seconds, &tm) || strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm) == 0)
+        snprintf(buf, size, "%s", t == 0 ? "unknown" : "?");
+    return buf;
+}
+
+/* Parses "--since <time>" and "--until <time>" options out of args into w
+   (an open window when absent). Returns the number of arguments used, or
+   -1 on a malformed one. */
+static inline int parse_time_window(int argc, char *argv[], TimeWindow *w) {
+    w->since = 1;
+    w->until = INT64_MAX;
+    int used = 0;
+    while (used + 1 < argc) {
+        int64_t *field = strcmp(argv[used], "--since") == 0 ? &w->since :
+                         strcmp(argv[used], "--until") == 0 ? &w->until : NULL;
+        if (!field)
+            break;
+        if (parse_time_arg(argv[used + 1], field) == -1)
+            return -1;
+        used += 2;
+    }
+    return used < argc && strncmp(argv[used], "--", 2) == 0 ? -1 : used;
+}
+
+/* Calls fn for every record of a directory hunt added within w, in file
+   order, skipping whole blocks whose time range lies outside it. fn stops
+   the scan by returning non-zero. Returns 0, or -1 with errno ENODATA when
+   the hunt has no current times (sharded and archived hunts never do). */
+static inline int time_scan(const char *hunt_id, const TimeWindow *w,
+                            int (*fn)(const Treasure *t, int64_t added, void *arg), void *arg,
+                            TimeScanStats *stats) {
+    char path[PATH_MAX];
+    int record_fd = path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+                    open(path, O_RDONLY);
+    int times_fd = times_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDONLY);
+
+    TimesHeader header;
+    struct stat st;
+    if (record_fd == -1 || times_fd == -1 || fstat(record_fd, &st) == -1 ||
+        pread(times_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, TIMES_MAGIC, 4) != 0 || header.block_records != TIME_BLOCK_RECORDS ||
+        header.source_ino != (uint64_t)st.st_ino || header.records > (uint64_t)st.st_size / sizeof(Treasure)) {
+        if (record_fd != -1)
+            close(record_fd);
+        if (times_fd != -1)
+            close(times_fd);
+        errno = ENODATA;
+        return -1;
+    }
+
+    static TimeBlock blocks[64];
+    static Treasure records[TIME_BLOCK_RECORDS];
+    uint64_t block_count = (header.records + TIME_BLOCK_RECORDS - 1) / TIME_BLOCK_RECORDS;
+    int status = 0, stop = 0;
+    if (stats) {
+        stats->blocks = block_count;
+        stats->blocks_read = 0;
+    }
+    for (uint64_t first = 0; first < block_count && status == 0 && !stop; first += 64) {
+        uint64_t n = block_count - first < 64 ? block_count - first : 64;
+        ssize_t size = n * sizeof(TimeBlock);
+        if (pread(times_fd, blocks, size, sizeof(header) + first * sizeof(TimeBlock)) != size) {
+            status = -1;
+            break;
+        }
+        for (uint64_t b = 0; b < n && status == 0 && !stop; b++) {
+            if (blocks[b].max < w->since || blocks[b].min > w->until)
+                continue;
+            uint64_t position = (first + b) * TIME_BLOCK_RECORDS;
+            uint64_t count = header.records - position < TIME_BLOCK_RECORDS ?
+                             header.records - position : TIME_BLOCK_RECORDS;
+            ssize_t record_size = count * sizeof(Treasure);
+            if (pread(record_fd, records, record_size, position * sizeof(Treasure)) != record_size) {
+                status = -1;
+                break;
+            }
+            if (stats)
+                stats->blocks_read++;
+            for (uint64_t i = 0; i < count && !stop; i++) {
+                int64_t added = blocks[b].added[i];
+                if (added != 0 && added >= w->since && added <= w->until)
+                    stop = fn(&records[i], added, arg);
+            }
+        }
+    }
+    close(record_fd);
+    close(times_fd);
+    return status;
+}
+
+/* Approximate summaries: treasures.sk holds mergeable sketches of a
+   directory hunt's records, kept current by add and rebuilt with the other
+   sidecars on rewrites:
+
+     SketchHeader | HuntSketch
+
+   - distinct users: HyperLogLog over 2^12 one-byte registers, standard
+     error 1.04 / sqrt(4096) = 1.6%;
+   - value quantiles: values bucketed by magnitude on a logarithmic scale
+     with ratio (1 + a) / (1 - a), so any quantile is reported within a
+     relative error of a = 1%;
+   - top users by treasure count: Space-Saving with 64 counters. Every
+     user holding more than records / 64 treasures is listed, and each
+     count is high by at most the error recorded with it.
+
+   Sketches of different hunts merge (sketch_merge) with the same bounds
+   over the combined records. Hunts without a current file (sharded,
+   archived, or stale) are sketched by a scan instead. */
+#define SKETCH_FILE "treasures.sk"
+#define SKETCH_MAGIC "TSK1"
+#define SKETCH_HLL_BITS 12
+#define SKETCH_HLL_REGISTERS (1 << SKETCH_HLL_BITS)
+#define SKETCH_RELATIVE_ERROR 0.01
+#define SKETCH_VALUE_BUCKETS 1076       /* covers magnitudes up to 2^31 */
+#define SKETCH_TOP_K 64
+
+typedef struct {
+    char magic[4];
+    uint32_t top_k;
+    uint64_t source_ino;
+    uint64_t records;
+} SketchHeader;
+
+typedef struct {
+    char username[USERNAME_LEN];
+    uint64_t count;
+    uint64_t error;                     /* count is at most this much too high */
+} SketchCounter;
+
+typedef struct {
+    uint64_t records;
+    uint64_t zero;                      /* values equal to 0 */
+    uint64_t positive[SKETCH_VALUE_BUCKETS];
+    uint64_t negative[SKETCH_VALUE_BUCKETS];    /* by magnitude */
+    uint8_t registers[SKETCH_HLL_REGISTERS];
+    uint32_t top_used;
+    SketchCounter top[SKETCH_TOP_K];
+} HuntSketch;
+
+static inline int sketch_path(char *path, size_t size, const char *hunt_id) {
+    return path_format(path, size, "%s/%s", hunt_id, SKETCH_FILE);
+}
+
+static inline void sketch_init(HuntSketch *sk) {
+    memset(sk, 0, sizeof(*sk));
+}
+
+/* Natural logarithm, square root and integer powers without libm, which
+   none of the programs link: x = m * 2^e with m in [1, 2),
+   ln m = 2 atanh((m-1)/(m+1)). */
+static inline double sketch_ln(double x) {
+    int e = 0;
+    while (x >= 2.0) {
+        x /= 2.0;
+        e++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        e--;
+    }
+    double s = (x - 1.0) / (x + 1.0), s2 = s * s, term = s, sum = 0.0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= s2;
+    }
+    return 2.0 * sum + e * 0.6931471805599453;
+}
+
+static inline double sketch_pow(double base, unsigned exp) {
+    double result = 1.0;
+    while (exp) {
+        if (exp & 1)
+            result *= base;
+        base *= base;
+        exp >>= 1;
+    }
+    return result;
+}
+
+/* Newton's iteration from above, for x >= 0. */
+static inline double sketch_sqrt(double x) {
+    if (x <= 0.0)
+        return 0.0;
+    double r = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 64; i++) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+static inline double sketch_gamma(void) {
+    return (1.0 + SKETCH_RELATIVE_ERROR) / (1.0 - SKETCH_RELATIVE_ERROR);
+}
+
+/* Bucket i holds magnitudes in (gamma^(i-1), gamma^i]. */
+static inline unsigned sketch_bucket(uint32_t magnitude) {
+    static double ln_gamma;
+    if (ln_gamma == 0.0)
+        ln_gamma = sketch_ln(sketch_gamma());
+    double index = sketch_ln(magnitude) / ln_gamma;
+    unsigned i = (unsigned)index;
+    if (index > i)
+        i++;
+    return i < SKETCH_VALUE_BUCKETS ? i : SKETCH_VALUE_BUCKETS - 1;
+}
+
+static inline uint64_t sketch_hash(const char *username) {
+    uint64_t h = user_key(username);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+static inline SketchCounter *sketch_counter_find(HuntSketch *sk, const char *username) {
+    for (uint32_t i = 0; i < sk->top_used; i++) {
+        if (strncmp(sk->top[i].username, username, USERNAME_LEN) == 0)
+            return &sk->top[i];
+    }
+    return NULL;
+}
+
+static inline SketchCounter *sketch_counter_min(HuntSketch *sk) {
+    SketchCounter *min = &sk->top[0];
+    for (uint32_t i = 1; i < sk->top_used; i++) {
+        if (sk->top[i].count < min->count)
+            min = &sk->top[i];
+    }
+    return min;
+}
+
+static inline void sketch_add(HuntSketch *sk, const Treasure *t) {
+    sk->records++;
+    if (t->value == 0)
+        sk->zero++;
+    else if (t->value > 0)
+        sk->positive[sketch_bucket(t->value)]++;
+    else
+        sk->negative[sketch_bucket(-(int64_t)t->value)]++;
+
+    uint64_t h = sketch_hash(t->username);
+    uint32_t reg = h >> (64 - SKETCH_HLL_BITS);
+    uint8_t rank = __builtin_clzll((h << SKETCH_HLL_BITS) | (1ULL << (SKETCH_HLL_BITS - 1))) + 1;
+    if (rank > sk->registers[reg])
+        sk->registers[reg] = rank;
+
+    SketchCounter *c = sketch_counter_find(sk, t->username);
+    if (!c && sk->top_used < SKETCH_TOP_K) {
+        c = &sk->top[sk->top_used++];
+        memset(c, 0, sizeof(*c));
+        strncpy(c->username, t->username, USERNAME_LEN);
+    } else if (!c) {
+        /* Space-Saving: the new user takes over the smallest counter. */
+        c = sketch_counter_min(sk);
+        c->error = c->count;
+        strncpy(c->username, t->username, USERNAME_LEN);
+    }
+    c->count++;
+}
+
+static inline int compare_sketch_counters(const void *a, const void *b) {
+    const SketchCounter *x = a, *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/* Folds src into dst. A user missing from a full set of counters may have
+   up to that set's smallest count, which is added to both count and error
+   so the combined counts stay upper bounds. */
+static inline void sketch_merge(HuntSketch *dst, const HuntSketch *src) {
+    dst->records += src->records;
+    dst->zero += src->zero;
+    for (int i = 0; i < SKETCH_VALUE_BUCKETS; i++) {
+        dst->positive[i] += src->positive[i];
+        dst->negative[i] += src->negative[i];
+    }
+    for (int i = 0; i < SKETCH_HLL_REGISTERS; i++) {
+        if (src->registers[i] > dst->registers[i])
+            dst->registers[i] = src->registers[i];
+    }
+
+    static SketchCounter merged[2 * SKETCH_TOP_K];
+    uint64_t dst_floor = dst->top_used == SKETCH_TOP_K ? sketch_counter_min(dst)->count : 0;
+    uint64_t src_floor = src->top_used == SKETCH_TOP_K ?
+                         sketch_counter_min((HuntSketch *)src)->count : 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < dst->top_used; i++) {
+        merged[n] = dst->top[i];
+        SketchCounter *other = sketch_counter_find((HuntSketch *)src, dst->top[i].username);
+        merged[n].count += other ? other->count : src_floor;
+        merged[n].error += other ? other->error : src_floor;
+        n++;
+    }
+    for (uint32_t i = 0; i < src->top_used; i++) {
+        if (sketch_counter_find(dst, src->top[i].username))
+            continue;
+        merged[n] = src->top[i];
+        merged[n].count += dst_floor;
+        merged[n].error += dst_floor;
+        n++;
+    }
+    qsort(merged, n, sizeof(SketchCounter), compare_sketch_counters);
+    dst->top_used = n < SKETCH_TOP_K ? n : SKETCH_TOP_K;
+    memcpy(dst->top, merged, dst->top_used * sizeof(SketchCounter));
+}
+
+/* HyperLogLog estimate, with linear counting while registers are empty. */
+static inline double sketch_distinct(const HuntSketch *sk) {
+    const double m = SKETCH_HLL_REGISTERS;
+    double sum = 0.0;
+    unsigned empty = 0;
+    for (int i = 0; i < SKETCH_HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ULL << sk->registers[i]);
+        if (sk->registers[i] == 0)
+            empty++;
+    }
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && empty > 0)
+        estimate = m * sketch_ln(m / empty);
+    return estimate;
+}
+
+/* Estimated q-quantile of value (0 <= q <= 1); 0 for an empty sketch. */
+static inline double sketch_quantile(const HuntSketch *sk, double q) {
+    if (sk->records == 0)
+        return 0.0;
+    uint64_t rank = (uint64_t)(q * (sk->records - 1));
+    double gamma = sketch_gamma();
+    uint64_t seen = 0;
+    for (int i = SKETCH_VALUE_BUCKETS - 1; i >= 0; i--) {
+        seen += sk->negative[i];
+        if (seen > rank)
+            return -2.0 * sketch_pow(gamma, i) / (gamma + 1.0);
+    }
+    seen += sk->zero;
+    if (seen > rank)
+        return 0.0;
+    for (int i = 0; i < SKETCH_VALUE_BUCKETS; i++) {
+        seen += sk->positive[i];
+        if (seen > rank)
+            return 2.0 * sketch_pow(gamma, i) / (gamma + 1.0);
+    }
+    return 2.0 * sketch_pow(gamma, SKETCH_VALUE_BUCKETS - 1) / (gamma + 1.0);
+}
+
+/* Reads a directory hunt's sketch when it describes exactly the records of
+   the file st was taken from. */
+static inline int sketch_read(const char *hunt_id, HuntSketch *sk, const struct stat *st) {
+    char path[PATH_MAX];
+    if (sketch_path(path, sizeof(path), hunt_id) == -1)
+        return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    SketchHeader header;
+    int status = read(fd, &header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, SKETCH_MAGIC, 4) == 0 && header.top_k == SKETCH_TOP_K &&
+                 header.source_ino == (uint64_t)st->st_ino &&
+                 header.records == (uint64_t)st->st_size / sizeof(Treasure) &&
+                 read(fd, sk, sizeof(*sk)) == sizeof(*sk) && sk->records == header.records ? 0 : -1;
+    close(fd);
+    return status;
+}
+
+/* Sketch of any hunt: from treasures.sk when current, otherwise by reading
+   every record (*scanned is then set). */
+static inline int hunt_sketch_get(const char *hunt_id, HuntSketch *sk, int *scanned) {
+    char path[PATH_MAX];
+    struct stat st;
+    *scanned = 0;
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == 0 && stat(path, &st) == 0 &&
+        sketch_read(hunt_id, sk, &st) == 0)
+        return 0;
+
+    *scanned = 1;
+    sketch_init(sk);
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1)
+        return -1;
+    Treasure t;
+    int result;
+    while ((result = record_stream_next(&rs, &t)) == 1)
+        sketch_add(sk, &t);
+    record_stream_close(&rs);
+    return result == -1 ? -1 : 0;
+}
+
+/* The report behind the monitor's "approx" command and
+   "score_calculator --approx". */
+static inline void sketch_report(FILE *out, const char *name, const HuntSketch *sk, int top) {
+    fprintf(out, "Approximate summary for %s:\n", name);
+    fprintf(out, "  Records        : %llu\n", (unsigned long long)sk->records);
+    fprintf(out, "  Distinct users : ~%.0f (standard error %.1f%%)\n", sketch_distinct(sk),
+            104.0 / sketch_sqrt(SKETCH_HLL_REGISTERS));
+    fprintf(out, "  Value p50/p90/p99: ~%.1f / ~%.1f / ~%.1f (within %.0f%%)\n",
+            sketch_quantile(sk, 0.5), sketch_quantile(sk, 0.9), sketch_quantile(sk, 0.99),
+            SKETCH_RELATIVE_ERROR * 100);
+
+    static SketchCounter sorted[SKETCH_TOP_K];
+    memcpy(sorted, sk->top, sk->top_used * sizeof(SketchCounter));
+    qsort(sorted, sk->top_used, sizeof(SketchCounter), compare_sketch_counters);
+    int shown = top < (int)sk->top_used ? top : (int)sk->top_used;
+    fprintf(out, "  Top users (treasure count, at most +error too high; complete above %llu):\n",
+            (unsigned long long)(sk->records / SKETCH_TOP_K));
+    for (int i = 0; i < shown; i++)
+        fprintf(out, "    %-20.*s %llu (+%llu)\n", USERNAME_LEN, sorted[i].username,
+                (unsigned long long)sorted[i].count, (unsigned long long)sorted[i].error);
+}
+
+#endif
@@ -1,257 +1,2438 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <dirent.h>
-#include <unistd.h>
-#include <signal.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/wait.h>
-
-#define TREASURE_FILE "treasures.dat"
-#define USERNAME_LEN 50
-#define CLUE_LEN 255
-#define SIGCALC (SIGRTMAX + 1)
-
-typedef struct __attribute__((packed)) {
-    int treasure_id;               
-    char username[USERNAME_LEN];   
-    float latitude;                 
-    float longitude;                
-    char clue[CLUE_LEN];           
-    int value;                       
-} Treasure;
-
-int hub_pipe_fd[2];
-
-void calculate_score(const char *hunt_id);
-
-void list_hunts() {
-    DIR *dir = opendir(".");
-    if (!dir) {
-        perror("ERROR: Failed to open current directory");
-        fflush(stdout);
-        return;
-    }
-
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-            char file_path[256];
-            snprintf(file_path, sizeof(file_path), "%s/%s", entry->d_name, TREASURE_FILE);
-
-            struct stat st;
-            int count = 0;
-            if (stat(file_path, &st) == 0) {
-                count = st.st_size / sizeof(Treasure);
-            }
-            printf("HUNT %s %d\n", entry->d_name, count);
-            fflush(stdout);
-        }
-    }
-    closedir(dir);
-}
-
-void list_treasures(const char *hunt_id) {
-    char path[256];
-    snprintf(path, sizeof(path), "%s/%s", hunt_id, TREASURE_FILE);
-
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        perror("ERROR: Could not open treasure file for hunt");
-        fflush(stdout);
-        return;
-    }
-
-    printf("HUNT %s\n", hunt_id);
-    fflush(stdout);
-
-    Treasure t;
-    while (read(fd, &t, sizeof(Treasure)) == sizeof(Treasure)) {
-        printf("TREASURE %d %s %.6f %.6f %d\nCLUE: %s\n",
-               t.treasure_id, t.username, t.latitude, t.longitude, t.value, t.clue);
-        fflush(stdout);
-    }
-    close(fd);
-}
-
-void view_treasure(const char *hunt_id, int treasure_id) {
-    char path[256];
-    snprintf(path, sizeof(path), "%s/%s", hunt_id, TREASURE_FILE);
-
-    int fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        perror("ERROR: Could not open treasure file for hunt");
-        fflush(stdout);
-        return;
-    }
-
-    Treasure t;
-    int found = 0;
-    while (read(fd, &t, sizeof(Treasure)) == sizeof(Treasure)) {
-        if (t.treasure_id == treasure_id) {
-            found = 1;
-            printf("TREASURE %d %s %.6f %.6f %d\nCLUE: %s\n",
-                   t.treasure_id, t.username, t.latitude, t.longitude, t.value, t.clue);
-            fflush(stdout);
-            break;
-        }
-    }
-    if (!found) {
-        printf("ERROR: Treasure ID %d not found in hunt %s\n", treasure_id, hunt_id);
-        fflush(stdout);
-    }
-    close(fd);
-}
-
-void sigusr1_handler(int sig) {
-    (void)sig;
-    list_hunts();
-}
-
-void sigusr2_handler(int sig) {
-    (void)sig;
-    int fd = open("cmd_hunt.txt", O_RDONLY);
-    if (fd == -1) {
-        perror("ERROR: Could not open cmd_hunt.txt");
-        fflush(stdout);
-        return;
-    }
-
-    char hunt_id[256];
-    ssize_t n = read(fd, hunt_id, sizeof(hunt_id) - 1);
-    if (n > 0) {
-        hunt_id[n] = '\0';
-        hunt_id[strcspn(hunt_id, "\n")] = '\0';
-        list_treasures(hunt_id);
-    } else {
-        printf("ERROR: cmd_hunt.txt is empty or malformed\n");
-        fflush(stdout);
-    }
-    close(fd);
-}
-
-void sigrtmin_handler(int sig) {
-    (void)sig;
-    int fd = open("cmd_view.txt", O_RDONLY);
-    if (fd == -1) {
-        perror("ERROR: Could not open cmd_view.txt");
-        fflush(stdout);
-        return;
-    }
-
-    char hunt_id[256], treasure_id_str[256];
-    ssize_t n = read(fd, hunt_id, sizeof(hunt_id) - 1);
-    if (n > 0) {
-        hunt_id[n] = '\0';
-    }
-    n = read(fd, treasure_id_str, sizeof(treasure_id_str) - 1);
-    if (n > 0) {
-        treasure_id_str[n] = '\0';
-    }
-
-    hunt_id[strcspn(hunt_id, "\n")] = '\0';
-    treasure_id_str[strcspn(treasure_id_str, "\n")] = '\0';
-    int treasure_id = atoi(treasure_id_str);
-    
-    view_treasure(hunt_id, treasure_id);
-    close(fd);
-}
-
-void sigterm_handler(int sig) {
-    (void)sig;
-    printf("SIGTERM received: Exiting after 2 seconds...\n");
-    fflush(stdout);
-    usleep(2000000);
-    exit(0);
-}
-
-void sigcalc_handler(int sig) {
-    (void)sig;
-    int fd = open("cmd_score.txt", O_RDONLY);
-    if (fd == -1) {
-        perror("ERROR: Could not open cmd_score.txt");
-        fflush(stdout);
-        return;
-    }
-
-    char hunt_id[256];
-    if (read(fd, hunt_id, sizeof(hunt_id) - 1) > 0) {
-        hunt_id[strcspn(hunt_id, "\n")] = '\0';
-        calculate_score(hunt_id);
-    } else {
-        printf("ERROR: cmd_score.txt is empty or malformed\n");
-        fflush(stdout);
-    }
-    close(fd);
-}
-
-void calculate_score(const char *hunt_id) {
-    int score_pipe_fd[2];
-    if (pipe(score_pipe_fd) == -1) {
-        perror("Failed to create pipe for score calculation");
-        return;
-    }
-
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("Failed to fork for score calculation");
-        return;
-    }
-
-    if (pid == 0) {
-        close(score_pipe_fd[0]);
-        if (dup2(score_pipe_fd[1], STDOUT_FILENO) == -1) {
-            perror("Failed to redirect stdout to pipe");
-            exit(EXIT_FAILURE);
-        }
-        close(score_pipe_fd[1]);
-        execl("./score_calculator", "score_calculator", hunt_id, NULL);
-        perror("Failed to execute score_calculator");
-        exit(EXIT_FAILURE);
-    } else {
-        close(score_pipe_fd[1]);
-        char buf[1024];
-        ssize_t n;
-        printf("Score results for hunt '%s':\n", hunt_id);
-        while ((n = read(score_pipe_fd[0], buf, sizeof(buf)-1)) > 0) {
-            buf[n] = '\0';
-            printf("%s", buf);
-        }
-        close(score_pipe_fd[0]);
-        wait(NULL);
-    }
-}
-
-int main() {
-    struct sigaction sa;
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigusr1_handler;
-    sigaction(SIGUSR1, &sa, NULL);
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigusr2_handler;
-    sigaction(SIGUSR2, &sa, NULL);
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigrtmin_handler;
-    sigaction(SIGRTMIN, &sa, NULL);
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigterm_handler;
-    sigaction(SIGTERM, &sa, NULL);
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigcalc_handler;
-    sigaction(SIGCALC, &sa, NULL);
-
-    printf("Monitor running (PID: %d). Waiting for signals...\n", getpid());
-    fflush(stdout);
-
-    while (1) {
-        pause();
-    }
-
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "treasure.h"
+#include "hub_protocol.h"
+#include "hunt_store.h"
+#include "uring_io.h"
+#include "shm_ring.h"
+
+#define SIGSTATS (SIGRTMIN + 1)
+#define LATENCY_BUCKETS 24
+#define RESPONSE_BUF_SIZE (64 * 1024)
+#define CACHE_BUCKETS 4096
+#define DEFAULT_CACHE_BYTES (4 * 1024 * 1024)
+#define URING_ENTRIES 64
+#define URING_DEPTH 8
+#define URING_CHUNK_RECORDS 204     /* ~64 KB reads that never split a record */
+#define SCORE_MAX_JOBS 16
+#define SCORE_QUEUE_LEN 32
+#define SCORE_MAX_WAITERS 64
+#define SCORE_OUTPUT_MAX (1 << 20)     /* "calculate_score all" prints a line per hunt */
+#define SCORE_DEFERRED 1
+
+enum { OP_LIST_HUNTS, OP_LIST_TREASURES, OP_VIEW_TREASURE, OP_CALCULATE_SCORE, OP_HUNT_STATS, OP_USER_REPORT, OP_SEARCH, OP_WATCH, OP_COUNT };
+
+static const char *op_names[OP_COUNT] = {
+    "list_hunts", "list_treasures", "view_treasure", "calculate_score", "hunt_stats", "user_report", "search", "watch"
+};
+
+typedef struct {
+    unsigned long requests;
+    unsigned long errors;
+    unsigned long total_us;
+    unsigned long max_us;
+    unsigned long latency_hist[LATENCY_BUCKETS];   /* bucket i counts latencies < 2^i us */
+} OpStats;
+
+typedef struct {
+    OpStats ops[OP_COUNT];
+    unsigned long open_calls;
+    unsigned long read_calls;
+    unsigned long stat_calls;
+    unsigned long bytes_read;
+    unsigned long bytes_spliced;
+    unsigned long forks;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long cache_evictions;
+    unsigned long cache_invalidations;
+    unsigned long uring_submits;
+    unsigned long uring_ops;
+} MonitorStats;
+
+/* Counters are only touched from this (single) thread, so reads need no locking.
+   With stats_enabled off every hook reduces to one branch. */
+static MonitorStats stats;
+static int stats_enabled = 1;
+
+/* io_uring is used for batched statx and queued record reads when the kernel
+   allows it (MONITOR_IO=sync forces the blocking path). */
+static IoRing ring = { .fd = -1 };
+static int uring_enabled;
+
+/* Responses are accumulated here and written to stdout with one write() per
+   full buffer or per finished response, instead of a flush per line. */
+static char response_buf[RESPONSE_BUF_SIZE];
+static size_t response_len;
+static uint32_t response_tag;
+
+/* When the hub passes --ring, frames go into that shared-memory ring
+   instead of stdout; stdout then only tells the hub when we exit. */
+static ShmRing out_ring = { .mem_fd = -1, .data_fd = -1, .space_fd = -1, .peer_fd = -1 };
+
+static int out_write(const void *buf, size_t len) {
+    if (out_ring.hdr)
+        return shm_ring_write(&out_ring, buf, len);
+    return write_full(STDOUT_FILENO, buf, len);
+}
+
+static volatile sig_atomic_t terminate_requested;
+
+/* One of shard_count monitors run by the hub (--shard i --shards N): the
+   requests that cover every hunt only look at the hunts this monitor owns,
+   and their summaries go out as FRAME_TOTALS / FRAME_SKETCH for the hub
+   to add up. */
+static int shard_index, shard_count = 1;
+
+static int owns_hunt(const char *hunt_id) {
+    return shard_count <= 1 || hunt_shard(hunt_id, shard_count) == shard_index;
+}
+
+/* Score calculation admission state; see score_submit(). */
+static int score_job_limit = 1;
+static int score_running, score_queued;
+static uint64_t score_seq;
+static unsigned long score_coalesced, score_rejected;
+
+static void resp_flush(void) {
+    if (response_len == 0)
+        return;
+    if (out_write(response_buf, response_len) == -1)
+        perror("Failed to write response");
+    response_len = 0;
+}
+
+static void resp_frame_flags(uint16_t type, uint16_t flags, const void *payload, uint32_t length) {
+    if (response_len + sizeof(FrameHeader) + length > sizeof(response_buf))
+        resp_flush();
+
+    FrameHeader header = { length, type, flags, response_tag };
+    if (sizeof(header) + length > sizeof(response_buf)) {
+        /* Never fits the buffer: write it straight through. */
+        if (out_write(&header, sizeof(header)) == -1 || out_write(payload, length) == -1)
+            perror("Failed to write response");
+        return;
+    }
+    memcpy(response_buf + response_len, &header, sizeof(header));
+    response_len += sizeof(header);
+    memcpy(response_buf + response_len, payload, length);
+    response_len += length;
+}
+
+static void resp_frame(uint16_t type, const void *payload, uint32_t length) {
+    resp_frame_flags(type, 0, payload, length);
+}
+
+static void resp_text(uint16_t type, const char *fmt, ...) {
+    char text[4096];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if (n >= (int)sizeof(text))
+        n = sizeof(text) - 1;
+    resp_frame(type, text, n);
+}
+
+static void resp_perror(const char *msg) {
+    resp_text(FRAME_ERROR, "%s: %s", msg, strerror(errno));
+}
+
+static void resp_end(int status) {
+    int32_t code = status;
+    resp_frame(FRAME_END, &code, sizeof(code));
+    resp_flush();
+}
+
+static int io_open(const char *path, int flags) {
+    if (stats_enabled)
+        stats.open_calls++;
+    return open(path, flags);
+}
+
+static ssize_t io_read(int fd, void *buf, size_t count) {
+    ssize_t n = read(fd, buf, count);
+    if (stats_enabled) {
+        stats.read_calls++;
+        if (n > 0)
+            stats.bytes_read += n;
+    }
+    return n;
+}
+
+static int io_stat(const char *path, struct stat *st) {
+    if (stats_enabled)
+        stats.stat_calls++;
+    return stat(path, st);
+}
+
+static void op_begin(struct timespec *start) {
+    if (stats_enabled)
+        clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void op_end(int op, const struct timespec *start, int result) {
+    if (!stats_enabled)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long us = (now.tv_sec - start->tv_sec) * 1000000UL +
+                       (now.tv_nsec - start->tv_nsec) / 1000;
+
+    OpStats *s = &stats.ops[op];
+    s->requests++;
+    if (result != 0)
+        s->errors++;
+    s->total_us += us;
+    if (us > s->max_us)
+        s->max_us = us;
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && us >= (1UL << bucket))
+        bucket++;
+    s->latency_hist[bucket]++;
+}
+
+/* LRU cache of decoded records for view_treasure, keyed by (hunt, id).
+   Each entry remembers the identity of the file it was read from (inode,
+   size, mtime); a lookup whose file no longer matches drops the entry. */
+typedef struct CacheEntry {
+    char hunt_id[HUNT_ID_LEN];
+    int treasure_id;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    Treasure treasure;
+    struct CacheEntry *hash_next;
+    struct CacheEntry *lru_prev;
+    struct CacheEntry *lru_next;
+} CacheEntry;
+
+static CacheEntry *cache_buckets[CACHE_BUCKETS];
+static CacheEntry *lru_head;    /* most recently used */
+static CacheEntry *lru_tail;
+static size_t cache_entries;
+static size_t cache_budget = DEFAULT_CACHE_BYTES;
+
+static uint32_t cache_bucket(const char *hunt_id, int treasure_id) {
+    return (hunt_hash(hunt_id) ^ ((uint32_t)treasure_id * 2654435761u)) % CACHE_BUCKETS;
+}
+
+static void lru_unlink(CacheEntry *e) {
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(CacheEntry *e) {
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head)
+        lru_head->lru_prev = e;
+    lru_head = e;
+    if (!lru_tail)
+        lru_tail = e;
+}
+
+static void cache_remove(CacheEntry *e) {
+    CacheEntry **link = &cache_buckets[cache_bucket(e->hunt_id, e->treasure_id)];
+    while (*link != e)
+        link = &(*link)->hash_next;
+    *link = e->hash_next;
+    lru_unlink(e);
+    free(e);
+    cache_entries--;
+}
+
+static int same_version(const CacheEntry *e, const struct stat *st) {
+    return e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static CacheEntry *cache_lookup(const char *hunt_id, int treasure_id, const struct stat *st) {
+    CacheEntry *e = cache_buckets[cache_bucket(hunt_id, treasure_id)];
+    while (e && (e->treasure_id != treasure_id || strcmp(e->hunt_id, hunt_id) != 0))
+        e = e->hash_next;
+
+    if (e && !same_version(e, st)) {
+        cache_remove(e);
+        if (stats_enabled)
+            stats.cache_invalidations++;
+        e = NULL;
+    }
+    if (!e) {
+        if (stats_enabled)
+            stats.cache_misses++;
+        return NULL;
+    }
+
+    lru_unlink(e);
+    lru_push_front(e);
+    if (stats_enabled)
+        stats.cache_hits++;
+    return e;
+}
+
+static void cache_insert(const char *hunt_id, int treasure_id, const struct stat *st, const Treasure *t) {
+    if (strlen(hunt_id) >= HUNT_ID_LEN || sizeof(CacheEntry) > cache_budget)
+        return;
+
+    while (lru_tail && (cache_entries + 1) * sizeof(CacheEntry) > cache_budget) {
+        cache_remove(lru_tail);
+        if (stats_enabled)
+            stats.cache_evictions++;
+    }
+
+    CacheEntry *e = malloc(sizeof(*e));
+    if (!e)
+        return;
+    snprintf(e->hunt_id, sizeof(e->hunt_id), "%s", hunt_id);
+    e->treasure_id = treasure_id;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+    e->treasure = *t;
+
+    uint32_t bucket = cache_bucket(hunt_id, treasure_id);
+    e->hash_next = cache_buckets[bucket];
+    cache_buckets[bucket] = e;
+    lru_push_front(e);
+    cache_entries++;
+}
+
+/* Stats whichever file currently holds the hunt's records. */
+static int hunt_source_stat(const char *hunt_id, struct stat *st) {
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1)
+        return -1;
+    if (io_stat(path, st) == 0)
+        return 0;
+    if (path_format(path, sizeof(path), "%s%s", hunt_id, ARCHIVE_SUFFIX) == 0 && io_stat(path, st) == 0)
+        return 0;
+
+    ShardTableHeader header;
+    int fd = shard_table_open(O_RDONLY, &header);
+    if (fd == -1)
+        return -1;
+    close(fd);
+    if (shard_path(path, sizeof(path), &header, hunt_id) == -1)
+        return -1;
+    return io_stat(path, st);
+}
+
+static void write_stats(FILE *out) {
+    if (shard_count > 1)
+        fprintf(out, "SHARD index=%d count=%d\n", shard_index, shard_count);
+    fprintf(out, "STATS enabled=%d forks=%lu\n", stats_enabled, stats.forks);
+    fprintf(out, "IO open=%lu read=%lu stat=%lu bytes_read=%lu bytes_spliced=%lu\n",
+            stats.open_calls, stats.read_calls, stats.stat_calls, stats.bytes_read,
+            stats.bytes_spliced);
+    fprintf(out, "URING enabled=%d submits=%lu ops=%lu\n",
+            uring_enabled, stats.uring_submits, stats.uring_ops);
+    fprintf(out, "CACHE hits=%lu misses=%lu evictions=%lu invalidations=%lu entries=%zu bytes=%zu budget=%zu\n",
+            stats.cache_hits, stats.cache_misses, stats.cache_evictions, stats.cache_invalidations,
+            cache_entries, cache_entries * sizeof(CacheEntry), cache_budget);
+    fprintf(out, "SCORE jobs=%d running=%d queued=%d coalesced=%lu busy=%lu\n",
+            score_job_limit, score_running, score_queued, score_coalesced, score_rejected);
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        OpStats *s = &stats.ops[op];
+        fprintf(out, "OP %s requests=%lu errors=%lu avg_us=%lu max_us=%lu\n",
+                op_names[op], s->requests, s->errors,
+                s->requests ? s->total_us / s->requests : 0, s->max_us);
+        if (s->requests == 0)
+            continue;
+
+        fprintf(out, "HIST %s", op_names[op]);
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            if (s->latency_hist[i] == 0)
+                continue;
+            if (i == LATENCY_BUCKETS - 1)
+                fprintf(out, " >=%luus:%lu", 1UL << (i - 1), s->latency_hist[i]);
+            else
+                fprintf(out, " <%luus:%lu", 1UL << i, s->latency_hist[i]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+typedef struct {
+    char name[256];
+    char path[PATH_MAX];    /* record file (directory hunts) or archive */
+    off_t size;             /* -1 when the record file could not be stat'ed */
+    ino_t ino;
+    uint16_t flags;
+} HuntEntry;
+
+/* Directory and archived hunts in the current directory, in readdir order. */
+static int collect_hunts(HuntEntry **out, size_t *count) {
+    DIR *dir = opendir(".");
+    if (!dir)
+        return -1;
+
+    HuntEntry *hunts = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strcmp(entry->d_name, SHARD_DIR) == 0 ||
+            strcmp(entry->d_name, USER_INDEX_DIR) == 0)
+            continue;
+
+        size_t name_len = strlen(entry->d_name);
+        uint16_t flags = 0;
+        if (entry->d_type == DT_REG && name_len > strlen(ARCHIVE_SUFFIX) &&
+            strcmp(entry->d_name + name_len - strlen(ARCHIVE_SUFFIX), ARCHIVE_SUFFIX) == 0) {
+            name_len -= strlen(ARCHIVE_SUFFIX);
+            flags = HUNT_ARCHIVED;
+        } else if (entry->d_type != DT_DIR) {
+            continue;
+        }
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            HuntEntry *grown = realloc(hunts, cap * sizeof(HuntEntry));
+            if (!grown) {
+                free(hunts);
+                closedir(dir);
+                return -1;
+            }
+            hunts = grown;
+        }
+        HuntEntry *h = &hunts[n];
+        if (path_format(h->path, sizeof(h->path), flags & HUNT_ARCHIVED ? "%s" : "%s/" RECORD_FILE,
+                        entry->d_name) == -1)
+            continue;
+        n++;
+        memcpy(h->name, entry->d_name, name_len);
+        h->name[name_len] = '\0';
+        h->size = -1;
+        h->ino = 0;
+        h->flags = flags;
+    }
+    closedir(dir);
+    *out = hunts;
+    *count = n;
+    return 0;
+}
+
+/* A failed submit leaves the ring unusable and later requests go
+   blocking, but the ring stays open until the caller has passed its
+   in-flight count to uring_retire(). */
+static int uring_submit(unsigned wait_nr) {
+    int n = io_ring_submit(&ring, wait_nr);
+    if (n == -1) {
+        uring_enabled = 0;
+    } else if (stats_enabled) {
+        stats.uring_submits++;
+        stats.uring_ops += n;
+    }
+    return n;
+}
+
+/* Closes a ring that failed once the inflight requests its caller still
+   owes completions for have finished, so that the kernel no longer writes
+   into the caller's buffers and no stale completions remain. Entries the
+   kernel never picked up are not waited for. */
+static void uring_retire(unsigned inflight) {
+    int saved_errno = errno;
+    if (ring.fd != -1) {
+        unsigned unconsumed = *ring.sq_tail + ring.queued - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        inflight = inflight > unconsumed ? inflight - unconsumed : 0;
+        ring.queued = 0;
+        struct io_uring_cqe cqe;
+        while (inflight > 0) {
+            if (io_ring_peek(&ring, &cqe)) {
+                inflight--;
+                continue;
+            }
+            if (io_ring_submit(&ring, 1) == -1 && errno != EAGAIN && errno != EBUSY)
+                break;
+        }
+    }
+    io_ring_exit(&ring);
+    errno = saved_errno;
+}
+
+/* Returns a submission entry. When the queue is full the entries already
+   queued are handed to the kernel first; NULL if there is still no room. */
+static struct io_uring_sqe *uring_get_sqe(void) {
+    struct io_uring_sqe *sqe = io_ring_get_sqe(&ring);
+    if (!sqe && uring_submit(0) != -1)
+        sqe = io_ring_get_sqe(&ring);
+    return sqe;
+}
+
+/* Fills in the record file size of every directory hunt. With io_uring the
+   statx calls of up to URING_ENTRIES hunts go to the kernel in one submit. */
+static void stat_hunt_files(HuntEntry *hunts, size_t n, int use_uring) {
+    struct statx bufs[URING_ENTRIES];
+    size_t index[URING_ENTRIES];
+    size_t i = 0;
+
+    while (i < n) {
+        if (!use_uring || !uring_enabled) {
+            struct stat st;
+            if (!(hunts[i].flags & HUNT_ARCHIVED) && io_stat(hunts[i].path, &st) == 0) {
+                hunts[i].size = st.st_size;
+                hunts[i].ino = st.st_ino;
+            }
+            i++;
+            continue;
+        }
+
+        unsigned batch = 0;
+        for (; i < n && batch < URING_ENTRIES; i++) {
+            if (hunts[i].flags & HUNT_ARCHIVED)
+                continue;
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            if (!sqe)
+                break;
+            index[batch] = i;
+            io_prep_statx(sqe, hunts[i].path, &bufs[batch], batch);
+            batch++;
+        }
+        if (!uring_enabled) {
+            uring_retire(batch);
+            if (batch > 0)
+                i = index[0];
+            continue;
+        }
+        if (batch == 0) {
+            /* No room even after a flush: stat this one the blocking way. */
+            if (i < n) {
+                struct stat st;
+                if (io_stat(hunts[i].path, &st) == 0) {
+                    hunts[i].size = st.st_size;
+                    hunts[i].ino = st.st_ino;
+                }
+                i++;
+            }
+            continue;
+        }
+        if (uring_submit(batch) == -1) {
+            uring_retire(batch);
+            i = index[0];
+            continue;
+        }
+
+        struct io_uring_cqe cqe;
+        for (unsigned done = 0; done < batch; ) {
+            if (!io_ring_peek(&ring, &cqe)) {
+                if (uring_submit(1) == -1) {
+                    uring_retire(batch - done);
+                    i = index[0];
+                    break;
+                }
+                continue;
+            }
+            HuntEntry *h = &hunts[index[cqe.user_data]];
+            if (cqe.res == 0) {
+                h->size = bufs[cqe.user_data].stx_size;
+                h->ino = bufs[cqe.user_data].stx_ino;
+            }
+            done++;
+        }
+    }
+}
+
+typedef int (*chunk_fn)(const char *records, size_t len, void *arg);
+
+/* Passes every whole record of fd to fn, in file order, in chunks of at
+   most URING_CHUNK_RECORDS. With io_uring up to URING_DEPTH chunk reads are
+   in flight at once and their completions are put back into file order;
+   otherwise the file is read with plain read() calls. */
+static int read_record_file(int fd, int use_uring, chunk_fn fn, void *arg) {
+    static char bufs[URING_DEPTH][URING_CHUNK_RECORDS * sizeof(Treasure)];
+    const size_t chunk = sizeof(bufs[0]);
+
+    if (!use_uring || !uring_enabled) {
+        size_t have = 0;
+        ssize_t n;
+        while ((n = io_read(fd, bufs[0] + have, chunk - have)) > 0) {
+            have += n;
+            if (have == chunk) {
+                if (fn(bufs[0], have, arg) == -1)
+                    return -1;
+                have = 0;
+            }
+        }
+        if (n == -1)
+            return -1;
+        have -= have % sizeof(Treasure);
+        return have ? fn(bufs[0], have, arg) : 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return -1;
+    uint64_t size = st.st_size - st.st_size % sizeof(Treasure);
+    uint64_t chunks = (size + chunk - 1) / chunk;
+    uint64_t submitted = 0, emitted = 0;
+    ssize_t result[URING_DEPTH];
+    int done[URING_DEPTH];
+    unsigned inflight = 0;
+    int status = 0, saved_errno = 0;
+
+    while (inflight > 0 || (status == 0 && emitted < chunks)) {
+        while (status == 0 && submitted < chunks && submitted - emitted < URING_DEPTH) {
+            unsigned slot = submitted % URING_DEPTH;
+            uint64_t offset = submitted * chunk;
+            unsigned len = size - offset < chunk ? size - offset : chunk;
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            if (!sqe) {
+                if (!uring_enabled) {
+                    uring_retire(inflight);
+                    return -1;
+                }
+                break;
+            }
+            io_prep_read(sqe, fd, bufs[slot], len, offset, submitted);
+            done[slot] = 0;
+            submitted++;
+            inflight++;
+        }
+        if (uring_submit(inflight ? 1 : 0) == -1) {
+            uring_retire(inflight);
+            return -1;
+        }
+
+        struct io_uring_cqe cqe;
+        while (io_ring_peek(&ring, &cqe)) {
+            result[cqe.user_data % URING_DEPTH] = cqe.res;
+            done[cqe.user_data % URING_DEPTH] = 1;
+            inflight--;
+        }
+
+        while (status == 0 && emitted < submitted && done[emitted % URING_DEPTH]) {
+            unsigned slot = emitted % URING_DEPTH;
+            uint64_t offset = emitted * chunk;
+            size_t len = size - offset < chunk ? size - offset : chunk;
+            ssize_t got = result[slot];
+            if (got < 0) {
+                saved_errno = -got;
+                status = -1;
+                break;
+            }
+            /* Short reads are finished synchronously; a file that shrank
+               under us just ends early. */
+            while ((size_t)got < len) {
+                ssize_t n = pread(fd, bufs[slot] + got, len - got, offset + got);
+                if (n <= 0)
+                    break;
+                got += n;
+            }
+            if (stats_enabled)
+                stats.bytes_read += got;
+            got -= got % sizeof(Treasure);
+            if (got > 0 && fn(bufs[slot], got, arg) == -1) {
+                saved_errno = errno;
+                status = -1;
+                break;
+            }
+            emitted++;
+            if ((size_t)got < len)
+                chunks = emitted;
+        }
+    }
+
+    errno = saved_errno;
+    return status;
+}
+
+/* Hunts in the sharded backend come straight from the slot table. */
+static int list_sharded_hunts(void) {
+    ShardTableHeader header;
+    int fd = shard_table_open(O_RDONLY, &header);
+    if (fd == -1)
+        return errno == ENOENT ? 0 : (resp_perror("Could not open shard table"), -1);
+    if (stats_enabled)
+        stats.open_calls++;
+
+    HuntSlot slots[256];
+    uint32_t done = 0;
+    while (done < header.slot_count) {
+        uint32_t want = header.slot_count - done < 256 ? header.slot_count - done : 256;
+        ssize_t n = pread(fd, slots, want * sizeof(HuntSlot), shard_slot_offset(done));
+        if (stats_enabled) {
+            stats.read_calls++;
+            if (n > 0)
+                stats.bytes_read += n;
+        }
+        if (n != (ssize_t)(want * sizeof(HuntSlot))) {
+            resp_text(FRAME_ERROR, "Shard table is truncated");
+            close(fd);
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < want; i++) {
+            if (slots[i].state != SLOT_LIVE || !owns_hunt(slots[i].hunt_id))
+                continue;
+            uint32_t count = slots[i].record_count;
+            size_t name_len = strnlen(slots[i].hunt_id, HUNT_ID_LEN);
+            char payload[sizeof(count) + HUNT_ID_LEN];
+            memcpy(payload, &count, sizeof(count));
+            memcpy(payload + sizeof(count), slots[i].hunt_id, name_len);
+            resp_frame(FRAME_HUNT, payload, sizeof(count) + name_len);
+        }
+        done += want;
+    }
+    close(fd);
+    return 0;
+}
+
+int list_hunts() {
+    HuntEntry *hunts;
+    size_t n;
+    if (collect_hunts(&hunts, &n) == -1) {
+        resp_perror("Failed to open current directory");
+        return -1;
+    }
+    if (shard_count > 1) {
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (owns_hunt(hunts[i].name))
+                hunts[kept++] = hunts[i];
+        }
+        n = kept;
+    }
+    stat_hunt_files(hunts, n, 1);
+
+    for (size_t i = 0; i < n; i++) {
+        HuntEntry *h = &hunts[i];
+        uint32_t count = 0;
+        uint16_t flags = h->flags;
+        HuntMeta meta;
+
+        if (h->flags & HUNT_ARCHIVED) {
+            ArchiveHeader header;
+            int fd = io_open(h->path, O_RDONLY);
+            if (fd == -1)
+                continue;
+            if (io_read(fd, &header, sizeof(header)) == sizeof(header) &&
+                memcmp(header.magic, ARCHIVE_MAGIC, 4) == 0)
+                count = header.record_count;
+            close(fd);
+        } else if (h->size > 0) {
+            /* A current stats block comes along for free. */
+            struct stat st = { .st_ino = h->ino, .st_size = h->size };
+            count = h->size / sizeof(Treasure);
+            if (stats_enabled)
+                stats.open_calls++;
+            if (hunt_meta_read(h->name, &meta, &st) == 0 && meta.stats.records == count)
+                flags |= HUNT_STATS;
+        }
+
+        size_t name_len = strlen(h->name);
+        char payload[sizeof(count) + sizeof(HuntStats) + 256];
+        size_t len = 0;
+        memcpy(payload, &count, sizeof(count));
+        len += sizeof(count);
+        if (flags & HUNT_STATS) {
+            memcpy(payload + len, &meta.stats, sizeof(HuntStats));
+            len += sizeof(HuntStats);
+        }
+        memcpy(payload + len, h->name, name_len);
+        resp_frame_flags(FRAME_HUNT, flags, payload, len + name_len);
+    }
+    free(hunts);
+
+    return list_sharded_hunts();
+}
+
+int hunt_stats(const char *hunt_id) {
+    HuntStats summary;
+    if (stats_enabled)
+        stats.open_calls++;
+    if (hunt_stats_get(hunt_id, &summary) == -1) {
+        resp_perror("Could not read treasure file for hunt");
+        return -1;
+    }
+
+    size_t name_len = strnlen(hunt_id, 256);
+    char payload[sizeof(HuntStats) + 256];
+    memcpy(payload, &summary, sizeof(summary));
+    memcpy(payload + sizeof(summary), hunt_id, name_len);
+    resp_frame(FRAME_HUNT_STATS, payload, sizeof(summary) + name_len);
+    return 0;
+}
+
+/* Reports a user's treasures across all hunts from their user index bucket,
+   reading only the records the entries point at. Entries written for
+   older layouts of a hunt fail to resolve and are skipped; the same
+   treasure indexed more than once is reported once. */
+int user_report(const char *username) {
+    char path[PATH_MAX];
+    int fd = user_index_path(path, sizeof(path), user_index_bucket(username)) == -1 ? -1 :
+             io_open(path, O_RDONLY);
+    if (fd == -1 && errno != ENOENT) {
+        resp_perror("Could not open user index");
+        return -1;
+    }
+
+    KeySet seen, hunts;
+    if (key_set_init(&seen, KEY_SET_MIN_CAPACITY) == -1 ||
+        key_set_init(&hunts, KEY_SET_MIN_CAPACITY) == -1) {
+        resp_perror("Could not allocate user report");
+        key_set_free(&seen);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    UserIndexEntry entries[128];
+    unsigned long treasures = 0;
+    int64_t score = 0;
+    ssize_t n = 0;
+    while (fd != -1 && (n = io_read(fd, entries, sizeof(entries))) > 0) {
+        for (size_t i = 0; i < n / sizeof(UserIndexEntry); i++) {
+            const UserIndexEntry *e = &entries[i];
+            Treasure t;
+            if (strncmp(e->username, username, USERNAME_LEN) != 0 || !owns_hunt(e->hunt_id) ||
+                !user_entry_resolve(e, &t))
+                continue;
+
+            uint64_t hunt = user_key(e->hunt_id);
+            uint64_t key = hunt ^ ((uint64_t)(uint32_t)t.treasure_id * 0x9E3779B97F4A7C15ULL);
+            if (key_set_insert(&seen, key ? key : 1) != 1)
+                continue;
+            key_set_insert(&hunts, hunt);
+
+            char payload[sizeof(Treasure) + HUNT_ID_LEN];
+            size_t name_len = strnlen(e->hunt_id, HUNT_ID_LEN);
+            memcpy(payload, &t, sizeof(t));
+            memcpy(payload + sizeof(t), e->hunt_id, name_len);
+            resp_frame(FRAME_USER_TREASURE, payload, sizeof(t) + name_len);
+            treasures++;
+            score += t.value;
+        }
+    }
+    if (fd != -1)
+        close(fd);
+
+    if (shard_count > 1) {
+        char payload[sizeof(FrameTotals) + USERNAME_LEN];
+        FrameTotals totals = { TOTALS_USER, { treasures, hunts.header->count, score } };
+        size_t name_len = strnlen(username, USERNAME_LEN);
+        memcpy(payload, &totals, sizeof(totals));
+        memcpy(payload + sizeof(totals), username, name_len);
+        resp_frame(FRAME_TOTALS, payload, sizeof(totals) + name_len);
+    } else {
+        resp_text(FRAME_TEXT, "User '%s': %lu treasure(s) in %llu hunt(s), total score %lld\n",
+                  username, treasures, (unsigned long long)hunts.header->count, (long long)score);
+    }
+    key_set_free(&seen);
+    key_set_free(&hunts);
+    if (n == -1) {
+        resp_perror("Could not read user index");
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    const ClueQuery *query;
+    unsigned long matches;
+    int all;
+} SearchState;
+
+static int search_hunt(const char *hunt_id, void *arg) {
+    SearchState *state = arg;
+    if (state->all && !owns_hunt(hunt_id))
+        return 0;
+    int32_t *ids;
+    size_t count;
+    if (stats_enabled)
+        stats.open_calls++;
+    if (clue_search(hunt_id, state->query, &ids, &count) == -1) {
+        resp_text(FRAME_ERROR, "Could not search hunt %s: %s", hunt_id, strerror(errno));
+        return -1;
+    }
+
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = count > 0 ? open_memstream(&text, &len) : NULL;
+    if (out) {
+        fprintf(out, "%s:", hunt_id);
+        for (size_t i = 0; i < count; i++)
+            fprintf(out, " %d", ids[i]);
+        fprintf(out, "\n");
+        fclose(out);
+        const size_t max = RESPONSE_BUF_SIZE - sizeof(FrameHeader);
+        for (size_t off = 0; off < len; off += max)
+            resp_frame(FRAME_TEXT, text + off, len - off < max ? len - off : max);
+        free(text);
+    }
+    state->matches += count;
+    free(ids);
+    return 0;
+}
+
+/* Clue search over one hunt or, for "all", every hunt. */
+int search_treasures(const char *target, const char *terms) {
+    ClueQuery query;
+    if (clue_query_parse(terms, &query) == -1) {
+        resp_text(FRAME_ERROR, "No searchable terms in '%s'", terms);
+        return -1;
+    }
+
+    SearchState state = { &query, 0, strcmp(target, "all") == 0 };
+    int result = state.all ? for_each_hunt(search_hunt, &state, 1) : search_hunt(target, &state);
+    if (result != 0)
+        return -1;
+    if (state.all && shard_count > 1) {
+        FrameTotals totals = { TOTALS_SEARCH, { state.matches, 0, 0 } };
+        resp_frame(FRAME_TOTALS, &totals, sizeof(totals));
+    } else {
+        resp_text(FRAME_TEXT, "%lu matching treasure(s)\n", state.matches);
+    }
+    return 0;
+}
+
+typedef struct {
+    HuntSketch *merged;
+    uint32_t hunts;
+    uint32_t scanned;       /* hunts without a current treasures.sk */
+    int all;
+} ApproxState;
+
+static int approx_hunt(const char *hunt_id, void *arg) {
+    ApproxState *state = arg;
+    if (state->all && !owns_hunt(hunt_id))
+        return 0;
+    static HuntSketch sketch;
+    int scanned;
+    if (hunt_sketch_get(hunt_id, &sketch, &scanned) == -1) {
+        resp_text(FRAME_ERROR, "Could not read hunt %s: %s", hunt_id, strerror(errno));
+        return -1;
+    }
+    sketch_merge(state->merged, &sketch);
+    state->hunts++;
+    state->scanned += scanned;
+    return 0;
+}
+
+/* Approximate summary of one hunt or, for "all", of every hunt's sketches
+   merged into one. */
+int approx_summary(const char *target) {
+    static HuntSketch merged;
+    sketch_init(&merged);
+    ApproxState state = { &merged, 0, 0, strcmp(target, "all") == 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = state.all ? for_each_hunt(approx_hunt, &state, 1) : approx_hunt(target, &state);
+    if (result != 0)
+        return -1;
+    if (state.all && shard_count > 1) {
+        static char payload[sizeof(HuntSketch) + 2 * sizeof(uint32_t)];
+        memcpy(payload, &merged, sizeof(merged));
+        memcpy(payload + sizeof(merged), &state.hunts, sizeof(uint32_t));
+        memcpy(payload + sizeof(merged) + sizeof(uint32_t), &state.scanned, sizeof(uint32_t));
+        resp_frame(FRAME_SKETCH, payload, sizeof(payload));
+        return 0;
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+
+    char name[300] = "all hunts";
+    if (strcmp(target, "all") != 0)
+        snprintf(name, sizeof(name), "hunt '%s'", target);
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    if (!out) {
+        resp_perror("Could not format summary");
+        return -1;
+    }
+    sketch_report(out, name, &merged, 10);
+    fprintf(out, "  (%u hunt(s), %u sketched by a full scan, %.0f us)\n", state.hunts, state.scanned, us);
+    fclose(out);
+    resp_frame(FRAME_TEXT, text, len);
+    free(text);
+    return 0;
+}
+
+/* Live subscriptions. Each watched hunt has one inotify watch on its
+   directory (rewrites replace treasures.dat, so the file itself cannot be
+   watched) however many subscribers follow it. A subscriber is the tag of
+   the watch request that opened it; events go out as FRAME_WATCH frames
+   under that tag after the request itself has ended. Appends are read from
+   the offset reported so far; a replaced file is diffed against the IDs
+   already reported to find removals. */
+#define MAX_WATCHES 64
+#define MAX_SUBSCRIBERS 16
+
+typedef struct {
+    char hunt_id[HUNT_ID_LEN];
+    int wd;
+    int pending;
+    int ended;
+    uint64_t ino;
+    off_t offset;
+    KeySet ids;
+    uint32_t tags[MAX_SUBSCRIBERS];
+    int subscribers;
+} HuntWatch;
+
+static int inotify_fd = -1;
+static HuntWatch watches[MAX_WATCHES];
+static int watch_count;
+
+static HuntWatch *watch_find(const char *hunt_id) {
+    for (int i = 0; i < watch_count; i++) {
+        if (strcmp(watches[i].hunt_id, hunt_id) == 0)
+            return &watches[i];
+    }
+    return NULL;
+}
+
+/* Sends an event to count subscribers, starting at index first. */
+static void watch_send(const HuntWatch *w, int first, int count, uint32_t kind, const Treasure *t) {
+    char payload[sizeof(uint32_t) + sizeof(Treasure) + HUNT_ID_LEN];
+    size_t name_len = strnlen(w->hunt_id, HUNT_ID_LEN);
+    memcpy(payload, &kind, sizeof(kind));
+    memcpy(payload + sizeof(kind), t, sizeof(*t));
+    memcpy(payload + sizeof(kind) + sizeof(*t), w->hunt_id, name_len);
+
+    uint32_t saved_tag = response_tag;
+    for (int i = first; i < first + count; i++) {
+        response_tag = w->tags[i];
+        resp_frame(FRAME_WATCH, payload, sizeof(kind) + sizeof(*t) + name_len);
+    }
+    response_tag = saved_tag;
+}
+
+static void watch_emit(const HuntWatch *w, uint32_t kind, const Treasure *t) {
+    watch_send(w, 0, w->subscribers, kind, t);
+}
+
+static void watch_emit_id(const HuntWatch *w, uint32_t kind, int32_t treasure_id) {
+    Treasure t;
+    memset(&t, 0, sizeof(t));
+    t.treasure_id = treasure_id;
+    watch_emit(w, kind, &t);
+}
+
+/* Reads the whole record file into a fresh ID set. With report set, IDs
+   that are new are sent as additions and IDs that disappeared as
+   removals. */
+static int watch_rescan(HuntWatch *w, int report) {
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", w->hunt_id, RECORD_FILE) == -1 ? -1 :
+             io_open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    KeySet ids;
+    ids.path[0] = '\0';
+    if (key_set_init(&ids, KEY_SET_MIN_CAPACITY) == -1) {
+        close(fd);
+        return -1;
+    }
+    Treasure chunk[256];
+    off_t offset = 0;
+    ssize_t n;
+    while ((n = io_read(fd, chunk, sizeof(chunk))) >= (ssize_t)sizeof(Treasure)) {
+        for (size_t i = 0; i < n / sizeof(Treasure); i++) {
+            key_set_insert(&ids, treasure_key(chunk[i].treasure_id));
+            if (report && !key_set_contains(&w->ids, treasure_key(chunk[i].treasure_id)))
+                watch_emit(w, WATCH_ADDED, &chunk[i]);
+        }
+        offset += n - n % sizeof(Treasure);
+        if (n % sizeof(Treasure))
+            break;
+    }
+    close(fd);
+
+    if (report) {
+        for (uint32_t i = 0; i < w->ids.header->capacity; i++) {
+            uint64_t key = w->ids.slots[i];
+            if (key && !key_set_contains(&ids, key))
+                watch_emit_id(w, WATCH_REMOVED, (int32_t)(uint32_t)key);
+        }
+    }
+    key_set_free(&w->ids);
+    w->ids = ids;
+    w->ino = st.st_ino;
+    w->offset = offset;
+    return 0;
+}
+
+/* Sends the records appended since the last look, or diffs the whole file
+   when it was replaced or truncated. */
+static void watch_update(HuntWatch *w) {
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", w->hunt_id, RECORD_FILE) == -1 ? -1 :
+             io_open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+    if ((uint64_t)st.st_ino != w->ino || st.st_size < w->offset) {
+        close(fd);
+        watch_rescan(w, 1);
+        return;
+    }
+
+    Treasure chunk[256];
+    ssize_t n;
+    while (w->offset + (off_t)sizeof(Treasure) <= st.st_size &&
+           (n = pread(fd, chunk, sizeof(chunk), w->offset)) >= (ssize_t)sizeof(Treasure)) {
+        for (size_t i = 0; i < n / sizeof(Treasure); i++) {
+            key_set_insert(&w->ids, treasure_key(chunk[i].treasure_id));
+            watch_emit(w, WATCH_ADDED, &chunk[i]);
+        }
+        w->offset += n - n % sizeof(Treasure);
+        if (stats_enabled) {
+            stats.read_calls++;
+            stats.bytes_read += n;
+        }
+    }
+    close(fd);
+}
+
+static void watch_release(HuntWatch *w) {
+    if (w->wd != -1)
+        inotify_rm_watch(inotify_fd, w->wd);
+    key_set_free(&w->ids);
+    *w = watches[--watch_count];
+}
+
+/* Closes a watch, telling every remaining subscriber. */
+static void watch_drop(HuntWatch *w) {
+    watch_emit_id(w, WATCH_ENDED, 0);
+    watch_release(w);
+}
+
+int watch_hunt(const char *hunt_id) {
+    HuntWatch *w = watch_find(hunt_id);
+    if (!w) {
+        char path[PATH_MAX];
+        struct stat st;
+        if (strlen(hunt_id) >= HUNT_ID_LEN ||
+            path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 || io_stat(path, &st) == -1) {
+            resp_text(FRAME_ERROR, "Hunt %s has no treasures.dat; only directory hunts can be watched", hunt_id);
+            return -1;
+        }
+        if (watch_count == MAX_WATCHES) {
+            resp_text(FRAME_ERROR, "Too many watched hunts");
+            return -1;
+        }
+        if (inotify_fd == -1 && (inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+            resp_perror("Could not start inotify");
+            return -1;
+        }
+
+        w = &watches[watch_count];
+        memset(w, 0, sizeof(*w));
+        snprintf(w->hunt_id, sizeof(w->hunt_id), "%s", hunt_id);
+        w->wd = inotify_add_watch(inotify_fd, hunt_id, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                                      IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (w->wd == -1 || watch_rescan(w, 0) == -1) {
+            resp_perror("Could not watch hunt");
+            if (w->wd != -1)
+                inotify_rm_watch(inotify_fd, w->wd);
+            key_set_free(&w->ids);
+            return -1;
+        }
+        watch_count++;
+    }
+
+    if (w->subscribers == MAX_SUBSCRIBERS) {
+        resp_text(FRAME_ERROR, "Too many subscribers for hunt %s", hunt_id);
+        return -1;
+    }
+    w->tags[w->subscribers++] = response_tag;
+    resp_text(FRAME_TEXT, "Watching hunt %s as subscription %u from record %lld (%d subscriber(s))\n",
+              hunt_id, response_tag, (long long)(w->offset / sizeof(Treasure)), w->subscribers);
+    return 0;
+}
+
+/* Ends the subscription opened by the watch request with the given tag;
+   tag 0 picks the only subscriber. Others keep their events, and the
+   inotify watch goes once the last subscriber has left. */
+int unwatch_hunt(const char *hunt_id, uint32_t tag) {
+    HuntWatch *w = watch_find(hunt_id);
+    if (!w) {
+        resp_text(FRAME_ERROR, "Hunt %s is not being watched", hunt_id);
+        return -1;
+    }
+    if (tag == 0 && w->subscribers > 1) {
+        resp_text(FRAME_ERROR, "Hunt %s has %d subscribers; give the subscription to end",
+                  hunt_id, w->subscribers);
+        return -1;
+    }
+    int i = 0;
+    while (i < w->subscribers && tag != 0 && w->tags[i] != tag)
+        i++;
+    if (i == w->subscribers) {
+        resp_text(FRAME_ERROR, "No subscription %u to hunt %s", tag, hunt_id);
+        return -1;
+    }
+
+    tag = w->tags[i];
+    Treasure t;
+    memset(&t, 0, sizeof(t));
+    watch_send(w, i, 1, WATCH_ENDED, &t);
+    w->tags[i] = w->tags[--w->subscribers];
+    int subscribers = w->subscribers;
+    if (subscribers == 0)
+        watch_release(w);
+    resp_text(FRAME_TEXT, "Stopped subscription %u to hunt %s (%d subscriber(s) left)\n",
+              tag, hunt_id, subscribers);
+    return 0;
+}
+
+/* Drains the inotify queue and sends the resulting events. */
+static void watch_events(void) {
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            for (int i = 0; i < watch_count; i++) {
+                HuntWatch *w = &watches[i];
+                if (w->wd != ev->wd)
+                    continue;
+                if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    w->wd = -1;
+                    w->pending = 0;
+                    w->ended = 1;
+                } else if (ev->len > 0 && strcmp(ev->name, RECORD_FILE) == 0) {
+                    w->pending = 1;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < watch_count;) {
+        HuntWatch *w = &watches[i];
+        if (w->ended) {
+            watch_drop(w);
+            continue;
+        }
+        if (w->pending) {
+            w->pending = 0;
+            watch_update(w);
+        }
+        i++;
+    }
+    resp_flush();
+}
+
+/* Warm state handed from a monitor being replaced to its successor: the
+   counters, the view cache, least recently used entry first, and the live
+   watches. Entries keep their file identity, so any that went stale
+   meanwhile are dropped on first lookup as usual. A watch carries its
+   subscribers, its read offset and the IDs reported so far; the successor
+   sends whatever changed since the handoff, and the old monitor stops
+   watching once the state is saved. */
+#define STATE_MAGIC "MST2"
+
+typedef struct {
+    char magic[4];
+    uint32_t entry_size;
+    uint64_t entries;
+    uint32_t watches;
+    MonitorStats stats;
+} StateHeader;
+
+typedef struct {
+    char hunt_id[HUNT_ID_LEN];
+    uint64_t ino;
+    int64_t offset;
+    uint32_t tags[MAX_SUBSCRIBERS];
+    uint32_t subscribers;
+    uint32_t capacity;      /* ID set slots that follow */
+    uint64_t count;
+} WatchState;
+
+static int save_watch(FILE *out, const HuntWatch *w) {
+    WatchState ws;
+    memset(&ws, 0, sizeof(ws));
+    memcpy(ws.hunt_id, w->hunt_id, sizeof(ws.hunt_id));
+    ws.ino = w->ino;
+    ws.offset = w->offset;
+    memcpy(ws.tags, w->tags, sizeof(ws.tags));
+    ws.subscribers = w->subscribers;
+    ws.capacity = w->ids.header->capacity;
+    ws.count = w->ids.header->count;
+    if (fwrite(&ws, sizeof(ws), 1, out) != 1 ||
+        fwrite(w->ids.slots, sizeof(uint64_t), ws.capacity, out) != ws.capacity)
+        return -1;
+    return 0;
+}
+
+/* Takes over a watch saved by the predecessor and catches up on the
+   changes made since. A hunt that went away is reported as ended. */
+static int load_watch(FILE *in) {
+    WatchState ws;
+    if (fread(&ws, sizeof(ws), 1, in) != 1 || ws.subscribers > MAX_SUBSCRIBERS ||
+        ws.capacity < KEY_SET_MIN_CAPACITY || (ws.capacity & (ws.capacity - 1)) ||
+        memchr(ws.hunt_id, '\0', sizeof(ws.hunt_id)) == NULL)
+        return -1;
+
+    HuntWatch *w = &watches[watch_count];
+    memset(w, 0, sizeof(*w));
+    memcpy(w->hunt_id, ws.hunt_id, sizeof(w->hunt_id));
+    memcpy(w->tags, ws.tags, sizeof(w->tags));
+    w->subscribers = ws.subscribers;
+    w->ino = ws.ino;
+    w->offset = ws.offset;
+    w->wd = -1;
+    w->ids.path[0] = '\0';
+    if (key_set_init(&w->ids, ws.capacity) == -1)
+        return -1;
+    if (fread(w->ids.slots, sizeof(uint64_t), ws.capacity, in) != ws.capacity) {
+        key_set_free(&w->ids);
+        return -1;
+    }
+    w->ids.header->count = ws.count;
+    watch_count++;
+
+    if (inotify_fd == -1)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd != -1)
+        w->wd = inotify_add_watch(inotify_fd, w->hunt_id, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                                          IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (w->wd == -1)
+        watch_drop(w);
+    else
+        watch_update(w);
+    return 0;
+}
+
+static int save_state(const char *path) {
+    FILE *out = fopen(path, "wb");
+    if (!out)
+        return -1;
+
+    StateHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STATE_MAGIC, 4);
+    header.entry_size = sizeof(CacheEntry);
+    header.entries = cache_entries;
+    header.watches = watch_count;
+    header.stats = stats;
+    int status = fwrite(&header, sizeof(header), 1, out) == 1 ? 0 : -1;
+    for (CacheEntry *e = lru_tail; e && status == 0; e = e->lru_prev) {
+        if (fwrite(e, sizeof(*e), 1, out) != 1)
+            status = -1;
+    }
+    for (int i = 0; i < watch_count && status == 0; i++)
+        status = save_watch(out, &watches[i]);
+    if (fclose(out) != 0)
+        status = -1;
+    if (status == -1)
+        unlink(path);
+    return status;
+}
+
+static int load_state(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return -1;
+
+    StateHeader header;
+    int status = -1;
+    if (fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, STATE_MAGIC, 4) == 0 &&
+        header.entry_size == sizeof(CacheEntry)) {
+        stats = header.stats;
+        CacheEntry e;
+        for (uint64_t i = 0; i < header.entries && fread(&e, sizeof(e), 1, in) == 1; i++) {
+            struct stat st;
+            memset(&st, 0, sizeof(st));
+            st.st_dev = e.dev;
+            st.st_ino = e.ino;
+            st.st_size = e.size;
+            st.st_mtim = e.mtime;
+            cache_insert(e.hunt_id, e.treasure_id, &st, &e.treasure);
+        }
+        status = 0;
+        for (uint32_t i = 0; i < header.watches && watch_count < MAX_WATCHES; i++) {
+            if (load_watch(in) == -1)
+                break;
+        }
+    }
+    fclose(in);
+    unlink(path);
+    return status;
+}
+
+static int emit_treasures(const char *records, size_t len, void *arg) {
+    (void)arg;
+    for (size_t off = 0; off < len; off += sizeof(Treasure))
+        resp_frame(FRAME_TREASURE, records + off, sizeof(Treasure));
+    return 0;
+}
+
+int list_treasures(const char *hunt_id) {
+    if (uring_enabled) {
+        char path[PATH_MAX];
+        int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+                 io_open(path, O_RDONLY);
+        if (fd != -1) {
+            int result = read_record_file(fd, 1, emit_treasures, NULL);
+            close(fd);
+            if (result == -1)
+                resp_perror("Could not read treasure file for hunt");
+            return result;
+        }
+    }
+
+    RecordStream rs;
+    if (stats_enabled)
+        stats.open_calls++;
+    if (record_stream_open(&rs, hunt_id) == -1) {
+        resp_perror("Could not open treasure file for hunt");
+        return -1;
+    }
+
+    Treasure t;
+    int result;
+    while ((result = record_stream_next(&rs, &t)) == 1) {
+        resp_frame(FRAME_TREASURE, &t, sizeof(t));
+    }
+    record_stream_close(&rs);
+    if (result == -1) {
+        resp_perror("Could not read treasure file for hunt");
+        return -1;
+    }
+    return 0;
+}
+
+int view_treasure(const char *hunt_id, int treasure_id) {
+    struct stat version;
+    int cacheable = cache_budget > 0 && hunt_source_stat(hunt_id, &version) == 0;
+    if (cacheable) {
+        CacheEntry *e = cache_lookup(hunt_id, treasure_id, &version);
+        if (e) {
+            resp_frame(FRAME_TREASURE, &e->treasure, sizeof(e->treasure));
+            return 0;
+        }
+    }
+
+    /* Sorted hunts are binary searched instead of scanned. */
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+             io_open(path, O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        HuntMeta meta;
+        Treasure t;
+        int found = -1;
+        if (fstat(fd, &st) == 0 && hunt_meta_read(hunt_id, &meta, &st) == 0 && meta.sorted_count > 0)
+            found = sorted_find(fd, &st, &meta, treasure_id, &t);
+        close(fd);
+        if (found == 1) {
+            resp_frame(FRAME_TREASURE, &t, sizeof(t));
+            if (cacheable)
+                cache_insert(hunt_id, treasure_id, &version, &t);
+            return 0;
+        }
+        if (found == 0) {
+            resp_text(FRAME_ERROR, "Treasure ID %d not found in hunt %s", treasure_id, hunt_id);
+            return -1;
+        }
+    }
+
+    RecordStream rs;
+    if (stats_enabled)
+        stats.open_calls++;
+    if (record_stream_open(&rs, hunt_id) == -1) {
+        resp_perror("Could not open treasure file for hunt");
+        return -1;
+    }
+
+    Treasure t;
+    int found = 0;
+    while (record_stream_next(&rs, &t) == 1) {
+        if (t.treasure_id == treasure_id) {
+            found = 1;
+            resp_frame(FRAME_TREASURE, &t, sizeof(t));
+            if (cacheable)
+                cache_insert(hunt_id, treasure_id, &version, &t);
+            break;
+        }
+    }
+    if (!found) {
+        resp_text(FRAME_ERROR, "Treasure ID %d not found in hunt %s", treasure_id, hunt_id);
+    }
+    record_stream_close(&rs);
+    return found ? 0 : -1;
+}
+
+/* Moves len bytes of fd (from its current offset) to stdout without copying
+   them through user space: splice() when stdout is a pipe, sendfile()
+   otherwise. Bytes missing because the file shrank are padded with zeroes
+   so the frame stays well formed; returns -1 in that case. */
+static int splice_to_stdout(int fd, size_t len) {
+    int status = 0;
+    while (len > 0) {
+        ssize_t n = splice(fd, NULL, STDOUT_FILENO, NULL, len, SPLICE_F_MORE);
+        if (n == -1 && errno == EINVAL)
+            n = sendfile(STDOUT_FILENO, fd, NULL, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            static const char zeroes[4096];
+            size_t pad = len < sizeof(zeroes) ? len : sizeof(zeroes);
+            if (write_full(STDOUT_FILENO, zeroes, pad) == -1)
+                return -1;
+            len -= pad;
+            status = -1;
+            continue;
+        }
+        if (stats_enabled)
+            stats.bytes_spliced += n;
+        len -= n;
+    }
+    return status;
+}
+
+/* Reads len bytes of fd into the output ring. A short read is padded with
+   zeroes like splice_to_stdout does, so the frame keeps its length. */
+static int ring_from_fd(int fd, size_t len) {
+    ssize_t n = shm_ring_write_fd(&out_ring, fd, len);
+    if (n == -1)
+        return -1;
+    if ((size_t)n == len)
+        return 0;
+    static const char zeroes[4096];
+    for (size_t left = len - n; left > 0; ) {
+        size_t pad = left < sizeof(zeroes) ? left : sizeof(zeroes);
+        if (shm_ring_write(&out_ring, zeroes, pad) == -1)
+            return -1;
+        left -= pad;
+    }
+    return -1;
+}
+
+/* Streams a hunt's records as FRAME_EXPORT chunks. Directory hunts are
+   spliced straight from treasures.dat (or read straight into the ring);
+   archived and sharded hunts have no raw record file and go through the
+   regular buffered path. */
+int export_hunt(const char *hunt_id) {
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+             io_open(path, O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            resp_perror("Could not stat treasure file for hunt");
+            close(fd);
+            return -1;
+        }
+
+        size_t remaining = st.st_size - st.st_size % sizeof(Treasure);
+        int status = 0;
+        while (remaining > 0) {
+            size_t chunk = remaining < EXPORT_CHUNK_SIZE ? remaining : EXPORT_CHUNK_SIZE;
+            FrameHeader header = { chunk, FRAME_EXPORT, 0, response_tag };
+            resp_flush();
+            if (out_write(&header, sizeof(header)) == -1 ||
+                (out_ring.hdr ? ring_from_fd(fd, chunk) : splice_to_stdout(fd, chunk)) == -1) {
+                status = -1;
+                break;
+            }
+            remaining -= chunk;
+        }
+        close(fd);
+        if (status == -1)
+            resp_text(FRAME_ERROR, "Export of hunt %s was truncated", hunt_id);
+        return status;
+    }
+
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1) {
+        resp_perror("Could not open treasure file for hunt");
+        return -1;
+    }
+
+    static Treasure chunk[EXPORT_CHUNK_SIZE / sizeof(Treasure)];
+    size_t count = 0;
+    int result;
+    while ((result = record_stream_next(&rs, &chunk[count])) == 1) {
+        if (++count == sizeof(chunk) / sizeof(chunk[0])) {
+            resp_frame(FRAME_EXPORT, chunk, sizeof(chunk));
+            count = 0;
+        }
+    }
+    if (count > 0)
+        resp_frame(FRAME_EXPORT, chunk, count * sizeof(Treasure));
+    record_stream_close(&rs);
+    if (result == -1) {
+        resp_perror("Could not read treasure file for hunt");
+        return -1;
+    }
+    return 0;
+}
+
+/* Reads a cmd_*.txt request file written by the hub into buf. */
+static int read_request_file(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        resp_text(FRAME_ERROR, "Could not open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0) {
+        resp_text(FRAME_ERROR, "%s is empty or malformed", path);
+        return -1;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+void sigusr1_handler(int sig) {
+    (void)sig;
+    struct timespec start;
+    op_begin(&start);
+    int status = list_hunts();
+    op_end(OP_LIST_HUNTS, &start, status);
+    resp_end(status);
+}
+
+void sigusr2_handler(int sig) {
+    (void)sig;
+    char hunt_id[256];
+    if (read_request_file("cmd_hunt.txt", hunt_id, sizeof(hunt_id)) == -1) {
+        resp_end(-1);
+        return;
+    }
+    hunt_id[strcspn(hunt_id, "\n")] = '\0';
+
+    struct timespec start;
+    op_begin(&start);
+    int status = list_treasures(hunt_id);
+    op_end(OP_LIST_TREASURES, &start, status);
+    resp_end(status);
+}
+
+void sigrtmin_handler(int sig) {
+    (void)sig;
+    char request[512];
+    if (read_request_file("cmd_view.txt", request, sizeof(request)) == -1) {
+        resp_end(-1);
+        return;
+    }
+
+    char *hunt_id = request;
+    char *treasure_id_str = strchr(request, '\n');
+    if (!treasure_id_str) {
+        resp_text(FRAME_ERROR, "cmd_view.txt is empty or malformed");
+        resp_end(-1);
+        return;
+    }
+    *treasure_id_str++ = '\0';
+    treasure_id_str[strcspn(treasure_id_str, "\n")] = '\0';
+    int treasure_id = atoi(treasure_id_str);
+
+    struct timespec start;
+    op_begin(&start);
+    int status = view_treasure(hunt_id, treasure_id);
+    op_end(OP_VIEW_TREASURE, &start, status);
+    resp_end(status);
+}
+
+/* SIGTERM only marks the monitor for shutdown; the command loop finishes
+   the requests already sent and then exits without further delay. */
+void sigterm_handler(int sig) {
+    (void)sig;
+    terminate_requested = 1;
+}
+
+static void finish_shutdown(void) {
+    while (watch_count > 0)
+        watch_drop(&watches[0]);
+    resp_text(FRAME_TEXT, "SIGTERM received: exiting.\n");
+    resp_end(0);
+    exit(0);
+}
+
+/* Score calculations run score_calculator in child processes without
+   holding up other commands. At most score_job_limit run at once
+   (MONITOR_SCORE_JOBS, by default the CPUs shared out among the hub's
+   shard monitors, at least one each); further requests wait in a queue
+   of SCORE_QUEUE_LEN, and once that is full they are answered "Busy"
+   straight away. A request for a hunt and window that is already
+   queued, or running on the same version of the records, joins that job
+   instead of starting another: the one result is sent to every waiter
+   under its own tag, so responses may overtake each other. The hunt "all"
+   scores every hunt this monitor owns, one after another in one job. */
+enum { SCORE_FREE, SCORE_QUEUED, SCORE_RUNNING };
+
+typedef struct {
+    int state;
+    uint64_t seq;                   /* arrival order, for the queue */
+    char hunt_id[256];
+    char args[4][64];               /* --since/--until arguments */
+    int arg_count;
+    char key[512];                  /* hunt and arguments, for coalescing */
+    struct stat version;            /* records the running job reads */
+    int have_version;
+    pid_t pid;
+    int fd;
+    char *output;
+    size_t output_len, output_size;
+    uint32_t tags[SCORE_MAX_WAITERS];
+    struct timespec starts[SCORE_MAX_WAITERS];
+    int waiters;
+} ScoreJob;
+
+static ScoreJob score_jobs[SCORE_MAX_JOBS + SCORE_QUEUE_LEN];
+
+static void score_limit_init(void) {
+    const char *env = getenv("MONITOR_SCORE_JOBS");
+    long limit = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN) / shard_count;
+    score_job_limit = limit < 1 ? 1 : limit > SCORE_MAX_JOBS ? SCORE_MAX_JOBS : (int)limit;
+}
+
+typedef struct {
+    const ScoreJob *job;
+    int failed;
+} ScoreAll;
+
+/* Runs in the child of an "all" job: scores each owned hunt in turn with
+   stdout already on the job's pipe. */
+static int score_hunt(const char *hunt_id, void *arg) {
+    ScoreAll *all = arg;
+    const ScoreJob *job = all->job;
+    if (!owns_hunt(hunt_id))
+        return 0;
+    pid_t pid = fork();
+    if (pid == 0) {
+        char *args[8] = { "score_calculator", (char *)hunt_id };
+        for (int i = 0; i < job->arg_count; i++)
+            args[2 + i] = (char *)job->args[i];
+        execv("./score_calculator", args);
+        perror("Failed to execute score_calculator");
+        _exit(EXIT_FAILURE);
+    }
+    int wstatus;
+    if (pid < 0 || waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+        dprintf(STDOUT_FILENO, "Could not score hunt '%s'\n", hunt_id);
+        all->failed++;
+    }
+    return 0;
+}
+
+static int score_start(ScoreJob *job) {
+    int score_pipe_fd[2];
+    if (pipe2(score_pipe_fd, O_CLOEXEC) == -1)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(score_pipe_fd[0]);
+        close(score_pipe_fd[1]);
+        return -1;
+    }
+    if (stats_enabled)
+        stats.forks++;
+
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        if (dup2(score_pipe_fd[1], STDOUT_FILENO) == -1) {
+            perror("Failed to redirect stdout to pipe");
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(job->hunt_id, "all") == 0) {
+            ScoreAll all = { job, 0 };
+            int result = for_each_hunt(score_hunt, &all, 1);
+            _exit(result != 0 || all.failed ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+        char *args[8] = { "score_calculator", job->hunt_id };
+        for (int i = 0; i < job->arg_count; i++)
+            args[2 + i] = job->args[i];
+        execv("./score_calculator", args);
+        perror("Failed to execute score_calculator");
+        exit(EXIT_FAILURE);
+    }
+
+    close(score_pipe_fd[1]);
+    fcntl(score_pipe_fd[0], F_SETFL, O_NONBLOCK);
+    job->pid = pid;
+    job->fd = score_pipe_fd[0];
+    job->output_len = 0;
+    job->have_version = hunt_source_stat(job->hunt_id, &job->version) == 0;
+    job->state = SCORE_RUNNING;
+    score_running++;
+    return 0;
+}
+
+/* Sends the output of an "all" job: the per-hunt lines and their sum as
+   text, or with several monitors each hunt's score as FRAME_TOTALS for the
+   hub to add up. Lines that are not totals go out as they are. */
+static void score_send_all(const ScoreJob *job) {
+    static const char prefix[] = "Total score for hunt '";
+    double total = 0;
+    unsigned long hunts = 0;
+    const char *line = job->output, *end = job->output + job->output_len;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        size_t len = eol ? (size_t)(eol + 1 - line) : (size_t)(end - line);
+        const char *name = line + sizeof(prefix) - 1;
+        const char *quote = len > sizeof(prefix) ? memchr(name, '\'', line + len - name) : NULL;
+        const char *colon = NULL;
+        for (const char *c = line; c < line + len; c++) {
+            if (*c == ':')
+                colon = c;
+        }
+        if (strncmp(line, prefix, sizeof(prefix) - 1) != 0 || !quote || !colon || colon < quote) {
+            resp_frame(FRAME_TEXT, line, len);
+            line += len;
+            continue;
+        }
+        double score = strtod(colon + 1, NULL);
+        total += score;
+        hunts++;
+        if (shard_count > 1) {
+            char payload[sizeof(FrameTotals) + HUNT_ID_LEN];
+            int64_t hundredths = (int64_t)(score * 100 + (score < 0 ? -0.5 : 0.5));
+            FrameTotals totals = { TOTALS_SCORE, { hundredths, 1, 0 } };
+            size_t name_len = (size_t)(quote - name) < HUNT_ID_LEN ? (size_t)(quote - name) : HUNT_ID_LEN;
+            memcpy(payload, &totals, sizeof(totals));
+            memcpy(payload + sizeof(totals), name, name_len);
+            resp_frame(FRAME_TOTALS, payload, sizeof(totals) + name_len);
+        } else {
+            resp_frame(FRAME_TEXT, line, len);
+        }
+        line += len;
+    }
+    if (shard_count <= 1) {
+        int integral = total == (double)(long long)total;
+        resp_text(FRAME_TEXT, "Total score across %lu hunt(s): %.*f\n", hunts, integral ? 0 : 2, total);
+    }
+}
+
+/* Sends a finished job's result to all of its waiters and frees it. */
+static void score_finish(ScoreJob *job, int status) {
+    uint32_t saved_tag = response_tag;
+    int all = strcmp(job->hunt_id, "all") == 0;
+    for (int i = 0; i < job->waiters; i++) {
+        response_tag = job->tags[i];
+        if (all)
+            score_send_all(job);
+        else if (job->output_len > 0)
+            resp_frame(FRAME_TEXT, job->output, job->output_len);
+        if (status != 0 && all)
+            resp_text(FRAME_ERROR, "Score calculation failed for some hunts");
+        else if (status != 0)
+            resp_text(FRAME_ERROR, "Score calculation failed for hunt '%s'", job->hunt_id);
+        resp_end(status);
+        op_end(OP_CALCULATE_SCORE, &job->starts[i], status);
+    }
+    response_tag = saved_tag;
+    free(job->output);
+    job->output = NULL;
+    job->output_len = job->output_size = 0;
+    if (job->state == SCORE_RUNNING)
+        score_running--;
+    else if (job->state == SCORE_QUEUED)
+        score_queued--;
+    job->state = SCORE_FREE;
+}
+
+/* Starts queued jobs, oldest first, while there is room. */
+static void score_schedule(void) {
+    while (score_running < score_job_limit && score_queued > 0) {
+        ScoreJob *next = NULL;
+        for (size_t i = 0; i < sizeof(score_jobs) / sizeof(score_jobs[0]); i++) {
+            if (score_jobs[i].state == SCORE_QUEUED && (!next || score_jobs[i].seq < next->seq))
+                next = &score_jobs[i];
+        }
+        score_queued--;
+        next->state = SCORE_FREE;
+        if (score_start(next) == -1) {
+            uint32_t saved_tag = response_tag;
+            for (int i = 0; i < next->waiters; i++) {
+                response_tag = next->tags[i];
+                resp_perror("Failed to start score calculation");
+            }
+            response_tag = saved_tag;
+            score_finish(next, -1);
+        }
+    }
+}
+
+/* Queues a score calculation for the request being served. Returns
+   SCORE_DEFERRED when the response will follow once the job is done, or
+   the status of a response already sent in full (busy, errors). */
+static int score_submit(const char *hunt_id, char *window[], int window_args) {
+    char key[512];
+    int n = snprintf(key, sizeof(key), "%s", hunt_id);
+    for (int i = 0; i < window_args && n < (int)sizeof(key); i++) {
+        if (strlen(window[i]) >= sizeof(score_jobs[0].args[0]) || i >= 4) {
+            resp_text(FRAME_ERROR, "Invalid score window argument");
+            return -1;
+        }
+        n += snprintf(key + n, sizeof(key) - n, " %s", window[i]);
+    }
+
+    struct timespec start;
+    op_begin(&start);
+    struct stat version;
+    int have_version = hunt_source_stat(hunt_id, &version) == 0;
+    ScoreJob *job = NULL, *free_slot = NULL;
+    for (size_t i = 0; i < sizeof(score_jobs) / sizeof(score_jobs[0]); i++) {
+        ScoreJob *j = &score_jobs[i];
+        if (j->state == SCORE_FREE) {
+            if (!free_slot)
+                free_slot = j;
+            continue;
+        }
+        if (strcmp(j->key, key) != 0 || j->waiters == SCORE_MAX_WAITERS)
+            continue;
+        /* A running job only answers for the records it is reading. */
+        if (j->state == SCORE_RUNNING &&
+            (!have_version || !j->have_version || version.st_ino != j->version.st_ino ||
+             version.st_size != j->version.st_size ||
+             version.st_mtim.tv_sec != j->version.st_mtim.tv_sec ||
+             version.st_mtim.tv_nsec != j->version.st_mtim.tv_nsec))
+            continue;
+        job = j;
+        break;
+    }
+
+    if (job) {
+        score_coalesced++;
+    } else if (score_running >= score_job_limit && score_queued >= SCORE_QUEUE_LEN) {
+        score_rejected++;
+        resp_text(FRAME_ERROR, "Busy: %d score calculation(s) running and %d queued; try again later",
+                  score_running, score_queued);
+        op_end(OP_CALCULATE_SCORE, &start, -1);
+        return -1;
+    } else {
+        job = free_slot;
+        memset(job, 0, sizeof(*job));
+        job->seq = score_seq++;
+        snprintf(job->hunt_id, sizeof(job->hunt_id), "%s", hunt_id);
+        snprintf(job->key, sizeof(job->key), "%s", key);
+        for (int i = 0; i < window_args; i++)
+            snprintf(job->args[i], sizeof(job->args[i]), "%s", window[i]);
+        job->arg_count = window_args;
+        job->state = SCORE_QUEUED;
+        score_queued++;
+    }
+    job->tags[job->waiters] = response_tag;
+    job->starts[job->waiters++] = start;
+    score_schedule();
+    return SCORE_DEFERRED;
+}
+
+/* Adds the pipes of running jobs to fds; returns how many were added. */
+static int score_poll_fds(struct pollfd *fds) {
+    int n = 0;
+    for (size_t i = 0; i < sizeof(score_jobs) / sizeof(score_jobs[0]); i++) {
+        if (score_jobs[i].state == SCORE_RUNNING)
+            fds[n++] = (struct pollfd){ score_jobs[i].fd, POLLIN, 0 };
+    }
+    return n;
+}
+
+/* Collects output from the jobs whose pipes are ready and completes the
+   jobs that exited. Runs with the request signals blocked. */
+static void score_events(const struct pollfd *fds, int n) {
+    for (int k = 0; k < n; k++) {
+        if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        ScoreJob *job = NULL;
+        for (size_t i = 0; i < sizeof(score_jobs) / sizeof(score_jobs[0]) && !job; i++) {
+            if (score_jobs[i].state == SCORE_RUNNING && score_jobs[i].fd == fds[k].fd)
+                job = &score_jobs[i];
+        }
+        if (!job)
+            continue;
+
+        char buf[1024];
+        ssize_t got;
+        while ((got = read(job->fd, buf, sizeof(buf))) > 0) {
+            if (job->output_size - job->output_len < (size_t)got && job->output_size < SCORE_OUTPUT_MAX) {
+                size_t size = job->output_size ? job->output_size * 2 : 4096;
+                char *grown = realloc(job->output, size);
+                if (grown) {
+                    job->output = grown;
+                    job->output_size = size;
+                }
+            }
+            size_t room = job->output_size - job->output_len;
+            if (room > 0) {
+                memcpy(job->output + job->output_len, buf, (size_t)got < room ? (size_t)got : room);
+                job->output_len += (size_t)got < room ? (size_t)got : room;
+            }
+        }
+        if (got == -1 && (errno == EAGAIN || errno == EINTR))
+            continue;
+
+        close(job->fd);
+        int wstatus;
+        int status = waitpid(job->pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) ||
+                     WEXITSTATUS(wstatus) != 0 ? -1 : 0;
+        score_finish(job, status);
+    }
+    score_schedule();
+}
+
+static int score_busy(void) {
+    return score_running + score_queued > 0;
+}
+
+static int stats_request(const char *request) {
+    int status = 0;
+    if (request[0] == '\0' || strcmp(request, "show") == 0) {
+        char *text = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&text, &len);
+        if (!out) {
+            resp_perror("Could not format stats");
+            status = -1;
+        } else {
+            write_stats(out);
+            fclose(out);
+            resp_frame(FRAME_TEXT, text, len);
+            free(text);
+        }
+    } else if (strcmp(request, "reset") == 0) {
+        memset(&stats, 0, sizeof(stats));
+        resp_text(FRAME_TEXT, "STATS reset\n");
+    } else if (strcmp(request, "on") == 0 || strcmp(request, "off") == 0) {
+        stats_enabled = strcmp(request, "on") == 0;
+        resp_text(FRAME_TEXT, "STATS enabled=%d\n", stats_enabled);
+    } else if (strncmp(request, "dump ", 5) == 0) {
+        FILE *out = fopen(request + 5, "w");
+        if (!out) {
+            resp_perror("Could not open stats dump file");
+            status = -1;
+        } else {
+            write_stats(out);
+            fclose(out);
+            resp_text(FRAME_TEXT, "STATS dumped to %s\n", request + 5);
+        }
+    } else {
+        resp_text(FRAME_ERROR, "Unknown stats request '%s'", request);
+        status = -1;
+    }
+    return status;
+}
+
+void sigstats_handler(int sig) {
+    (void)sig;
+    char request[256];
+    if (read_request_file("cmd_stats.txt", request, sizeof(request)) == -1) {
+        resp_end(-1);
+        return;
+    }
+    request[strcspn(request, "\n")] = '\0';
+    resp_end(stats_request(request));
+}
+
+static void add_request_signals(sigset_t *set) {
+    sigaddset(set, SIGUSR1);
+    sigaddset(set, SIGUSR2);
+    sigaddset(set, SIGRTMIN);
+    sigaddset(set, SIGSTATS);
+    sigaddset(set, SIGTERM);
+}
+
+/* Every handler blocks the other request signals while it runs so that the
+   frames of two responses never interleave on stdout. */
+static void install_handler(int sig, void (*handler)(int)) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    add_request_signals(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+/* Handles one "<tag> <command> [args]" line from the hub's command pipe. */
+static void dispatch_command(char *line) {
+    char *tag_str = strtok(line, " ");
+    char *command = strtok(NULL, " ");
+    if (!tag_str || !command)
+        return;
+
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    add_request_signals(&mask);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+
+    response_tag = strtoul(tag_str, NULL, 10);
+    struct timespec start;
+    int status;
+
+    if (strcmp(command, "list_hunts") == 0) {
+        op_begin(&start);
+        status = list_hunts();
+        op_end(OP_LIST_HUNTS, &start, status);
+    } else if (strcmp(command, "list_treasures") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            resp_text(FRAME_ERROR, "Usage: list_treasures <hunt_id>");
+            status = -1;
+        } else {
+            op_begin(&start);
+            status = list_treasures(hunt_id);
+            op_end(OP_LIST_TREASURES, &start, status);
+        }
+    } else if (strcmp(command, "view_treasure") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *treasure_id = strtok(NULL, " ");
+        if (!hunt_id || !treasure_id) {
+            resp_text(FRAME_ERROR, "Usage: view_treasure <hunt_id> <treasure_id>");
+            status = -1;
+        } else {
+            op_begin(&start);
+            status = view_treasure(hunt_id, atoi(treasure_id));
+            op_end(OP_VIEW_TREASURE, &start, status);
+        }
+    } else if (strcmp(command, "calculate_score") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *window[4];
+        int window_args = 0;
+        while (window_args < 4 && (window[window_args] = strtok(NULL, " ")) != NULL)
+            window_args++;
+        if (!hunt_id) {
+            resp_text(FRAME_ERROR, "Usage: calculate_score <hunt_id|all> [--since <time>] [--until <time>]");
+            status = -1;
+        } else {
+            status = score_submit(hunt_id, window, window_args);
+        }
+    } else if (strcmp(command, "hunt_stats") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            resp_text(FRAME_ERROR, "Usage: hunt_stats <hunt_id>");
+            status = -1;
+        } else {
+            op_begin(&start);
+            status = hunt_stats(hunt_id);
+            op_end(OP_HUNT_STATS, &start, status);
+        }
+    } else if (strcmp(command, "user_report") == 0) {
+        char *username = strtok(NULL, " ");
+        if (!username) {
+            resp_text(FRAME_ERROR, "Usage: user_report <username>");
+            status = -1;
+        } else {
+            op_begin(&start);
+            status = user_report(username);
+            op_end(OP_USER_REPORT, &start, status);
+        }
+    } else if (strcmp(command, "search") == 0) {
+        char *target = strtok(NULL, " ");
+        char *terms = strtok(NULL, "");
+        if (!target || !terms) {
+            resp_text(FRAME_ERROR, "Usage: search <hunt_id|all> <terms>");
+            status = -1;
+        } else {
+            op_begin(&start);
+            status = search_treasures(target, terms);
+            op_end(OP_SEARCH, &start, status);
+        }
+    } else if (strcmp(command, "approx") == 0) {
+        char *target = strtok(NULL, " ");
+        if (!target) {
+            resp_text(FRAME_ERROR, "Usage: approx <hunt_id|all>");
+            status = -1;
+        } else {
+            status = approx_summary(target);
+        }
+    } else if (strcmp(command, "watch") == 0 || strcmp(command, "unwatch") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *tag = command[0] == 'u' ? strtok(NULL, " ") : NULL;
+        char *end = NULL;
+        unsigned long subscription = tag ? strtoul(tag, &end, 10) : 0;
+        if (!hunt_id || (tag && (*end != '\0' || subscription == 0 || subscription > UINT32_MAX))) {
+            resp_text(FRAME_ERROR, command[0] == 'w' ? "Usage: watch <hunt_id>" :
+                                                       "Usage: unwatch <hunt_id> [subscription]");
+            status = -1;
+        } else if (command[0] == 'w') {
+            op_begin(&start);
+            status = watch_hunt(hunt_id);
+            op_end(OP_WATCH, &start, status);
+        } else {
+            status = unwatch_hunt(hunt_id, (uint32_t)subscription);
+        }
+    } else if (strcmp(command, "export_hunt") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            resp_text(FRAME_ERROR, "Usage: export_hunt <hunt_id>");
+            status = -1;
+        } else {
+            status = export_hunt(hunt_id);
+        }
+    } else if (strcmp(command, "handoff") == 0) {
+        char *path = strtok(NULL, " ");
+        if (!path) {
+            resp_text(FRAME_ERROR, "Usage: handoff <state_file>");
+            status = -1;
+        } else if (save_state(path) == -1) {
+            resp_perror("Could not save monitor state");
+            status = -1;
+        } else {
+            resp_text(FRAME_TEXT, "Handed off %zu cached record(s) and %d watched hunt(s)\n",
+                      cache_entries, watch_count);
+            while (watch_count > 0)
+                watch_release(&watches[0]);
+            status = 0;
+        }
+    } else if (strcmp(command, "stats") == 0) {
+        char *request = strtok(NULL, "");
+        status = stats_request(request ? request : "show");
+    } else {
+        resp_text(FRAME_ERROR, "Unknown command '%s'", command);
+        status = -1;
+    }
+
+    if (status != SCORE_DEFERRED)
+        resp_end(status);
+    response_tag = 0;
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/* Serves newline-terminated commands from stdin until the hub closes it or
+   SIGTERM arrives. Commands may arrive pipelined; responses go out in
+   arrival order. SIGTERM is only let through while waiting for input, and
+   once it has been seen whatever is already in the pipe is still served. */
+static void serve_commands(void) {
+    char buf[4096];
+    size_t len = 0;
+    sigset_t term, wait_mask;
+    sigemptyset(&term);
+    sigaddset(&term, SIGTERM);
+    sigprocmask(SIG_BLOCK, &term, &wait_mask);
+    sigdelset(&wait_mask, SIGTERM);
+
+    int draining = 0, discarding = 0;
+    while (1) {
+        if (terminate_requested && !draining) {
+            fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+            draining = 1;
+        }
+        if (!draining) {
+            struct pollfd fds[2 + SCORE_MAX_JOBS] = {
+                { STDIN_FILENO, POLLIN, 0 },
+                { watch_count > 0 ? inotify_fd : -1, POLLIN, 0 },
+            };
+            int jobs = score_poll_fds(fds + 2);
+            if (ppoll(fds, 2 + jobs, NULL, &wait_mask) == -1)
+                continue;
+            if ((fds[1].revents & POLLIN) || jobs > 0) {
+                sigset_t mask, old_mask;
+                sigemptyset(&mask);
+                add_request_signals(&mask);
+                sigprocmask(SIG_BLOCK, &mask, &old_mask);
+                if (fds[1].revents & POLLIN)
+                    watch_events();
+                score_events(fds + 2, jobs);
+                sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            }
+            if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+        }
+
+        ssize_t n = read(STDIN_FILENO, buf + len, sizeof(buf) - 1 - len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (n == 0)
+            break;
+        len += n;
+
+        char *line = buf;
+        char *newline;
+        while ((newline = memchr(line, '\n', buf + len - line)) != NULL) {
+            *newline = '\0';
+            if (discarding)
+                discarding = 0;
+            else
+                dispatch_command(line);
+            line = newline + 1;
+        }
+        len -= line - buf;
+        memmove(buf, line, len);
+        /* A line that does not fit is dropped up to its newline. */
+        if (len == sizeof(buf) - 1) {
+            len = 0;
+            discarding = 1;
+        }
+    }
+}
+
+static int count_bytes(const char *records, size_t len, void *arg) {
+    (void)records;
+    *(unsigned long *)arg += len;
+    return 0;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* monitor --io-bench [rounds]: times the list_hunts stat pass and a full
+   read of every directory hunt, once per I/O backend. */
+static int io_bench(int rounds) {
+    HuntEntry *hunts;
+    size_t n;
+    if (collect_hunts(&hunts, &n) == -1) {
+        perror("Failed to open current directory");
+        return 1;
+    }
+
+    for (int use_uring = 0; use_uring <= 1; use_uring++) {
+        if (use_uring && !uring_enabled) {
+            printf("io_uring: unavailable, blocking path only\n");
+            break;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < rounds; r++)
+            stat_hunt_files(hunts, n, use_uring);
+        double stat_ms = elapsed_ms(&start);
+
+        unsigned long bytes = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < n; i++) {
+                if (hunts[i].flags & HUNT_ARCHIVED)
+                    continue;
+                int fd = open(hunts[i].path, O_RDONLY);
+                if (fd == -1)
+                    continue;
+                if (read_record_file(fd, use_uring, count_bytes, &bytes) == -1)
+                    perror("Read failed");
+                close(fd);
+            }
+        }
+        double read_ms = elapsed_ms(&start);
+
+        printf("%-8s stat: %zu hunts x %d in %.2f ms (%.2f us/hunt)  read: %.1f MB in %.2f ms (%.1f MB/s)\n",
+               use_uring ? "io_uring" : "blocking", n, rounds, stat_ms,
+               n ? stat_ms * 1e3 / (n * rounds) : 0.0, bytes / 1e6, read_ms,
+               read_ms > 0 ? bytes / 1e3 / read_ms : 0.0);
+    }
+    free(hunts);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    install_handler(SIGUSR1, sigusr1_handler);
+    install_handler(SIGUSR2, sigusr2_handler);
+    install_handler(SIGRTMIN, sigrtmin_handler);
+    install_handler(SIGTERM, sigterm_handler);
+    install_handler(SIGSTATS, sigstats_handler);
+
+    store_read = io_read;
+
+    const char *stats_env = getenv("MONITOR_STATS");
+    if (stats_env && strcmp(stats_env, "0") == 0)
+        stats_enabled = 0;
+
+    const char *cache_env = getenv("MONITOR_CACHE_BYTES");
+    if (cache_env)
+        cache_budget = strtoul(cache_env, NULL, 10);
+
+    const char *io_env = getenv("MONITOR_IO");
+    if (!(io_env && strcmp(io_env, "sync") == 0) && io_ring_init(&ring, URING_ENTRIES) == 0)
+        uring_enabled = 1;
+
+    if (argc >= 2 && strcmp(argv[1], "--io-bench") == 0)
+        return io_bench(argc >= 3 ? atoi(argv[2]) : 10);
+
+    const char *state_path = NULL;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--restore") == 0) {
+            state_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--shard") == 0) {
+            shard_index = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--shards") == 0) {
+            shard_count = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--ring") == 0) {
+            int mem_fd, data_fd, space_fd;
+            if (sscanf(argv[i + 1], "%d:%d:%d", &mem_fd, &data_fd, &space_fd) != 3 ||
+                shm_ring_attach(&out_ring, mem_fd, data_fd, space_fd, STDOUT_FILENO) == -1) {
+                perror("Could not attach response ring");
+                return EXIT_FAILURE;
+            }
+            /* Keep the ring away from score_calculator. */
+            fcntl(mem_fd, F_SETFD, FD_CLOEXEC);
+            fcntl(data_fd, F_SETFD, FD_CLOEXEC);
+            fcntl(space_fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    if (shard_count < 1 || shard_index < 0 || shard_index >= shard_count) {
+        fprintf(stderr, "Invalid shard %d of %d\n", shard_index, shard_count);
+        return EXIT_FAILURE;
+    }
+    score_limit_init();
+
+    int restored = state_path && load_state(state_path) == 0;
+    resp_text(FRAME_TEXT, "Monitor running (PID: %d). Waiting for commands...%s\n", getpid(),
+              restored ? " (state restored)" : "");
+    resp_end(0);
+
+    serve_commands();
+
+    /* No command pipe (or the hub closed it): keep serving signal requests,
+       and before exiting let the score calculations already accepted finish. */
+    sigset_t term, wait_mask, request_mask;
+    sigemptyset(&term);
+    sigaddset(&term, SIGTERM);
+    sigprocmask(SIG_BLOCK, &term, &wait_mask);
+    sigdelset(&wait_mask, SIGTERM);
+    sigemptyset(&request_mask);
+    add_request_signals(&request_mask);
+    while (!terminate_requested || score_busy()) {
+        struct pollfd fds[SCORE_MAX_JOBS];
+        int jobs = score_poll_fds(fds);
+        if (ppoll(fds, jobs, NULL, &wait_mask) <= 0)
+            continue;
+        sigset_t old_mask;
+        sigprocmask(SIG_BLOCK, &request_mask, &old_mask);
+        score_events(fds, jobs);
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    }
+    finish_shutdown();
+    return 0;
+}
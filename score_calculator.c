@@ -3,46 +3,511 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <ctype.h>
+#include "treasure.h"
+#include "hunt_store.h"
 
-#define USERNAME_LEN 50
-#define CLUE_LEN 255
+/* Scoring rules, one per line of the hunt's rules file (rules_path()):
 
-typedef struct __attribute__((packed)) {
-    int treasure_id;
-    char username[USERNAME_LEN];
-    float latitude;
-    float longitude;
-    char clue[CLUE_LEN];
-    int value;
-} Treasure;
+     <action> [if <condition> [and <condition>]...]
+
+   actions:     multiply <x>    the record's score is multiplied by x
+                bonus <x>       x is added to the record's score
+                cap <x>         the record's score is at most x
+                cap_user <x>    every user's total is at most x (no conditions)
+   conditions:  <field> <op> <number>   field: lat, lon, value, id
+                                        op: < <= > >= == !=
+                <field> in <a>..<b>     a <= field <= b
+                user == <name>, user != <name>
+
+   A record starts with its value as score and the rules apply in order,
+   e.g. "multiply 2 if lat in 44..48 and lon in 20..30" or
+   "bonus 50 if value >= 100". '#' starts a comment.
+
+   The rules are compiled once into a short program of column operations
+   that run over batches of records: conditions narrow a 0/1 mask, actions
+   update the scores through it without branching, so even a long rule
+   list is a few tight loops per batch. */
+#define SCORE_BATCH 256
+#define MAX_PROGRAM 256
+
+enum { FIELD_LAT, FIELD_LON, FIELD_VALUE, FIELD_ID, FIELD_COUNT };
+
+typedef struct {
+    double column[FIELD_COUNT][SCORE_BATCH];
+    const char *user[SCORE_BATCH];
+    double score[SCORE_BATCH];
+    double mask[SCORE_BATCH];
+    Treasure records[SCORE_BATCH];
+    size_t count;
+} Batch;
+
+typedef struct Instr Instr;
+typedef void (*OpFn)(Batch *b, const Instr *in);
+
+struct Instr {
+    OpFn fn;
+    int field;
+    double a, b;
+    char user[USERNAME_LEN];
+};
+
+static void op_mask_all(Batch *b, const Instr *in) {
+    (void)in;
+    for (size_t i = 0; i < b->count; i++)
+        b->mask[i] = 1.0;
+}
+
+#define CMP_OP(name, expr)                                        \
+    static void name(Batch *b, const Instr *in) {                 \
+        const double *x = b->column[in->field];                   \
+        const double a = in->a, c = in->b;                        \
+        (void)c;                                                  \
+        for (size_t i = 0; i < b->count; i++)                     \
+            b->mask[i] *= (expr) ? 1.0 : 0.0;                     \
+    }
+
+CMP_OP(op_lt, x[i] < a)
+CMP_OP(op_le, x[i] <= a)
+CMP_OP(op_gt, x[i] > a)
+CMP_OP(op_ge, x[i] >= a)
+CMP_OP(op_eq, x[i] == a)
+CMP_OP(op_ne, x[i] != a)
+CMP_OP(op_in, x[i] >= a && x[i] <= c)
+
+static void op_user_eq(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->mask[i] *= strncmp(b->user[i], in->user, USERNAME_LEN) == 0 ? 1.0 : 0.0;
+}
+
+static void op_user_ne(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->mask[i] *= strncmp(b->user[i], in->user, USERNAME_LEN) != 0 ? 1.0 : 0.0;
+}
+
+static void op_multiply(Batch *b, const Instr *in) {
+    const double k = in->a - 1.0;
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] += b->score[i] * k * b->mask[i];
+}
+
+static void op_bonus(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] += in->a * b->mask[i];
+}
+
+static void op_cap(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++) {
+        double over = b->score[i] > in->a ? b->score[i] - in->a : 0.0;
+        b->score[i] -= over * b->mask[i];
+    }
+}
+
+/* Unconditional actions skip the mask altogether. */
+static void op_multiply_all(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] *= in->a;
+}
+
+static void op_bonus_all(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] += in->a;
+}
+
+static void op_cap_all(Batch *b, const Instr *in) {
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] = b->score[i] > in->a ? in->a : b->score[i];
+}
+
+typedef struct {
+    Instr code[MAX_PROGRAM];
+    size_t length;
+    unsigned fields;        /* columns the program reads */
+    int users;              /* conditions on user names */
+    int rules;
+    int has_user_cap;
+    double user_cap;
+} Program;
+
+static int parse_number(const char *s, double *out) {
+    char *end;
+    *out = strtod(s, &end);
+    return end != s && *end == '\0' ? 0 : -1;
+}
+
+static int parse_field(const char *s) {
+    static const char *names[FIELD_COUNT] = { "lat", "lon", "value", "id" };
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (strcmp(s, names[f]) == 0)
+            return f;
+    }
+    return -1;
+}
+
+static Instr *emit(Program *p, OpFn fn) {
+    if (p->length == MAX_PROGRAM)
+        return NULL;
+    Instr *in = &p->code[p->length++];
+    memset(in, 0, sizeof(*in));
+    in->fn = fn;
+    return in;
+}
+
+/* Compiles one rule line; returns 0, or -1 with *error set. */
+static int compile_rule(Program *p, char *line, const char **error) {
+    char *words[64];
+    int n = 0;
+    for (char *w = strtok(line, " \t\r\n"); w && n < 64; w = strtok(NULL, " \t\r\n"))
+        words[n++] = w;
+    if (n == 0)
+        return 0;
+
+    double x;
+    if (n < 2 || parse_number(words[1], &x) == -1) {
+        *error = "expected '<action> <number>'";
+        return -1;
+    }
+    if (strcmp(words[0], "cap_user") == 0) {
+        if (n != 2) {
+            *error = "cap_user takes no conditions";
+            return -1;
+        }
+        p->has_user_cap = 1;
+        p->user_cap = x;
+        p->rules++;
+        return 0;
+    }
+
+    int action = strcmp(words[0], "multiply") == 0 ? 0 : strcmp(words[0], "bonus") == 0 ? 1 :
+                 strcmp(words[0], "cap") == 0 ? 2 : -1;
+    if (action == -1) {
+        *error = "unknown action (multiply, bonus, cap, cap_user)";
+        return -1;
+    }
+    if (n > 2 && strcmp(words[2], "if") != 0) {
+        *error = "expected 'if' after the action";
+        return -1;
+    }
+
+    if (n > 2 && !emit(p, op_mask_all)) {
+        *error = "too many rules";
+        return -1;
+    }
+    for (int i = 3; i < n; i += 4) {
+        if (i + 2 >= n) {
+            *error = "incomplete condition";
+            return -1;
+        }
+        const char *field = words[i], *op = words[i + 1], *arg = words[i + 2];
+        Instr *in;
+        if (strcmp(field, "user") == 0) {
+            in = emit(p, strcmp(op, "==") == 0 ? op_user_eq : strcmp(op, "!=") == 0 ? op_user_ne : NULL);
+            if (in && !in->fn) {
+                *error = "user conditions use == or !=";
+                return -1;
+            }
+            if (in)
+                snprintf(in->user, sizeof(in->user), "%s", arg);
+            p->users = 1;
+        } else {
+            int f = parse_field(field);
+            OpFn fn = strcmp(op, "<") == 0 ? op_lt : strcmp(op, "<=") == 0 ? op_le :
+                      strcmp(op, ">") == 0 ? op_gt : strcmp(op, ">=") == 0 ? op_ge :
+                      strcmp(op, "==") == 0 ? op_eq : strcmp(op, "!=") == 0 ? op_ne :
+                      strcmp(op, "in") == 0 ? op_in : NULL;
+            if (f == -1 || !fn) {
+                *error = "unknown field or operator";
+                return -1;
+            }
+            in = emit(p, fn);
+            if (in) {
+                in->field = f;
+                char *dots = fn == op_in ? strstr(arg, "..") : NULL;
+                if (dots)
+                    *dots = '\0';
+                if ((fn == op_in && !dots) || parse_number(arg, &in->a) == -1 ||
+                    (dots && parse_number(dots + 2, &in->b) == -1)) {
+                    *error = fn == op_in ? "expected a range <a>..<b>" : "expected a number";
+                    return -1;
+                }
+            }
+            p->fields |= 1u << f;
+        }
+        if (!in) {
+            *error = "too many rules";
+            return -1;
+        }
+        if (i + 3 < n && strcmp(words[i + 3], "and") != 0) {
+            *error = "conditions are joined with 'and'";
+            return -1;
+        }
+    }
+
+    static const OpFn masked[] = { op_multiply, op_bonus, op_cap };
+    static const OpFn always[] = { op_multiply_all, op_bonus_all, op_cap_all };
+    Instr *in = emit(p, n > 2 ? masked[action] : always[action]);
+    if (!in) {
+        *error = "too many rules";
+        return -1;
+    }
+    in->a = x;
+    p->rules++;
+    return 0;
+}
+
+/* Loads and compiles a hunt's rules; no file means plain value sums. */
+static int load_rules(const char *hunt_id, Program *p) {
+    memset(p, 0, sizeof(*p));
+    char path[PATH_MAX];
+    if (rules_path(path, sizeof(path), hunt_id) == -1)
+        return -1;
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return errno == ENOENT ? 0 : -1;
+
+    char line[512];
+    int number = 0, status = 0;
+    while (status == 0 && fgets(line, sizeof(line), f)) {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        const char *error = NULL;
+        if (compile_rule(p, line, &error) == -1) {
+            fprintf(stderr, "%s:%d: %s\n", path, number, error);
+            errno = EINVAL;
+            status = -1;
+        }
+    }
+    fclose(f);
+    return status;
+}
+
+/* Per-user totals, kept only when the rules cap them. */
+typedef struct {
+    char name[USERNAME_LEN];
+    double total;
+    int used;
+} UserTotal;
+
+typedef struct {
+    const Program *program;
+    Batch batch;
+    int64_t plain_total;
+    double total;
+    UserTotal *users;
+    size_t user_count, user_capacity;
+} Scorer;
+
+static UserTotal *user_total(Scorer *s, const char *name) {
+    if (s->user_count * 2 >= s->user_capacity) {
+        size_t capacity = s->user_capacity ? s->user_capacity * 2 : 1024;
+        UserTotal *table = calloc(capacity, sizeof(UserTotal));
+        if (!table)
+            return NULL;
+        for (size_t i = 0; i < s->user_capacity; i++) {
+            if (!s->users[i].used)
+                continue;
+            size_t j = user_key(s->users[i].name) & (capacity - 1);
+            while (table[j].used)
+                j = (j + 1) & (capacity - 1);
+            table[j] = s->users[i];
+        }
+        free(s->users);
+        s->users = table;
+        s->user_capacity = capacity;
+    }
+    size_t j = user_key(name) & (s->user_capacity - 1);
+    while (s->users[j].used && strncmp(s->users[j].name, name, USERNAME_LEN) != 0)
+        j = (j + 1) & (s->user_capacity - 1);
+    if (!s->users[j].used) {
+        memcpy(s->users[j].name, name, USERNAME_LEN);
+        s->users[j].used = 1;
+        s->user_count++;
+    }
+    return &s->users[j];
+}
+
+static int scorer_flush(Scorer *s) {
+    Batch *b = &s->batch;
+    const Program *p = s->program;
+    for (size_t i = 0; i < b->count; i++)
+        b->score[i] = b->records[i].value;
+    if (p->fields & (1u << FIELD_LAT))
+        for (size_t i = 0; i < b->count; i++)
+            b->column[FIELD_LAT][i] = b->records[i].latitude;
+    if (p->fields & (1u << FIELD_LON))
+        for (size_t i = 0; i < b->count; i++)
+            b->column[FIELD_LON][i] = b->records[i].longitude;
+    if (p->fields & (1u << FIELD_VALUE))
+        for (size_t i = 0; i < b->count; i++)
+            b->column[FIELD_VALUE][i] = b->records[i].value;
+    if (p->fields & (1u << FIELD_ID))
+        for (size_t i = 0; i < b->count; i++)
+            b->column[FIELD_ID][i] = b->records[i].treasure_id;
+    if (p->users || p->has_user_cap)
+        for (size_t i = 0; i < b->count; i++)
+            b->user[i] = b->records[i].username;
+
+    for (size_t k = 0; k < p->length; k++)
+        p->code[k].fn(b, &p->code[k]);
+
+    if (p->has_user_cap) {
+        for (size_t i = 0; i < b->count; i++) {
+            UserTotal *u = user_total(s, b->user[i]);
+            if (!u)
+                return -1;
+            u->total += b->score[i];
+        }
+    } else {
+        double sum = 0;
+        for (size_t i = 0; i < b->count; i++)
+            sum += b->score[i];
+        s->total += sum;
+    }
+    b->count = 0;
+    return 0;
+}
+
+static int scorer_add(Scorer *s, const Treasure *t) {
+    if (s->program->rules == 0) {
+        s->plain_total += t->value;
+        return 0;
+    }
+    s->batch.records[s->batch.count++] = *t;
+    return s->batch.count == SCORE_BATCH ? scorer_flush(s) : 0;
+}
+
+static int scorer_finish(Scorer *s) {
+    if (s->program->rules == 0)
+        return 0;
+    if (s->batch.count > 0 && scorer_flush(s) == -1)
+        return -1;
+    for (size_t i = 0; i < s->user_capacity; i++) {
+        if (s->users[i].used)
+            s->total += s->users[i].total < s->program->user_cap ? s->users[i].total : s->program->user_cap;
+    }
+    free(s->users);
+    return 0;
+}
+
+static void print_total(const Scorer *s, const char *hunt_id, const char *window) {
+    if (s->program->rules == 0) {
+        printf("Total score for hunt '%s'%s: %lld\n", hunt_id, window, (long long)s->plain_total);
+        return;
+    }
+    double total = s->total;
+    int integral = total == (double)(long long)total;
+    printf("Total score for hunt '%s'%s (%d scoring rule(s)): %.*f\n", hunt_id, window, s->program->rules,
+           integral ? 0 : 2, total);
+}
+
+static int add_score(const Treasure *t, int64_t added, void *arg) {
+    (void)added;
+    return scorer_add(arg, t) == -1 ? 1 : 0;
+}
+
+/* Scores only the treasures added within w, reading just the blocks of
+   the hunt whose time range overlaps it. */
+static int window_score(const char *hunt_id, const TimeWindow *w, Scorer *s) {
+    if (time_scan(hunt_id, w, add_score, s, NULL) == -1) {
+        if (errno == ENODATA)
+            fprintf(stderr, "Hunt '%s' has no current insertion times (run 'treasure_manager reindex %s').\n",
+                    hunt_id, hunt_id);
+        else
+            perror("Failed to read treasure file");
+        return EXIT_FAILURE;
+    }
+    if (scorer_finish(s) == -1) {
+        perror("Failed to score treasures");
+        return EXIT_FAILURE;
+    }
+
+    char since[32], until[32], window[96];
+    snprintf(window, sizeof(window), " (added %s .. %s)",
+             w->since > 1 ? format_time(w->since, since, sizeof(since)) : "start",
+             w->until < INT64_MAX ? format_time(w->until, until, sizeof(until)) : "now");
+    print_total(s, hunt_id, window);
+    return EXIT_SUCCESS;
+}
+
+/* score_calculator --approx <hunt_id|all>...: the sketch summary of the
+   named hunts merged together, without reading their records. */
+static int approx_add(const char *hunt_id, void *arg) {
+    static HuntSketch sketch;
+    int scanned;
+    if (hunt_sketch_get(hunt_id, &sketch, &scanned) == -1) {
+        fprintf(stderr, "Failed to read hunt %s: %s\n", hunt_id, strerror(errno));
+        return -1;
+    }
+    sketch_merge(arg, &sketch);
+    return 0;
+}
+
+static int approx_main(int count, char *hunts[]) {
+    static HuntSketch merged;
+    sketch_init(&merged);
+    char name[512] = "";
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        int all = strcmp(hunts[i], "all") == 0;
+        if ((all ? for_each_hunt(approx_add, &merged, 1) : approx_add(hunts[i], &merged)) != 0)
+            return EXIT_FAILURE;
+        if (len < sizeof(name))
+            len += snprintf(name + len, sizeof(name) - len, "%s%s%s%s", i ? ", " : "",
+                            all ? "" : "hunt '", all ? "all hunts" : hunts[i], all ? "" : "'");
+    }
+    sketch_report(stdout, name, &merged, 10);
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <hunt_id>\n", argv[0]);
+    if (argc >= 3 && strcmp(argv[1], "--approx") == 0)
+        return approx_main(argc - 2, argv + 2);
+
+    TimeWindow w;
+    if (argc < 2 || parse_time_window(argc - 2, argv + 2, &w) != argc - 2) {
+        fprintf(stderr, "Usage: %s <hunt_id> [--since <time>] [--until <time>]\n", argv[0]);
+        fprintf(stderr, "       %s --approx <hunt_id|all>...\n", argv[0]);
         return EXIT_FAILURE;
     }
 
     const char *hunt_id = argv[1];
+    static Program program;
+    static Scorer scorer;
+    if (load_rules(hunt_id, &program) == -1) {
+        if (errno != EINVAL)
+            perror("Failed to read scoring rules");
+        return EXIT_FAILURE;
+    }
+    scorer.program = &program;
 
-    char file_path[256];
-    snprintf(file_path, sizeof(file_path), "%s/%s", hunt_id, "treasures.dat");
+    if (argc > 2)
+        return window_score(hunt_id, &w, &scorer);
 
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) {
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1) {
         perror("Failed to open treasure file");
         return EXIT_FAILURE;
     }
 
     Treasure t;
-    int total_score = 0;
+    int result;
 
-    while (read(fd, &t, sizeof(Treasure)) == sizeof(Treasure)) {
-        total_score += t.value;
+    while ((result = record_stream_next(&rs, &t)) == 1) {
+        if (scorer_add(&scorer, &t) == -1) {
+            result = -1;
+            break;
+        }
     }
 
-    close(fd);
+    record_stream_close(&rs);
+    if (result == -1 || scorer_finish(&scorer) == -1) {
+        perror("Failed to read treasure file");
+        return EXIT_FAILURE;
+    }
 
-    printf("Total score for hunt '%s': %d\n", hunt_id, total_score);
+    print_total(&scorer, hunt_id, "");
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,319 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "hub_protocol.h"
+
+/* Single-producer/single-consumer byte ring in a shared memfd, carrying the
+   monitor -> hub frame stream without a pipe in between. The hub creates
+   it and the monitor inherits the descriptors. Page 0 holds the header;
+   the data pages are mapped twice back to back, so any span of up to
+   size bytes starting in the ring is contiguous in memory and can be
+   passed to write() or read() without splitting at the wrap.
+
+   Each side sleeps only when the ring gives it nothing to do: it sets its
+   *_waiting flag, checks the ring again and then polls its eventfd, which
+   the other side signals once it sees the flag. peer_fd is a pipe end
+   whose hangup tells a sleeping side that the other process is gone. */
+#define SHM_RING_MAGIC "SRG1"
+#define SHM_RING_BYTES (4u << 20)
+#define SHM_RING_PAGE 4096
+
+typedef struct {
+    char magic[4];
+    uint32_t size;                              /* data bytes, a power of two */
+    _Alignas(64) uint64_t head;                 /* bytes written, advanced by the producer */
+    uint32_t reader_waiting;
+    _Alignas(64) uint64_t tail;                 /* bytes consumed, advanced by the consumer */
+    uint32_t writer_waiting;
+} ShmRingHeader;
+
+typedef struct {
+    ShmRingHeader *hdr;                         /* NULL when no ring is in use */
+    char *data;
+    uint32_t mask;
+    size_t map_len;
+    int mem_fd;
+    int data_fd;                                /* producer -> consumer wakeups */
+    int space_fd;                               /* consumer -> producer wakeups */
+    int peer_fd;
+    uint64_t read_pos;                          /* consumer: bytes consumed, published as tail lazily */
+    size_t held;                                /* consumer: bytes lent out by shm_ring_peek() */
+} ShmRing;
+
+static inline int shm_ring_map(ShmRing *r, uint32_t size) {
+    r->map_len = SHM_RING_PAGE + 2 * (size_t)size;
+    char *base = mmap(NULL, r->map_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return -1;
+    if (mmap(base, SHM_RING_PAGE + size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             r->mem_fd, 0) == MAP_FAILED ||
+        mmap(base + SHM_RING_PAGE + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             r->mem_fd, SHM_RING_PAGE) == MAP_FAILED) {
+        munmap(base, r->map_len);
+        return -1;
+    }
+    r->hdr = (ShmRingHeader *)base;
+    r->data = base + SHM_RING_PAGE;
+    r->mask = size - 1;
+    return 0;
+}
+
+static inline void shm_ring_close(ShmRing *r) {
+    if (r->hdr)
+        munmap(r->hdr, r->map_len);
+    if (r->mem_fd != -1)
+        close(r->mem_fd);
+    if (r->data_fd != -1)
+        close(r->data_fd);
+    if (r->space_fd != -1)
+        close(r->space_fd);
+    r->hdr = NULL;
+    r->mem_fd = r->data_fd = r->space_fd = -1;
+}
+
+/* Creates a ring of size bytes (a power of two, a multiple of the page
+   size). The descriptors are close-on-exec; clear that in the child that
+   should inherit them. */
+static inline int shm_ring_create(ShmRing *r, uint32_t size) {
+    memset(r, 0, sizeof(*r));
+    r->mem_fd = memfd_create("monitor-ring", MFD_CLOEXEC);
+    r->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->peer_fd = -1;
+    if (r->mem_fd == -1 || r->data_fd == -1 || r->space_fd == -1 ||
+        ftruncate(r->mem_fd, SHM_RING_PAGE + (off_t)size) == -1 || shm_ring_map(r, size) == -1) {
+        shm_ring_close(r);
+        return -1;
+    }
+    memcpy(r->hdr->magic, SHM_RING_MAGIC, 4);
+    r->hdr->size = size;
+    return 0;
+}
+
+/* Maps a ring created by the other process from inherited descriptors. */
+static inline int shm_ring_attach(ShmRing *r, int mem_fd, int data_fd, int space_fd, int peer_fd) {
+    memset(r, 0, sizeof(*r));
+    r->mem_fd = mem_fd;
+    r->data_fd = data_fd;
+    r->space_fd = space_fd;
+    r->peer_fd = peer_fd;
+    ShmRingHeader header;
+    struct stat st;
+    if (fstat(mem_fd, &st) == -1 || pread(mem_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SHM_RING_MAGIC, 4) != 0 || header.size == 0 ||
+        (header.size & (header.size - 1)) != 0 || st.st_size != SHM_RING_PAGE + (off_t)header.size ||
+        shm_ring_map(r, header.size) == -1) {
+        r->hdr = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void shm_ring_signal(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+        ;
+}
+
+static inline void shm_ring_clear(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) == -1 && errno == EINTR)
+        ;
+}
+
+/* Wakes the other side if it announced it is asleep. */
+static inline void shm_ring_wake(uint32_t *waiting, int fd) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST))
+        shm_ring_signal(fd);
+}
+
+static inline uint64_t shm_ring_readable(const ShmRing *r) {
+    return __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE) - r->read_pos;
+}
+
+static inline uint64_t shm_ring_writable(const ShmRing *r) {
+    return r->hdr->size - (r->hdr->head - __atomic_load_n(&r->hdr->tail, __ATOMIC_ACQUIRE));
+}
+
+/* Consumer: hands the space consumed so far back to the producer. */
+static inline void shm_ring_publish(ShmRing *r) {
+    if (r->hdr->tail == r->read_pos)
+        return;
+    __atomic_store_n(&r->hdr->tail, r->read_pos, __ATOMIC_RELEASE);
+    shm_ring_wake(&r->hdr->writer_waiting, r->space_fd);
+}
+
+static inline void shm_ring_release(ShmRing *r);
+
+/* Consumer: returns 1 when data is waiting, otherwise announces that the
+   consumer is about to sleep on data_fd and returns 0. A frame still held
+   from shm_ring_peek() is released first; it is not new data. */
+static inline int shm_ring_arm(ShmRing *r) {
+    shm_ring_release(r);
+    if (shm_ring_readable(r) > 0)
+        return 1;
+    shm_ring_publish(r);
+    __atomic_store_n(&r->hdr->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    if (shm_ring_readable(r) > 0) {
+        __atomic_store_n(&r->hdr->reader_waiting, 0, __ATOMIC_RELAXED);
+        return 1;
+    }
+    return 0;
+}
+
+/* Sleeps until the ring may have changed for the given side. Returns -1
+   with EPIPE once the peer is gone. */
+static inline int shm_ring_wait(ShmRing *r, int writer) {
+    uint32_t *waiting = writer ? &r->hdr->writer_waiting : &r->hdr->reader_waiting;
+    int fd = writer ? r->space_fd : r->data_fd;
+    if (!writer)
+        shm_ring_publish(r);
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if ((writer ? shm_ring_writable(r) : shm_ring_readable(r)) > 0) {
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    struct pollfd fds[2] = { { fd, POLLIN, 0 }, { r->peer_fd, 0, 0 } };
+    if (poll(fds, 2, -1) == -1)
+        return errno == EINTR ? 0 : -1;
+    if (fds[0].revents & POLLIN)
+        shm_ring_clear(fd);
+    else if (fds[1].revents & (POLLHUP | POLLERR)) {
+        /* Anything published before the peer left is still there. */
+        if ((writer ? shm_ring_writable(r) : shm_ring_readable(r)) > 0)
+            return 0;
+        errno = EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+/* Producer: publishes len bytes that were written at the head. */
+static inline void shm_ring_commit(ShmRing *r, size_t len) {
+    __atomic_store_n(&r->hdr->head, r->hdr->head + len, __ATOMIC_RELEASE);
+    shm_ring_wake(&r->hdr->reader_waiting, r->data_fd);
+}
+
+/* Consumer: releases len bytes read at the tail. The producer learns of
+   it once a quarter of the ring is free or the consumer goes to sleep,
+   which keeps the fence and cache line transfer off the per-frame path. */
+static inline void shm_ring_consume(ShmRing *r, size_t len) {
+    r->read_pos += len;
+    if (r->read_pos - r->hdr->tail >= r->hdr->size / 4)
+        shm_ring_publish(r);
+}
+
+/* Producer: copies buf into the ring, waiting for space as needed. */
+static inline int shm_ring_write(ShmRing *r, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        uint64_t room = shm_ring_writable(r);
+        if (room == 0) {
+            if (shm_ring_wait(r, 1) == -1)
+                return -1;
+            continue;
+        }
+        size_t n = len < room ? len : room;
+        memcpy(r->data + (r->hdr->head & r->mask), p, n);
+        shm_ring_commit(r, n);
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Producer: reads up to len bytes of fd straight into the ring. Returns
+   the number of bytes moved, short after a read error or early end of
+   file, or -1 when waiting for room failed. */
+static inline ssize_t shm_ring_write_fd(ShmRing *r, int fd, size_t len) {
+    size_t moved = 0;
+    while (moved < len) {
+        uint64_t room = shm_ring_writable(r);
+        if (room == 0) {
+            if (shm_ring_wait(r, 1) == -1)
+                return -1;
+            continue;
+        }
+        size_t want = len - moved;
+        ssize_t n = read(fd, r->data + (r->hdr->head & r->mask), want < room ? want : room);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        shm_ring_commit(r, n);
+        moved += n;
+    }
+    return moved;
+}
+
+static inline void shm_ring_release(ShmRing *r) {
+    if (r->held > 0)
+        shm_ring_consume(r, r->held);
+    r->held = 0;
+}
+
+/* Consumer: waits until len bytes (at most the ring size) are readable
+   and returns a pointer to them in place. They stay valid until the next
+   read from the ring. NULL at end of stream. */
+static inline const char *shm_ring_peek(ShmRing *r, size_t len) {
+    shm_ring_release(r);
+    while (shm_ring_readable(r) < len) {
+        if (shm_ring_wait(r, 0) == -1)
+            return NULL;
+    }
+    r->held = len;
+    return r->data + (r->read_pos & r->mask);
+}
+
+/* Consumer: like read_full() on a pipe. Returns 1 when len bytes were read,
+   0 at end of stream before any byte, -1 otherwise. */
+static inline int shm_ring_read(ShmRing *r, void *buf, size_t len) {
+    shm_ring_release(r);
+    char *p = buf;
+    size_t done = 0;
+    while (done < len) {
+        uint64_t avail = shm_ring_readable(r);
+        if (avail == 0) {
+            if (shm_ring_wait(r, 0) == -1)
+                return done == 0 && errno == EPIPE ? 0 : -1;
+            continue;
+        }
+        size_t n = len - done < avail ? len - done : avail;
+        memcpy(p + done, r->data + (r->read_pos & r->mask), n);
+        shm_ring_consume(r, n);
+        done += n;
+    }
+    return 1;
+}
+
+/* Consumer: writes len bytes from the ring straight to fd. */
+static inline int shm_ring_read_fd(ShmRing *r, int fd, size_t len) {
+    shm_ring_release(r);
+    while (len > 0) {
+        uint64_t avail = shm_ring_readable(r);
+        if (avail == 0) {
+            if (shm_ring_wait(r, 0) == -1)
+                return -1;
+            continue;
+        }
+        size_t n = len < avail ? len : avail;
+        if (write_full(fd, r->data + (r->read_pos & r->mask), n) == -1)
+            return -1;
+        shm_ring_consume(r, n);
+        len -= n;
+    }
+    return 0;
+}
+
+#endif
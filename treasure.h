@@ -0,0 +1,49 @@
+#ifndef TREASURE_H
+#define TREASURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define USERNAME_LEN 50
+#define CLUE_LEN 255
+#define RECORD_FILE "treasures.dat"
+#define LOG_FILE "logged_hunt"
+
+/* On-disk record layout shared by every tool; packed so that the file format
+   does not depend on the compiler's padding rules. */
+typedef struct __attribute__((packed)) {
+    int treasure_id;
+    char username[USERNAME_LEN];
+    float latitude;
+    float longitude;
+    char clue[CLUE_LEN];
+    int value;
+} Treasure;
+
+/* Summary of a hunt's records (kept in hunt.meta, sent in hunt_stats
+   responses). */
+typedef struct {
+    uint64_t records;
+    int64_t total_value;
+    int32_t min_value;
+    int32_t max_value;
+    uint64_t distinct_users;
+    float min_latitude;
+    float max_latitude;
+    float min_longitude;
+    float max_longitude;
+} HuntStats;
+
+static inline void print_hunt_stats(FILE *out, const char *hunt_id, int name_len, const HuntStats *s) {
+    fprintf(out, "Hunt: %.*s\n", name_len, hunt_id);
+    fprintf(out, "  Treasures      : %llu\n", (unsigned long long)s->records);
+    fprintf(out, "  Total value    : %lld\n", (long long)s->total_value);
+    if (s->records == 0)
+        return;
+    fprintf(out, "  Value range    : %d .. %d\n", s->min_value, s->max_value);
+    fprintf(out, "  Distinct users : %llu\n", (unsigned long long)s->distinct_users);
+    fprintf(out, "  Latitude range : %.6f .. %.6f\n", s->min_latitude, s->max_latitude);
+    fprintf(out, "  Longitude range: %.6f .. %.6f\n", s->min_longitude, s->max_longitude);
+}
+
+#endif
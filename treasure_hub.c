@@ -1,210 +1,1229 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <signal.h>
-#include <string.h>
-#include <sys/wait.h>
-#include <fcntl.h>
-
-#define SIGCALC (SIGRTMAX+1)
-
-pid_t monitor_pid = -1;
-int score_pipe_fd[2];
-
-void handle_sigchld(int sig) {
-    int status;
-    pid_t pid = waitpid(monitor_pid, &status, WNOHANG);
-    if (pid > 0) {
-        printf("[Hub] Monitor (PID %d) has terminated.\n", pid);
-        monitor_pid = -1;
-    }
-}
-
-void start_monitor() {
-    if (monitor_pid != -1) {
-        printf("[Hub] Monitor is already running (PID: %d)\n", monitor_pid);
-        return;
-    }
-
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("[Hub] fork failed");
-        exit(EXIT_FAILURE);
-    }
-
-    if (pid == 0) {
-        execl("./monitor", "monitor", NULL);
-        perror("[Hub] Failed to start monitor process");
-        exit(EXIT_FAILURE);
-    } else {
-        monitor_pid = pid;
-        printf("[Hub] Monitor started with PID: %d\n", monitor_pid);
-    }
-}
-
-void list_hunts() {
-    if (monitor_pid == -1) {
-        printf("[Hub] No monitor running. Start it first.\n");
-        return;
-    }
-    printf("[Hub] Sending request to list hunts...\n");
-    if (kill(monitor_pid, SIGUSR1) == -1) {
-        perror("[Hub] Failed to send SIGUSR1 to monitor");
-    }
-}
-
-void handle_list_treasures(char *input) {
-    char *token = strtok(input, " ");
-    token = strtok(NULL, " ");
-    if (!token) {
-        printf("[Hub] Usage: there wasnt any input, it should contain a hunt name\n");
-        return;
-    }
-
-    int fd = open("cmd_hunt.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        perror("[Hub] Failed to open cmd_hunt.txt");
-        return;
-    }
-
-    size_t len = strlen(token);
-    char buf[len + 2];
-    strcpy(buf, token);
-    strcat(buf, "\n");
-
-    if (write(fd, buf, strlen(buf)) == -1) {
-        perror("[Hub] Failed to write HuntId to cmd_hunt.txt");
-        close(fd);
-        return;
-    }
-    close(fd);
-
-    printf("[Hub] Requesting list_treasures for hunt '%s'...\n", token);
-
-    if (kill(monitor_pid, SIGUSR2) == -1) {
-        perror("[Hub] Failed to send SIGUSR2 to monitor");
-    }
-}
-
-void handle_view_treasure(char *input) {
-    char *token = strtok(input, " ");
-    char *hunt_id = strtok(NULL, " ");
-    char *treasure_id = strtok(NULL, " ");
-    if (!hunt_id || !treasure_id) {
-        printf("[Hub] Usage: view_treasure <HuntId> <treasure_id>\n");
-        return;
-    }
-
-    int fd = open("cmd_view.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        perror("[Hub] Failed to open cmd_view.txt");
-        return;
-    }
-
-    char buffer[512];
-    snprintf(buffer, sizeof(buffer), "%s\n%s\n", hunt_id, treasure_id);
-    if (write(fd, buffer, strlen(buffer)) == -1) {
-        perror("[Hub] Failed to write to cmd_view.txt");
-        close(fd);
-        return;
-    }
-    close(fd);
-
-    printf("[Hub] Requesting view_treasure for hunt '%s' and treasure '%s'...\n", hunt_id, treasure_id);
-
-    if (kill(monitor_pid, SIGRTMIN) == -1) {
-        perror("[Hub] Failed to send SIGRTMIN to monitor");
-    }
-}
-
-void stop_monitor() {
-    if (monitor_pid == -1) {
-        printf("[Hub] No monitor is running.\n");
-        return;
-    }
-
-    printf("[Hub] Sending termination request to monitor (PID: %d)...\n", monitor_pid);
-    if (kill(monitor_pid, SIGTERM) == -1) {
-        perror("[Hub] Failed to send SIGTERM to monitor");
-        return;
-    }
-
-    while (monitor_pid != -1) {
-        sleep(1);
-    }
-    printf("[Hub] Monitor terminated.\n");
-}
-
-void exit_hub() {
-    if (monitor_pid != -1) {
-        printf("[Hub] Cannot exit: Monitor is still running (PID: %d)\n", monitor_pid);
-        return;
-    }
-    printf("[Hub] Exiting Treasure Hub.\n");
-    exit(EXIT_SUCCESS);
-}
-
-void handle_calculate_score() {
-    char hunt_id[100];
-    printf("Enter hunt id for score calculation: ");
-    if (fgets(hunt_id, sizeof(hunt_id), stdin) == NULL) {
-        printf("Error reading hunt id.\n");
-        return;
-    }
-    hunt_id[strcspn(hunt_id, "\n")] = '\0';
-
-    int fd = open("cmd_score.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        perror("[Hub] Failed to open cmd_score.txt");
-        return;
-    }
-
-    if (write(fd, hunt_id, strlen(hunt_id)) == -1) {
-        perror("[Hub] Failed to write HuntId to cmd_score.txt");
-        close(fd);
-        return;
-    }
-    close(fd);
-
-    printf("[Hub] Requesting score calculation for hunt '%s'...\n", hunt_id);
-
-    if (kill(monitor_pid, SIGCALC) == -1) {
-        perror("[Hub] Failed to send SIGCALC to monitor");
-    }
-}
-
-int main() {
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = handle_sigchld;
-    sigaction(SIGCHLD, &sa, NULL);
-
-    char command[256];
-    printf("Welcome to Treasure Hub\n");
-    while (1) {
-        printf("hub> ");
-        if (fgets(command, sizeof(command), stdin) == NULL)
-            break;
-        command[strcspn(command, "\n")] = '\0';
-
-        if (strcmp(command, "start_monitor") == 0) {
-            start_monitor();
-        } else if (strcmp(command, "list_hunts") == 0) {
-            list_hunts();
-        } else if (strncmp(command, "list_treasures", 14) == 0) {
-            handle_list_treasures(command);
-        } else if (strncmp(command, "view_treasure", 13) == 0) {
-            handle_view_treasure(command);
-        } else if (strcmp(command, "stop_monitor") == 0) {
-            stop_monitor();
-        } else if (strcmp(command, "calculate_score") == 0) {
-            handle_calculate_score();
-        } else if (strcmp(command, "exit") == 0) {
-            exit_hub();
-        } else {
-            printf("[Hub] Unknown or unimplemented command: %s\n", command);
-        }
-    }
-
-    return 0;
-}
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "treasure.h"
+#include "hub_protocol.h"
+#include "hunt_store.h"
+#include "shm_ring.h"
+
+#define MAX_MONITORS 64
+#define MONITOR_QUICK_FAILURE 2     /* seconds; a crash sooner counts against the shard */
+#define MONITOR_MAX_FAILURES 3      /* quick crashes in a row before a shard is left down */
+
+/* One monitor process. With monitor_count > 1 each owns the hunts that
+   hunt_shard() maps to its index, and requests covering every hunt go to
+   all of them. */
+typedef struct {
+    pid_t pid;
+    int in_fd;
+    int out_fd;
+    ShmRing ring;
+    time_t started;
+    int failures;           /* quick crashes in a row */
+    int down;               /* given up on until the next stop_monitor */
+} MonitorLink;
+
+MonitorLink links[MAX_MONITORS];
+int monitor_count = 1;
+int monitors_started = 0;
+uint32_t next_tag = 1;
+int export_fd = -1;
+
+/* Responses arrive through a shared-memory ring (HUB_TRANSPORT=pipe keeps
+   them on the monitor's stdout, which otherwise only reports its exit). */
+int ring_transport = 1;
+
+void link_reset(MonitorLink *m) {
+    m->pid = -1;
+    m->in_fd = -1;
+    m->out_fd = -1;
+    m->ring = (ShmRing){ .mem_fd = -1, .data_fd = -1, .space_fd = -1, .peer_fd = -1 };
+}
+
+void handle_sigchld(int sig) {
+    (void)sig;
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        printf("[Hub] Monitor (PID %d) has terminated.\n", pid);
+        for (int i = 0; i < monitor_count; i++) {
+            if (links[i].pid == pid)
+                links[i].pid = -1;
+        }
+    }
+}
+
+void print_treasure(FILE *out, const Treasure *t) {
+    fprintf(out, "Treasure ID %d\n", t->treasure_id);
+    fprintf(out, "  Username  : %.*s\n", USERNAME_LEN, t->username);
+    fprintf(out, "  Latitude  : %.6f\n", t->latitude);
+    fprintf(out, "  Longitude : %.6f\n", t->longitude);
+    fprintf(out, "  Clue      : %.*s\n", CLUE_LEN, t->clue);
+    fprintf(out, "  Value     : %d\n", t->value);
+}
+
+void monitor_lost(MonitorLink *m) {
+    if (monitor_count > 1)
+        printf("[Hub] Lost connection to monitor shard %d.\n", (int)(m - links));
+    else
+        printf("[Hub] Lost connection to monitor.\n");
+    close(m->out_fd);
+    m->out_fd = -1;
+    shm_ring_close(&m->ring);
+}
+
+/* read_full() on whichever transport a monitor's responses use. */
+int link_read(int out_fd, ShmRing *ring, void *buf, size_t len) {
+    if (ring->hdr)
+        return shm_ring_read(ring, buf, len);
+    return read_full(out_fd, buf, len);
+}
+
+int read_frame_header(MonitorLink *m, FrameHeader *header) {
+    if (link_read(m->out_fd, &m->ring, header, sizeof(*header)) != 1 ||
+        header->length > FRAME_MAX_PAYLOAD) {
+        monitor_lost(m);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns the payload of the frame whose header was just read, valid until
+   the next read from the monitor; from the ring it is read in place. */
+const char *read_frame_payload(MonitorLink *m, const FrameHeader *header) {
+    static char payload[FRAME_MAX_PAYLOAD];
+    if (m->ring.hdr) {
+        const char *p = shm_ring_peek(&m->ring, header->length);
+        if (!p)
+            monitor_lost(m);
+        return p;
+    }
+    if (read_full(m->out_fd, payload, header->length) == -1) {
+        monitor_lost(m);
+        return NULL;
+    }
+    return payload;
+}
+
+/* Reads one frame from a monitor. Returns NULL if the monitor went away. */
+const char *read_frame(MonitorLink *m, FrameHeader *header) {
+    if (read_frame_header(m, header) == -1)
+        return NULL;
+    return read_frame_payload(m, header);
+}
+
+/* Sets fds[0..1] up to wait for a monitor's output. Returns 1 when output
+   is already waiting in the ring, so the caller must not sleep. */
+int monitor_poll_fds(MonitorLink *m, struct pollfd fds[2]) {
+    if (!m->ring.hdr) {
+        fds[0] = (struct pollfd){ m->out_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ -1, 0, 0 };
+        return 0;
+    }
+    fds[0] = (struct pollfd){ m->ring.data_fd, POLLIN, 0 };
+    fds[1] = (struct pollfd){ m->out_fd, 0, 0 };
+    return shm_ring_arm(&m->ring);
+}
+
+/* After poll(): returns 1 when a frame (or the monitor's exit) can be read.
+   A wakeup left over from data already read does not count. */
+int monitor_ready(MonitorLink *m, const struct pollfd fds[2], int pending) {
+    if (m->out_fd == -1)
+        return 0;
+    if (fds[0].fd == m->ring.data_fd && m->ring.hdr) {
+        if (fds[0].revents & POLLIN)
+            shm_ring_clear(m->ring.data_fd);
+        return pending || shm_ring_readable(&m->ring) > 0 || (fds[1].revents & (POLLHUP | POLLERR));
+    }
+    return fds[0].revents & (POLLIN | POLLHUP);
+}
+
+/* Moves an export frame's payload from the monitor pipe into export_fd with
+   splice(), so the records never pass through the hub's memory; from the
+   ring they are written out in place. */
+int splice_export(MonitorLink *m, size_t len) {
+    if (m->ring.hdr)
+        return shm_ring_read_fd(&m->ring, export_fd, len);
+    while (len > 0) {
+        ssize_t n = splice(m->out_fd, NULL, export_fd, NULL, len, SPLICE_F_MORE);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && errno == EINVAL) {
+            char buf[8192];
+            n = read(m->out_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (n > 0 && write_full(export_fd, buf, n) == -1)
+                return -1;
+        }
+        if (n <= 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* A response that several monitors answer in parts: each sends its share
+   of the closing summary as FRAME_TOTALS or FRAME_SKETCH, and the summary
+   is printed once the last of them has ended. */
+typedef struct {
+    int waiting;            /* monitors that have not ended yet */
+    int status;             /* first failure among them */
+    uint32_t kind;          /* TOTALS_* seen, 0 for none */
+    int64_t totals[3];
+    char username[USERNAME_LEN + 1];
+    HuntSketch *sketch;
+    uint32_t hunts, scanned;
+} Merge;
+
+/* Folds a frame into merge; returns 0 for frames that are rendered as is. */
+int merge_frame(Merge *merge, const FrameHeader *header, const char *payload) {
+    if (header->type == FRAME_TOTALS && header->length >= sizeof(FrameTotals)) {
+        FrameTotals totals;
+        memcpy(&totals, payload, sizeof(totals));
+        merge->kind = totals.kind;
+        for (int i = 0; i < 3; i++)
+            merge->totals[i] += totals.values[i];
+        size_t name_len = header->length - sizeof(totals);
+        if (name_len > USERNAME_LEN)
+            name_len = USERNAME_LEN;
+        memcpy(merge->username, payload + sizeof(totals), name_len);
+        merge->username[name_len] = '\0';
+        /* A hunt's score is also shown on its own line. */
+        return totals.kind != TOTALS_SCORE;
+    }
+    if (header->type == FRAME_SKETCH && header->length == sizeof(HuntSketch) + 2 * sizeof(uint32_t)) {
+        static HuntSketch part;
+        uint32_t counts[2];
+        if (!merge->sketch && (merge->sketch = malloc(sizeof(HuntSketch))) != NULL)
+            sketch_init(merge->sketch);
+        if (!merge->sketch)
+            return 1;
+        memcpy(&part, payload, sizeof(part));
+        memcpy(counts, payload + sizeof(part), sizeof(counts));
+        sketch_merge(merge->sketch, &part);
+        merge->hunts += counts[0];
+        merge->scanned += counts[1];
+        return 1;
+    }
+    return 0;
+}
+
+/* Counts one monitor's END; returns 1 when it was the last one. */
+int merge_end(Merge *merge, int status) {
+    if (status != 0 && merge->status == 0)
+        merge->status = status;
+    return --merge->waiting <= 0;
+}
+
+/* Prints a score sent in hundredths the way score_calculator would. */
+void print_hundredths(FILE *out, int64_t hundredths) {
+    double score = hundredths / 100.0;
+    fprintf(out, "%.*f\n", hundredths % 100 == 0 ? 0 : 2, score);
+}
+
+void merge_finish(FILE *out, Merge *merge) {
+    if (merge->kind == TOTALS_SEARCH) {
+        fprintf(out, "%lld matching treasure(s)\n", (long long)merge->totals[0]);
+    } else if (merge->kind == TOTALS_USER) {
+        fprintf(out, "User '%s': %lld treasure(s) in %lld hunt(s), total score %lld\n", merge->username,
+                (long long)merge->totals[0], (long long)merge->totals[1], (long long)merge->totals[2]);
+    } else if (merge->kind == TOTALS_SCORE) {
+        fprintf(out, "Total score across %lld hunt(s): ", (long long)merge->totals[1]);
+        print_hundredths(out, merge->totals[0]);
+    }
+    if (merge->sketch) {
+        sketch_report(out, "all hunts", merge->sketch, 10);
+        fprintf(out, "  (%u hunt(s), %u sketched by a full scan, %d monitor(s))\n", merge->hunts,
+                merge->scanned, monitor_count);
+        free(merge->sketch);
+        merge->sketch = NULL;
+    }
+}
+
+/* Renders a frame; returns 1 for the END frame of a response (status stored
+   in *status), 0 otherwise. */
+int render_frame(FILE *out, const FrameHeader *header, const char *payload, int *status) {
+    switch (header->type) {
+    case FRAME_TEXT:
+        fwrite(payload, 1, header->length, out);
+        break;
+    case FRAME_ERROR:
+        fprintf(out, "[Hub] Error: %.*s\n", (int)header->length, payload);
+        break;
+    case FRAME_HUNT: {
+        uint32_t count;
+        if (header->length < sizeof(count))
+            break;
+        memcpy(&count, payload, sizeof(count));
+        size_t offset = sizeof(count);
+        HuntStats stats;
+        int has_stats = (header->flags & HUNT_STATS) && header->length >= offset + sizeof(stats);
+        if (has_stats) {
+            memcpy(&stats, payload + offset, sizeof(stats));
+            offset += sizeof(stats);
+        }
+        fprintf(out, "Hunt %.*s: %u treasure(s)", (int)(header->length - offset), payload + offset, count);
+        if (has_stats)
+            fprintf(out, ", total value %lld, %llu user(s)", (long long)stats.total_value,
+                    (unsigned long long)stats.distinct_users);
+        fprintf(out, "%s\n", header->flags & HUNT_ARCHIVED ? " (archived)" : "");
+        break;
+    }
+    case FRAME_HUNT_STATS: {
+        HuntStats stats;
+        if (header->length < sizeof(stats))
+            break;
+        memcpy(&stats, payload, sizeof(stats));
+        print_hunt_stats(out, payload + sizeof(stats), (int)(header->length - sizeof(stats)), &stats);
+        break;
+    }
+    case FRAME_TREASURE: {
+        Treasure t;
+        if (header->length != sizeof(t))
+            break;
+        memcpy(&t, payload, sizeof(t));
+        print_treasure(out, &t);
+        break;
+    }
+    case FRAME_USER_TREASURE: {
+        Treasure t;
+        if (header->length < sizeof(t))
+            break;
+        memcpy(&t, payload, sizeof(t));
+        fprintf(out, "[%.*s] ", (int)(header->length - sizeof(t)), payload + sizeof(t));
+        print_treasure(out, &t);
+        break;
+    }
+    case FRAME_WATCH: {
+        uint32_t kind;
+        Treasure t;
+        if (header->length < sizeof(kind) + sizeof(t))
+            break;
+        memcpy(&kind, payload, sizeof(kind));
+        memcpy(&t, payload + sizeof(kind), sizeof(t));
+        int name_len = (int)(header->length - sizeof(kind) - sizeof(t));
+        const char *name = payload + sizeof(kind) + sizeof(t);
+        if (kind == WATCH_ADDED) {
+            fprintf(out, "[Hub] Watch %.*s: treasure added\n", name_len, name);
+            print_treasure(out, &t);
+        } else if (kind == WATCH_REMOVED) {
+            fprintf(out, "[Hub] Watch %.*s: treasure ID %d removed\n", name_len, name, t.treasure_id);
+        } else if (kind == WATCH_ENDED) {
+            fprintf(out, "[Hub] Watch %.*s: watch closed\n", name_len, name);
+        }
+        break;
+    }
+    case FRAME_TOTALS: {
+        FrameTotals totals;
+        if (header->length < sizeof(totals))
+            break;
+        memcpy(&totals, payload, sizeof(totals));
+        if (totals.kind == TOTALS_SCORE) {
+            fprintf(out, "Total score for hunt '%.*s': ", (int)(header->length - sizeof(totals)),
+                    payload + sizeof(totals));
+            print_hundredths(out, totals.values[0]);
+        }
+        break;
+    }
+    case FRAME_EXPORT:
+        for (uint32_t off = 0; off + sizeof(Treasure) <= header->length; off += sizeof(Treasure)) {
+            Treasure t;
+            memcpy(&t, payload + off, sizeof(t));
+            print_treasure(out, &t);
+        }
+        break;
+    case FRAME_END: {
+        int32_t code = 0;
+        if (header->length == sizeof(code))
+            memcpy(&code, payload, sizeof(code));
+        *status = code;
+        return 1;
+    }
+    default:
+        fprintf(out, "[Hub] Ignoring unknown frame type %u\n", header->type);
+        break;
+    }
+    return 0;
+}
+
+/* Reads and renders frames from a monitor until the end of one response,
+   folding summary parts into merge when one is given. Returns the response
+   status, or -1 if the monitor went away. */
+int read_response(MonitorLink *m, Merge *merge) {
+    while (1) {
+        FrameHeader header;
+        int status;
+        if (read_frame_header(m, &header) == -1)
+            return -1;
+        if (header.type == FRAME_EXPORT && export_fd != -1) {
+            if (splice_export(m, header.length) == -1) {
+                monitor_lost(m);
+                return -1;
+            }
+            continue;
+        }
+        const char *payload = read_frame_payload(m, &header);
+        if (!payload)
+            return -1;
+        if (merge && merge_frame(merge, &header, payload))
+            continue;
+        if (render_frame(stdout, &header, payload, &status)) {
+            fflush(stdout);
+            return status;
+        }
+    }
+}
+
+/* Sends "<tag> <command>\n" down a monitor's command pipe. */
+int send_command(MonitorLink *m, uint32_t tag, const char *command) {
+    char line[512];
+    int n = snprintf(line, sizeof(line), "%u %s\n", tag, command);
+    if (n < 0 || n >= (int)sizeof(line)) {
+        printf("[Hub] Command too long.\n");
+        return -1;
+    }
+    if (write_full(m->in_fd, line, n) == -1) {
+        perror("[Hub] Failed to send command to monitor");
+        return -1;
+    }
+    return 0;
+}
+
+/* The monitor a request goes to, or -1 for all of them: requests naming a
+   hunt go to its owner, list_hunts, stats, user_report and "all" targets
+   cover every hunt. */
+int command_shard(const char *command) {
+    char verb[32], target[256];
+    if (monitor_count == 1)
+        return 0;
+    if (sscanf(command, "%31s %255s", verb, target) < 2 || strcmp(verb, "stats") == 0 ||
+        strcmp(verb, "user_report") == 0 || strcmp(target, "all") == 0)
+        return -1;
+    return hunt_shard(target, monitor_count);
+}
+
+/* The request as sent to one of several monitors: a stats dump gets one
+   file per shard. */
+const char *shard_command(const char *command, int shard, char *buf, size_t size) {
+    if (monitor_count == 1 || strncmp(command, "stats dump ", 11) != 0)
+        return command;
+    snprintf(buf, size, "%s.%d", command, shard);
+    return buf;
+}
+
+int link_usable(MonitorLink *m) {
+    if (m->pid != -1 && m->in_fd != -1 && m->out_fd != -1)
+        return 1;
+    printf("[Hub] Monitor shard %d is not running.\n", (int)(m - links));
+    return 0;
+}
+
+void supervise_monitors();
+
+int request(const char *command) {
+    supervise_monitors();
+    if (!monitors_started) {
+        printf("[Hub] No monitor running. Start it first.\n");
+        return -1;
+    }
+
+    int shard = command_shard(command);
+    if (shard != -1) {
+        MonitorLink *m = &links[shard];
+        if (!link_usable(m) || send_command(m, next_tag++, command) == -1)
+            return -1;
+        return read_response(m, NULL);
+    }
+
+    /* Every monitor works on its share at once; the parts are read back
+       in shard order. */
+    Merge merge;
+    memset(&merge, 0, sizeof(merge));
+    uint32_t tag = next_tag++;
+    int sent[MAX_MONITORS];
+    for (int i = 0; i < monitor_count; i++) {
+        char buf[512];
+        sent[i] = link_usable(&links[i]) &&
+                  send_command(&links[i], tag, shard_command(command, i, buf, sizeof(buf))) == 0;
+        if (sent[i])
+            merge.waiting++;
+        else
+            merge.status = -1;
+    }
+    for (int i = 0; i < monitor_count; i++) {
+        if (sent[i])
+            merge_end(&merge, read_response(&links[i], &merge));
+    }
+    merge_finish(stdout, &merge);
+    fflush(stdout);
+    return merge.status;
+}
+
+/* Starts ./monitor for shard index on fresh pipes, handing it a state file
+   saved by its predecessor when state_path is given. */
+int spawn_monitor(MonitorLink *m, int index, const char *state_path) {
+    ShmRing ring = { .mem_fd = -1, .data_fd = -1, .space_fd = -1, .peer_fd = -1 };
+    if (ring_transport && shm_ring_create(&ring, SHM_RING_BYTES) == -1)
+        perror("[Hub] Shared-memory ring unavailable, using the pipe");
+    /* Close-on-exec, so that no monitor holds another one's pipes open. */
+    int in_pipe[2], out_pipe[2];
+    if (pipe2(in_pipe, O_CLOEXEC) == -1) {
+        perror("[Hub] Failed to create monitor pipe");
+        shm_ring_close(&ring);
+        return -1;
+    }
+    if (pipe2(out_pipe, O_CLOEXEC) == -1) {
+        perror("[Hub] Failed to create monitor pipe");
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        shm_ring_close(&ring);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[Hub] fork failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        if (dup2(in_pipe[0], STDIN_FILENO) == -1 || dup2(out_pipe[1], STDOUT_FILENO) == -1) {
+            perror("[Hub] Failed to redirect monitor input/output");
+            exit(EXIT_FAILURE);
+        }
+        char *args[10] = { "monitor" };
+        int n = 1;
+        char ring_arg[64], shard_arg[16], shards_arg[16];
+        if (ring.hdr) {
+            fcntl(ring.mem_fd, F_SETFD, 0);
+            fcntl(ring.data_fd, F_SETFD, 0);
+            fcntl(ring.space_fd, F_SETFD, 0);
+            snprintf(ring_arg, sizeof(ring_arg), "%d:%d:%d", ring.mem_fd, ring.data_fd, ring.space_fd);
+            args[n++] = "--ring";
+            args[n++] = ring_arg;
+        }
+        if (state_path) {
+            args[n++] = "--restore";
+            args[n++] = (char *)state_path;
+        }
+        if (monitor_count > 1) {
+            snprintf(shard_arg, sizeof(shard_arg), "%d", index);
+            snprintf(shards_arg, sizeof(shards_arg), "%d", monitor_count);
+            args[n++] = "--shard";
+            args[n++] = shard_arg;
+            args[n++] = "--shards";
+            args[n++] = shards_arg;
+        }
+        execv("./monitor", args);
+        perror("[Hub] Failed to start monitor process");
+        exit(EXIT_FAILURE);
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    m->in_fd = in_pipe[1];
+    m->out_fd = out_pipe[0];
+    m->pid = pid;
+    m->started = time(NULL);
+    ring.peer_fd = m->out_fd;
+    m->ring = ring;
+    return 0;
+}
+
+/* Starts every shard's monitor and reads their startup responses. Returns
+   -1 unless all of them came up. */
+int spawn_monitors() {
+    int result = 0;
+    for (int i = 0; i < monitor_count; i++) {
+        if (spawn_monitor(&links[i], i, NULL) == -1) {
+            result = -1;
+            continue;
+        }
+        monitors_started = 1;
+        if (monitor_count > 1)
+            printf("[Hub] Monitor shard %d/%d started with PID: %d\n", i, monitor_count, links[i].pid);
+        else
+            printf("[Hub] Monitor started with PID: %d\n", links[i].pid);
+    }
+    for (int i = 0; i < monitor_count; i++) {
+        if (links[i].out_fd != -1 && read_response(&links[i], NULL) != 0)
+            result = -1;
+    }
+    return result;
+}
+
+void start_monitor() {
+    if (monitors_started) {
+        printf("[Hub] Monitor is already running (PID: %d)\n", links[0].pid);
+        return;
+    }
+    spawn_monitors();
+}
+
+/* Turns a hub command line into the request sent to the monitor. Returns 0
+   and fills out on success, -1 (after printing usage) otherwise. */
+int build_monitor_command(char *input, char *out, size_t size) {
+    char *command = strtok(input, " ");
+    if (!command)
+        return -1;
+
+    if (strcmp(command, "list_hunts") == 0) {
+        snprintf(out, size, "list_hunts");
+    } else if (strcmp(command, "list_treasures") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            printf("[Hub] Usage: list_treasures <HuntId>\n");
+            return -1;
+        }
+        snprintf(out, size, "list_treasures %s", hunt_id);
+    } else if (strcmp(command, "view_treasure") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *treasure_id = strtok(NULL, " ");
+        if (!hunt_id || !treasure_id) {
+            printf("[Hub] Usage: view_treasure <HuntId> <treasure_id>\n");
+            return -1;
+        }
+        snprintf(out, size, "view_treasure %s %s", hunt_id, treasure_id);
+    } else if (strcmp(command, "calculate_score") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *window = strtok(NULL, "");
+        if (!hunt_id) {
+            printf("[Hub] Usage: calculate_score <HuntId|all> [--since <time>] [--until <time>]\n");
+            return -1;
+        }
+        snprintf(out, size, "calculate_score %s%s%s", hunt_id, window ? " " : "", window ? window : "");
+    } else if (strcmp(command, "hunt_stats") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            printf("[Hub] Usage: hunt_stats <HuntId>\n");
+            return -1;
+        }
+        snprintf(out, size, "hunt_stats %s", hunt_id);
+    } else if (strcmp(command, "user_report") == 0) {
+        char *username = strtok(NULL, " ");
+        if (!username) {
+            printf("[Hub] Usage: user_report <username>\n");
+            return -1;
+        }
+        snprintf(out, size, "user_report %s", username);
+    } else if (strcmp(command, "search") == 0) {
+        char *target = strtok(NULL, " ");
+        char *terms = strtok(NULL, "");
+        if (!target || !terms) {
+            printf("[Hub] Usage: search <HuntId|all> <term> [AND|OR <term>]...\n");
+            return -1;
+        }
+        snprintf(out, size, "search %s %s", target, terms);
+    } else if (strcmp(command, "approx") == 0) {
+        char *target = strtok(NULL, " ");
+        if (!target) {
+            printf("[Hub] Usage: approx <HuntId|all>\n");
+            return -1;
+        }
+        snprintf(out, size, "approx %s", target);
+    } else if (strcmp(command, "watch") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            printf("[Hub] Usage: watch <HuntId>\n");
+            return -1;
+        }
+        snprintf(out, size, "watch %s", hunt_id);
+    } else if (strcmp(command, "unwatch") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        char *subscription = strtok(NULL, " ");
+        if (!hunt_id) {
+            printf("[Hub] Usage: unwatch <HuntId> [subscription]\n");
+            return -1;
+        }
+        snprintf(out, size, "unwatch %s%s%s", hunt_id, subscription ? " " : "", subscription ? subscription : "");
+    } else if (strcmp(command, "export_hunt") == 0) {
+        char *hunt_id = strtok(NULL, " ");
+        if (!hunt_id) {
+            printf("[Hub] Usage: export_hunt <HuntId> [output_file]\n");
+            return -1;
+        }
+        snprintf(out, size, "export_hunt %s", hunt_id);
+    } else if (strcmp(command, "stats") == 0) {
+        char *request = strtok(NULL, "");
+        if (!request)
+            request = "show";
+        if (strcmp(request, "show") != 0 && strcmp(request, "reset") != 0 &&
+            strcmp(request, "on") != 0 && strcmp(request, "off") != 0 &&
+            strncmp(request, "dump ", 5) != 0) {
+            printf("[Hub] Usage: stats [show|reset|on|off|dump <file>]\n");
+            return -1;
+        }
+        snprintf(out, size, "stats %s", request);
+    } else {
+        printf("[Hub] Unknown or unimplemented command: %s\n", command);
+        return -1;
+    }
+    return 0;
+}
+
+/* Reads one line of user input into line (without the newline). While
+   waiting it also renders whatever the monitor sends unprompted, such as
+   watch events. Returns NULL at end of input. */
+char *read_input_line(char *line, size_t size) {
+    static char buf[1024];
+    static size_t len;
+    static int eof;
+
+    while (1) {
+        char *newline = memchr(buf, '\n', len);
+        if (newline || (eof && len > 0) || len == sizeof(buf)) {
+            size_t line_len = newline ? (size_t)(newline - buf) : len;
+            size_t copy = line_len < size - 1 ? line_len : size - 1;
+            memcpy(line, buf, copy);
+            line[copy] = '\0';
+            size_t used = newline ? line_len + 1 : line_len;
+            memmove(buf, buf + used, len - used);
+            len -= used;
+            return line;
+        }
+        if (eof)
+            return NULL;
+
+        supervise_monitors();
+        fflush(stdout);
+        struct pollfd fds[1 + 2 * MAX_MONITORS] = { { STDIN_FILENO, POLLIN, 0 } };
+        int pending[MAX_MONITORS], any_pending = 0;
+        for (int i = 0; i < monitor_count; i++)
+            any_pending |= pending[i] = monitor_poll_fds(&links[i], fds + 1 + 2 * i);
+        if (poll(fds, 1 + 2 * monitor_count, any_pending ? 0 : -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+        for (int i = 0; i < monitor_count; i++) {
+            if (monitor_ready(&links[i], fds + 1 + 2 * i, pending[i])) {
+                FrameHeader header;
+                int status;
+                const char *payload = read_frame(&links[i], &header);
+                if (payload)
+                    render_frame(stdout, &header, payload, &status);
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t n = read(STDIN_FILENO, buf + len, sizeof(buf) - len);
+            if (n == 0)
+                eof = 1;
+            else if (n > 0)
+                len += n;
+        }
+    }
+}
+
+/* Asks a monitor to finish the requests it has been sent and exit. Its
+   remaining frames are printed until it closes its pipe, then it is reaped
+   with SIGCHLD held off so the handler cannot take the status first. */
+void retire_monitor(pid_t pid, int in_fd, int out_fd, ShmRing *ring) {
+    sigset_t chld, old_mask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &old_mask);
+
+    if (pid > 0 && kill(pid, SIGTERM) == -1 && errno != ESRCH)
+        perror("[Hub] Failed to send SIGTERM to monitor");
+    if (in_fd != -1)
+        close(in_fd);
+
+    if (out_fd != -1) {
+        static char payload[FRAME_MAX_PAYLOAD];
+        FrameHeader header;
+        int status;
+        while (link_read(out_fd, ring, &header, sizeof(header)) == 1 && header.length <= FRAME_MAX_PAYLOAD &&
+               link_read(out_fd, ring, payload, header.length) == 1)
+            render_frame(stdout, &header, payload, &status);
+        close(out_fd);
+    }
+    shm_ring_close(ring);
+
+    int status;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid)
+        printf("[Hub] Monitor (PID %d) has terminated.\n", pid);
+    fflush(stdout);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+void stop_monitor() {
+    if (!monitors_started) {
+        printf("[Hub] No monitor is running.\n");
+        return;
+    }
+
+    monitors_started = 0;
+    for (int i = 0; i < monitor_count; i++) {
+        MonitorLink *m = &links[i];
+        pid_t pid = m->pid;
+        if (pid != -1)
+            printf("[Hub] Sending termination request to monitor (PID: %d)...\n", pid);
+        m->pid = -1;
+        retire_monitor(pid, m->in_fd, m->out_fd, &m->ring);
+        link_reset(m);
+        m->failures = 0;
+        m->down = 0;
+    }
+    printf("[Hub] Monitor terminated.\n");
+}
+
+/* Replaces each running monitor in turn without a gap in service: the old
+   one saves its warm state and hands over its watches, the new one starts
+   from it, and only then is the old one retired. */
+void restart_monitor() {
+    if (!monitors_started) {
+        printf("[Hub] No monitor is running.\n");
+        return;
+    }
+
+    for (int i = 0; i < monitor_count; i++) {
+        MonitorLink *m = &links[i];
+        if (m->pid == -1 || m->out_fd == -1)
+            continue;
+
+        char state_path[64], command[128];
+        snprintf(state_path, sizeof(state_path), "monitor-%d.state", m->pid);
+        snprintf(command, sizeof(command), "handoff %s", state_path);
+        int handed_off = send_command(m, next_tag++, command) == 0 && read_response(m, NULL) == 0;
+        if (!handed_off)
+            printf("[Hub] State handoff failed; the new monitor starts cold.\n");
+
+        MonitorLink old = *m;
+        if (spawn_monitor(m, i, handed_off ? state_path : NULL) == -1) {
+            if (handed_off) {
+                unlink(state_path);
+                printf("[Hub] Watches handed off by PID %d are closed; watch those hunts again.\n", old.pid);
+            }
+            continue;
+        }
+        if (read_response(m, NULL) != 0) {
+            printf("[Hub] New monitor failed to start; keeping PID %d.\n", old.pid);
+            MonitorLink fresh = *m;
+            *m = old;
+            retire_monitor(fresh.pid, fresh.in_fd, fresh.out_fd, &fresh.ring);
+            continue;
+        }
+
+        printf("[Hub] Monitor restarted (PID %d -> %d).\n", old.pid, m->pid);
+        retire_monitor(old.pid, old.in_fd, old.out_fd, &old.ring);
+    }
+}
+
+/* Brings back monitors that died on their own, one shard at a time while
+   the others keep serving. A shard that keeps crashing right after it was
+   started is left down. */
+void supervise_monitors() {
+    if (!monitors_started)
+        return;
+    for (int i = 0; i < monitor_count; i++) {
+        MonitorLink *m = &links[i];
+        if (m->down || (m->pid != -1 && m->out_fd != -1))
+            continue;
+
+        pid_t pid = m->pid;
+        m->pid = -1;
+        retire_monitor(pid, m->in_fd, m->out_fd, &m->ring);
+        link_reset(m);
+        if (time(NULL) - m->started < MONITOR_QUICK_FAILURE)
+            m->failures++;
+        else
+            m->failures = 0;
+        if (m->failures >= MONITOR_MAX_FAILURES) {
+            printf("[Hub] Monitor shard %d keeps failing; leaving it down.\n", i);
+            m->down = 1;
+            continue;
+        }
+
+        if (spawn_monitor(m, i, NULL) == 0 && read_response(m, NULL) == 0)
+            printf("[Hub] Monitor shard %d restarted (PID %d).\n", i, m->pid);
+    }
+}
+
+void exit_hub() {
+    if (monitors_started) {
+        printf("[Hub] Cannot exit: Monitor is still running (PID: %d)\n", links[0].pid);
+        return;
+    }
+    printf("[Hub] Exiting Treasure Hub.\n");
+    exit(EXIT_SUCCESS);
+}
+
+void handle_calculate_score(char *input) {
+    char line[300];
+    if (strcmp(input, "calculate_score") == 0) {
+        char hunt_id[100];
+        printf("Enter hunt id for score calculation: ");
+        if (read_input_line(hunt_id, sizeof(hunt_id)) == NULL) {
+            printf("Error reading hunt id.\n");
+            return;
+        }
+        snprintf(line, sizeof(line), "calculate_score %s", hunt_id);
+        input = line;
+    }
+
+    char command[512];
+    if (build_monitor_command(input, command, sizeof(command)) == -1)
+        return;
+    const char *target = command + strlen("calculate_score ");
+    if (strncmp(target, "all", 3) == 0 && (target[3] == '\0' || target[3] == ' '))
+        printf("[Hub] Requesting score calculation for all hunts...\n");
+    else
+        printf("[Hub] Requesting score calculation for hunt '%s'...\n", target);
+    request(command);
+}
+
+/* export_hunt <HuntId> [output_file]: without a file the records are
+   decoded and printed, with one they are written there raw. */
+void handle_export_hunt(char *input) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s", input);
+    strtok(line, " ");
+    strtok(NULL, " ");
+    char *output = strtok(NULL, " ");
+
+    char command[512];
+    if (build_monitor_command(input, command, sizeof(command)) == -1)
+        return;
+
+    if (output) {
+        export_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (export_fd == -1) {
+            perror("[Hub] Failed to open export file");
+            return;
+        }
+    }
+
+    printf("[Hub] Requesting %s...\n", command);
+    int status = request(command);
+
+    if (export_fd != -1) {
+        struct stat st;
+        if (status == 0 && fstat(export_fd, &st) == 0)
+            printf("[Hub] Exported %ld record(s) to %s\n", (long)(st.st_size / sizeof(Treasure)), output);
+        close(export_fd);
+        export_fd = -1;
+    }
+}
+
+void handle_monitor_command(char *input) {
+    char command[512];
+    if (build_monitor_command(input, command, sizeof(command)) == -1)
+        return;
+    printf("[Hub] Requesting %s...\n", command);
+    request(command);
+}
+
+typedef struct {
+    char command[512];
+    char *output;
+    size_t output_len;
+    FILE *out;
+    int done;
+    Merge merge;
+} BatchEntry;
+
+/* Commands waiting to be written to one monitor. */
+typedef struct {
+    char *text;
+    size_t len, off;
+} BatchQueue;
+
+/* Non-interactive mode: every command of the script is written to the
+   monitors that serve it as fast as their pipes accept it, while responses
+   are read back concurrently and printed in command order. */
+int run_batch(FILE *in) {
+    BatchEntry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    int local_errors = 0;
+
+    char line[512];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char *start = line;
+        while (*start == ' ')
+            start++;
+        if (*start == '\0' || *start == '#')
+            continue;
+        if (strcmp(start, "start_monitor") == 0 || strcmp(start, "stop_monitor") == 0 ||
+            strcmp(start, "exit") == 0)
+            continue;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BatchEntry *grown = realloc(entries, capacity * sizeof(*entries));
+            if (!grown) {
+                perror("[Hub] Out of memory");
+                free(entries);
+                return EXIT_FAILURE;
+            }
+            entries = grown;
+        }
+        BatchEntry *e = &entries[count];
+        memset(e, 0, sizeof(*e));
+        if (build_monitor_command(start, e->command, sizeof(e->command)) == -1) {
+            local_errors++;
+            continue;
+        }
+        count++;
+    }
+
+    if (spawn_monitors() == -1) {
+        stop_monitor();
+        free(entries);
+        return EXIT_FAILURE;
+    }
+
+    /* Tags are 1-based indexes into entries; a command for every hunt goes
+       to each monitor under the same tag. */
+    BatchQueue queues[MAX_MONITORS];
+    for (size_t i = 0; i < count; i++)
+        entries[i].merge.waiting = command_shard(entries[i].command) == -1 ? monitor_count : 1;
+    for (int s = 0; s < monitor_count; s++) {
+        FILE *queue_out = open_memstream(&queues[s].text, &queues[s].len);
+        for (size_t i = 0; i < count; i++) {
+            char buf[512];
+            int shard = command_shard(entries[i].command);
+            if (shard == -1 || shard == s)
+                fprintf(queue_out, "%zu %s\n", i + 1, shard_command(entries[i].command, s, buf, sizeof(buf)));
+        }
+        fclose(queue_out);
+        queues[s].off = 0;
+        fcntl(links[s].in_fd, F_SETFL, fcntl(links[s].in_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    size_t completed = 0, printed = 0;
+    int lost = 0;
+    while (completed < count && !lost) {
+        struct pollfd fds[3 * MAX_MONITORS];
+        int ready[MAX_MONITORS], any_ready = 0;
+        for (int s = 0; s < monitor_count; s++) {
+            BatchQueue *q = &queues[s];
+            fds[3 * s] = (struct pollfd){ q->off < q->len ? links[s].in_fd : -1, POLLOUT, 0 };
+            any_ready |= ready[s] = monitor_poll_fds(&links[s], fds + 3 * s + 1);
+        }
+        if (poll(fds, 3 * monitor_count, any_ready ? 0 : -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("[Hub] poll failed");
+            break;
+        }
+
+        for (int s = 0; s < monitor_count && !lost; s++) {
+            BatchQueue *q = &queues[s];
+            if (fds[3 * s].revents & (POLLOUT | POLLERR)) {
+                ssize_t n = write(links[s].in_fd, q->text + q->off, q->len - q->off);
+                if (n > 0)
+                    q->off += n;
+                else if (n == -1 && errno != EAGAIN && errno != EINTR) {
+                    perror("[Hub] Failed to send commands to monitor");
+                    lost = 1;
+                    break;
+                }
+            }
+
+            if (!monitor_ready(&links[s], fds + 3 * s + 1, ready[s]))
+                continue;
+            FrameHeader header;
+            const char *payload = read_frame(&links[s], &header);
+            if (!payload) {
+                lost = 1;
+                break;
+            }
+            if (header.type == FRAME_WATCH) {
+                int status;
+                render_frame(stdout, &header, payload, &status);
+                continue;
+            }
+            if (header.tag == 0 || header.tag > count)
+                continue;
+            BatchEntry *e = &entries[header.tag - 1];
+            if (!e->out)
+                e->out = open_memstream(&e->output, &e->output_len);
+            int status;
+            if (merge_frame(&e->merge, &header, payload) || !render_frame(e->out, &header, payload, &status))
+                continue;
+            if (merge_end(&e->merge, status)) {
+                merge_finish(e->out, &e->merge);
+                fclose(e->out);
+                e->out = NULL;
+                e->done = 1;
+                completed++;
+            }
+        }
+
+        while (printed < count && entries[printed].done) {
+            BatchEntry *e = &entries[printed++];
+            printf("hub> %s\n", e->command);
+            fwrite(e->output, 1, e->output_len, stdout);
+            free(e->output);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    int failed = local_errors;
+    for (size_t i = 0; i < count; i++) {
+        if (!entries[i].done || entries[i].merge.status != 0)
+            failed++;
+        if (entries[i].out)
+            fclose(entries[i].out);
+        if (!entries[i].done)
+            free(entries[i].output);
+        free(entries[i].merge.sketch);
+    }
+
+    printf("[Hub] Batch: %zu command(s), %zu completed, %d failed, %.3f s, %.0f cmd/s\n",
+           count, completed, failed, elapsed, elapsed > 0 ? completed / elapsed : 0.0);
+
+    for (int s = 0; s < monitor_count; s++)
+        free(queues[s].text);
+    free(entries);
+    if (!lost) {
+        for (int s = 0; s < monitor_count; s++) {
+            close(links[s].in_fd);
+            links[s].in_fd = -1;
+        }
+        stop_monitor();
+    }
+    return failed == 0 && !lost ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* treasure_hub --transport-bench <hunt_id> [rounds]: times list_treasures
+   responses read over the monitor's stdout pipe and over the ring. */
+int transport_bench(const char *hunt_id, int rounds) {
+    static const char *names[] = { "pipe", "ring" };
+    char command[300];
+    snprintf(command, sizeof(command), "list_treasures %s", hunt_id);
+
+    MonitorLink *m = &links[0];
+    monitor_count = 1;
+    for (int mode = 0; mode < 2; mode++) {
+        ring_transport = mode;
+        if (spawn_monitors() == -1)
+            return EXIT_FAILURE;
+        if (mode == 1 && !m->ring.hdr) {
+            printf("ring: unavailable\n");
+            stop_monitor();
+            break;
+        }
+
+        /* Round 0 warms the monitor's cache and is not timed. */
+        struct timespec begin, end;
+        size_t bytes = 0, frames = 0;
+        int status = 0;
+        for (int round = 0; round <= rounds && status == 0; round++) {
+            if (round == 1) {
+                clock_gettime(CLOCK_MONOTONIC, &begin);
+                bytes = frames = 0;
+            }
+            if (send_command(m, next_tag++, command) == -1)
+                return EXIT_FAILURE;
+            while (1) {
+                FrameHeader header;
+                const char *payload = read_frame(m, &header);
+                if (!payload)
+                    return EXIT_FAILURE;
+                bytes += sizeof(header) + header.length;
+                frames++;
+                if (header.type == FRAME_END) {
+                    memcpy(&status, payload, sizeof(status));
+                    break;
+                }
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (status != 0) {
+            printf("%s: list_treasures %s failed\n", names[mode], hunt_id);
+            stop_monitor();
+            return EXIT_FAILURE;
+        }
+
+        double ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+        printf("%s: %d x list_treasures %s: %.1f MB, %zu frames in %.2f ms (%.1f MB/s)\n",
+               names[mode], rounds, hunt_id, bytes / 1e6, frames, ms, ms > 0 ? bytes / 1e3 / ms : 0.0);
+        fflush(stdout);
+        stop_monitor();
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigchld;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *transport_env = getenv("HUB_TRANSPORT");
+    if (transport_env && strcmp(transport_env, "pipe") == 0)
+        ring_transport = 0;
+
+    /* One monitor per core unless HUB_MONITORS says otherwise. */
+    const char *monitors_env = getenv("HUB_MONITORS");
+    monitor_count = monitors_env ? atoi(monitors_env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (monitor_count < 1)
+        monitor_count = 1;
+    if (monitor_count > MAX_MONITORS)
+        monitor_count = MAX_MONITORS;
+    for (int i = 0; i < MAX_MONITORS; i++)
+        link_reset(&links[i]);
+
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        FILE *in = stdin;
+        if (argc >= 3 && strcmp(argv[2], "-") != 0) {
+            in = fopen(argv[2], "r");
+            if (!in) {
+                perror("[Hub] Failed to open batch file");
+                return EXIT_FAILURE;
+            }
+        }
+        int status = run_batch(in);
+        if (in != stdin)
+            fclose(in);
+        return status;
+    } else if (argc >= 3 && strcmp(argv[1], "--transport-bench") == 0) {
+        return transport_bench(argv[2], argc >= 4 ? atoi(argv[3]) : 10);
+    } else if (argc >= 2) {
+        fprintf(stderr, "Usage: %s [--batch [file|-] | --transport-bench <hunt_id> [rounds]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char command[256];
+    printf("Welcome to Treasure Hub\n");
+    while (1) {
+        printf("hub> ");
+        if (read_input_line(command, sizeof(command)) == NULL)
+            break;
+
+        if (strcmp(command, "start_monitor") == 0) {
+            start_monitor();
+        } else if (strcmp(command, "stop_monitor") == 0) {
+            stop_monitor();
+        } else if (strcmp(command, "restart_monitor") == 0) {
+            restart_monitor();
+        } else if (strcmp(command, "calculate_score") == 0 ||
+                   strncmp(command, "calculate_score ", 16) == 0) {
+            handle_calculate_score(command);
+        } else if (strncmp(command, "export_hunt", 11) == 0) {
+            handle_export_hunt(command);
+        } else if (strcmp(command, "exit") == 0) {
+            exit_hub();
+        } else if (command[0] != '\0') {
+            handle_monitor_command(command);
+        }
+    }
+
+    return 0;
+}
@@ -1,372 +1,4270 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/stat.h>
-#include <string.h>
-#include <time.h>
-#include <errno.h>
-
-#define USERNAME_LEN 50
-#define CLUE_LEN 255
-#define TEMP_FILE "temp.dat"
-#define RECORD_FILE "treasures.dat"
-#define LOG_FILE "logged_hunt"
-
-typedef struct {
-    int treasure_id;               
-    char username[USERNAME_LEN]; 
-    float latitude;         
-    float longitude;        
-    char clue[CLUE_LEN];             
-    int value;                        
-} Treasure;
-
-void log_operation(const char *hunt_dir, const char *operation) {
-    char log_path[256];
-    snprintf(log_path, sizeof(log_path), "%s/%s", hunt_dir, LOG_FILE);
-    int log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (log_fd == -1) {
-        perror("open log file");
-        return;
-    }
-
-    time_t now = time(NULL);
-    char log_entry[512];
-    snprintf(log_entry, sizeof(log_entry), "%s: %s\n", ctime(&now), operation);
-
-    if (write(log_fd, log_entry, strlen(log_entry)) != (ssize_t)strlen(log_entry)) {
-        perror("write log entry");
-    }
-    close(log_fd);
-}
-
-int create_symlink_for_log(const char *hunt_id) {
-    char target[256], linkpath[256];
-
-    snprintf(target, sizeof(target), "./%s/%s", hunt_id, LOG_FILE);
-    snprintf(linkpath, sizeof(linkpath), "logged_hunt-%s", hunt_id);
-
-    unlink(linkpath);
-
-    if (symlink(target, linkpath) == -1) {
-        perror("symlink creation");
-        return -1;
-    }
-    return 0;
-}
-
-int add_treasure(const char *hunt_id) {
-    if (mkdir(hunt_id, 0755) == -1) {
-        if (errno != EEXIST) {
-            perror("mkdir");
-            return -1;
-        }
-    }
-
-    if (create_symlink_for_log(hunt_id) == -1) {
-        fprintf(stderr, "Warning: Failed to create symlink for logged_hunt\n");
-    }
-
-    char record_path[256];
-    snprintf(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE);
-
-    int fd = open(record_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd == -1) {
-        perror("open treasures file");
-        return -1;
-    }
-
-    Treasure treasure;
-    
-    printf("Enter treasure ID (integer): ");
-    if (scanf("%d", &treasure.treasure_id) != 1) {
-        fprintf(stderr, "Error reading treasure_id\n");
-        close(fd);
-        return -1;
-    }
-    getchar();
-
-    printf("Enter username (max %d characters): ", USERNAME_LEN - 1);
-    if (fgets(treasure.username, USERNAME_LEN, stdin) == NULL) {
-        fprintf(stderr, "Error reading username\n");
-        close(fd);
-        return -1;
-    }
-    treasure.username[strcspn(treasure.username, "\n")] = '\0';
-
-    printf("Enter latitude (floating point): ");
-    if (scanf("%f", &treasure.latitude) != 1) {
-        fprintf(stderr, "Error reading latitude\n");
-        close(fd);
-        return -1;
-    }
-    printf("Enter longitude (floating point): ");
-    if (scanf("%f", &treasure.longitude) != 1) {
-        fprintf(stderr, "Error reading longitude\n");
-        close(fd);
-        return -1;
-    }
-    getchar();
-
-    printf("Enter clue text (max %d characters): ", CLUE_LEN - 1);
-    if (fgets(treasure.clue, CLUE_LEN, stdin) == NULL) {
-        fprintf(stderr, "Error reading clue text\n");
-        close(fd);
-        return -1;
-    }
-    treasure.clue[strcspn(treasure.clue, "\n")] = '\0';
-
-    printf("Enter treasure value (integer): ");
-    if (scanf("%d", &treasure.value) != 1) {
-        fprintf(stderr, "Error reading value\n");
-        close(fd);
-        return -1;
-    }
-
-    ssize_t written = write(fd, &treasure, sizeof(Treasure));
-    if (written != sizeof(Treasure)) {
-        perror("write treasure record");
-        close(fd);
-        return -1;
-    }
-    close(fd);
-
-    char log_details[256];
-    snprintf(log_details, sizeof(log_details), "Added treasure ID %d by user %s", 
-             treasure.treasure_id, treasure.username);
-    log_operation(hunt_id, log_details);
-
-    printf("Treasure added successfully.\n");
-    return 0;
-}
-
-int list_treasures(const char *hunt_id) {
-    char file_path[256];
-    snprintf(file_path, sizeof(file_path), "%s/%s", hunt_id, RECORD_FILE);
-
-    struct stat st;
-    if (stat(file_path, &st) == -1) {
-        perror("stat");
-        return -1;
-    }
-
-    printf("Hunt: %s\n", hunt_id);
-    printf("Total file size: %ld bytes\n", (long)st.st_size);
-
-    int treasureFileOpen = open(file_path, O_RDONLY);
-    if (treasureFileOpen == -1) {
-        perror("open treasures file");
-        return -1;
-    }
-
-    printf("\nTreasure List:\n");
-    int count = 0;
-    while (1) {
-        Treasure treasure;
-        ssize_t bytes_read = read(treasureFileOpen, &treasure, sizeof(Treasure));
-
-        if (bytes_read == 0)
-            break;
-        if (bytes_read != sizeof(Treasure)) {
-            fprintf(stderr, "Incomplete record read. File may be corrupted.\n");
-            break;
-        }
-
-        count++;
-        printf("Treasure #%d:\n", count);
-        printf("  ID        : %d\n", treasure.treasure_id);
-        printf("  Username  : %s\n", treasure.username);
-        printf("  Latitude  : %.6f\n", treasure.latitude);
-        printf("  Longitude : %.6f\n", treasure.longitude);
-        printf("  Clue      : %s\n", treasure.clue);
-        printf("  Value     : %d\n", treasure.value);
-        printf("\n");
-    }
-    close(treasureFileOpen);
-
-    if (count == 0) {
-        printf("No treasures found in hunt '%s'.\n", hunt_id);
-    }
-    return 0;
-}
-
-int view_treasure(const char *hunt_id, int target_id) {
-    char file_path[256];
-
-    snprintf(file_path, sizeof(file_path), "%s/%s", hunt_id, RECORD_FILE);
-
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening treasures file");
-        return -1;
-    }
-
-    Treasure treasure;
-    int found = 0;
-
-    while (read(fd, &treasure, sizeof(Treasure)) == sizeof(Treasure)) {
-        if (treasure.treasure_id == target_id) {
-            printf("Treasure Details:\n");
-            printf("  ID        : %d\n", treasure.treasure_id);
-            printf("  Username  : %s\n", treasure.username);
-            printf("  Latitude  : %.6f\n", treasure.latitude);
-            printf("  Longitude : %.6f\n", treasure.longitude);
-            printf("  Clue      : %s\n", treasure.clue);
-            printf("  Value     : %d\n", treasure.value);
-            found = 1;
-            break;
-        }
-    }
-    close(fd);
-
-    if (!found) {
-        fprintf(stderr, "Treasure with ID %d not found in hunt '%s'.\n", target_id, hunt_id);
-        return -1;
-    }
-
-    return 0;
-}
-
-int remove_treasure(const char *hunt_id, int target_id) {
-    char record_path[256];
-    char temp_path[256];
-
-    snprintf(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE);
-    snprintf(temp_path, sizeof(temp_path), "%s/%s", hunt_id, TEMP_FILE);
-
-    int fd_in = open(record_path, O_RDONLY);
-    if (fd_in == -1) {
-        perror("Error opening treasure file for reading");
-        return -1;
-    }
-
-    int fd_out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd_out == -1) {
-        perror("Error opening temporary file for writing");
-        close(fd_in);
-        return -1;
-    }
-
-    Treasure treasure;
-    ssize_t bytes_read;
-    int found = 0;
-
-
-    while ((bytes_read = read(fd_in, &treasure, sizeof(Treasure))) == sizeof(Treasure)) {
-        if (treasure.treasure_id == target_id) {
-            found = 1;
-            continue;
-        }
-        ssize_t bytes_written = write(fd_out, &treasure, sizeof(Treasure));
-        if (bytes_written != sizeof(Treasure)) {
-            perror("Error writing record to temporary file");
-            close(fd_in);
-            close(fd_out);
-            unlink(temp_path);
-            return -1;
-        }
-    }
-
-    if (bytes_read == -1) {
-        perror("Error reading treasure file");
-        close(fd_in);
-        close(fd_out);
-        unlink(temp_path);
-        return -1;
-    }
-
-    close(fd_in);
-    close(fd_out);
-
-    if (!found) {
-        fprintf(stderr, "Treasure with ID %d not found in hunt '%s'.\n", target_id, hunt_id);
-        unlink(temp_path);
-        return -1;
-    }
-
-    if (unlink(record_path) == -1) {
-        perror("Error removing original treasure file");
-        unlink(temp_path);
-        return -1;
-    }
-    if (rename(temp_path, record_path) == -1) {
-        perror("Error renaming temporary file to original filename");
-        return -1;
-    }
-
-    printf("Treasure with ID %d removed successfully.\n", target_id);
-    return 0;
-}
-
-int remove_hunt(const char *hunt_id) {
-    char hunt_dir[256];
-    snprintf(hunt_dir, sizeof(hunt_dir), "./%s", hunt_id);
-
-    char treasure_path[256];
-    snprintf(treasure_path, sizeof(treasure_path), "%s/%s", hunt_dir, RECORD_FILE);
-
-    char log_path[256];
-    snprintf(log_path, sizeof(log_path), "%s/%s", hunt_dir, LOG_FILE);
-
-    if (unlink(treasure_path) == -1 && errno != ENOENT) {
-        perror("Failed to delete treasures file");
-        return -1;
-    }
-
-    if (unlink(log_path) == -1 && errno != ENOENT) {
-        perror("Failed to delete logged_hunt file");
-        return -1;
-    }
-
-    if (rmdir(hunt_dir) == -1) {
-        perror("Failed to remove hunt directory (not empty?)");
-        return -1;
-    } else {
-        printf("Successfully removed hunt directory: %s\n", hunt_dir);
-    }
-
-    char symlink_path[256];
-    snprintf(symlink_path, sizeof(symlink_path), "logged_hunt-%s", hunt_id);
-    if (unlink(symlink_path) == -1 && errno != ENOENT) {
-        perror("Failed to remove symbolic link");
-        return -1;
-    } else {
-        printf("Successfully removed symbolic link: %s\n", symlink_path);
-    }
-
-    return 0;
-}
-
-
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "  %s add <hunt_id>\n", argv[0]);
-        fprintf(stderr, "  %s list <hunt_id>\n", argv[0]);
-        fprintf(stderr, "  %s view <hunt_id> <treasure_id>\n", argv[0]);
-        fprintf(stderr, "  %s remove_treasure <hunt_id> <treasure_id>\n", argv[0]);
-        fprintf(stderr, "  %s remove_hunt <hunt_id>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    const char *command = argv[1];
-    const char *hunt_id = argv[2];
-
-    if (strcmp(command, "add") == 0) {
-        return add_treasure(hunt_id);
-    } else if (strcmp(command, "list") == 0) {
-        return list_treasures(hunt_id);
-    } else if (strcmp(command, "view") == 0 && argc == 4) {
-        int id = atoi(argv[3]);
-        return view_treasure(hunt_id, id);
-    } else if (strcmp(command, "remove_treasure") == 0 && argc == 4) {
-        int id = atoi(argv[3]);
-        return remove_treasure(hunt_id, id);
-    } else if (strcmp(command, "remove_hunt") == 0) {
-        return remove_hunt(hunt_id);
-    } else {
-        fprintf(stderr, "Invalid command or arguments.\n");
-        return EXIT_FAILURE;
-    }
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdio_ext.h>
+#include "treasure.h"
+#include "hunt_store.h"
+#include "hub_protocol.h"
+
+#define TEMP_FILE "temp.dat"
+#define SOCKET_FILE "treasure_manager.sock"
+#define FD_CACHE_SIZE 64
+#define SERVE_WORKERS 8             /* clients served at once; TREASURE_MANAGER_WORKERS */
+#define SERVE_MAX_WORKERS 256
+#define SERVE_INPUT_TIMEOUT 60      /* seconds a request may wait on its client's stdin */
+#define INDEX_FILE "treasures.idx"
+#define USERS_FILE "users.idx"
+
+/* A hunt lives in the shard files when it has no directory of its own and
+   the sharded backend has been initialised. */
+int hunt_is_sharded(const char *hunt_id) {
+    struct stat st;
+    return stat(hunt_id, &st) == -1 && errno == ENOENT && access(SHARD_TABLE, F_OK) == 0;
+}
+
+void log_operation(const char *hunt_dir, const char *operation) {
+    char log_path[PATH_MAX];
+    const char *prefix = "";
+    int status;
+    if (hunt_is_sharded(hunt_dir)) {
+        status = path_format(log_path, sizeof(log_path), "%s", SHARD_LOG);
+        prefix = hunt_dir;
+    } else {
+        status = path_format(log_path, sizeof(log_path), "%s/%s", hunt_dir, LOG_FILE);
+    }
+    int log_fd = status == -1 ? -1 : open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd == -1) {
+        perror("open log file");
+        return;
+    }
+
+    time_t now = time(NULL);
+    char log_entry[512];
+    snprintf(log_entry, sizeof(log_entry), "%s: %s%s%s\n", ctime(&now),
+             prefix, *prefix ? ": " : "", operation);
+
+    if (write(log_fd, log_entry, strlen(log_entry)) != (ssize_t)strlen(log_entry)) {
+        perror("write log entry");
+    }
+    close(log_fd);
+}
+
+int create_symlink_for_log(const char *hunt_id) {
+    char target[PATH_MAX], linkpath[PATH_MAX];
+
+    if (path_format(target, sizeof(target), "./%s/%s", hunt_id, LOG_FILE) == -1 ||
+        path_format(linkpath, sizeof(linkpath), "logged_hunt-%s", hunt_id) == -1) {
+        perror("symlink path");
+        return -1;
+    }
+
+    unlink(linkpath);
+
+    if (symlink(target, linkpath) == -1) {
+        perror("symlink creation");
+        return -1;
+    }
+    return 0;
+}
+
+int read_treasure(Treasure *treasure) {
+    memset(treasure, 0, sizeof(*treasure));
+
+    printf("Enter treasure ID (integer): ");
+    if (scanf("%d", &treasure->treasure_id) != 1) {
+        fprintf(stderr, "Error reading treasure_id\n");
+        return -1;
+    }
+    getchar();
+
+    printf("Enter username (max %d characters): ", USERNAME_LEN - 1);
+    if (fgets(treasure->username, USERNAME_LEN, stdin) == NULL) {
+        fprintf(stderr, "Error reading username\n");
+        return -1;
+    }
+    treasure->username[strcspn(treasure->username, "\n")] = '\0';
+
+    printf("Enter latitude (floating point): ");
+    if (scanf("%f", &treasure->latitude) != 1) {
+        fprintf(stderr, "Error reading latitude\n");
+        return -1;
+    }
+    printf("Enter longitude (floating point): ");
+    if (scanf("%f", &treasure->longitude) != 1) {
+        fprintf(stderr, "Error reading longitude\n");
+        return -1;
+    }
+    getchar();
+
+    printf("Enter clue text (max %d characters): ", CLUE_LEN - 1);
+    if (fgets(treasure->clue, CLUE_LEN, stdin) == NULL) {
+        fprintf(stderr, "Error reading clue text\n");
+        return -1;
+    }
+    treasure->clue[strcspn(treasure->clue, "\n")] = '\0';
+
+    printf("Enter treasure value (integer): ");
+    if (scanf("%d", &treasure->value) != 1) {
+        fprintf(stderr, "Error reading value\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Opens the shard table for writing and takes its lock. */
+static int shard_table_lock(ShardTableHeader *header) {
+    int fd = shard_table_open(O_RDWR, header);
+    if (fd == -1) {
+        perror("open shard table");
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) == -1) {
+        perror("lock shard table");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Every hunt keeps the set of its treasure IDs on disk (treasures.idx, or
+   shards/<hunt>.idx for sharded hunts) so that add checks uniqueness with
+   O(1) work however large the hunt is. Directory hunts also keep the set of
+   their usernames (users.idx) and the stats block of hunt.meta, which add
+   updates incrementally. Whenever these no longer match the records they
+   are all rebuilt in a single pass. */
+typedef struct {
+    KeySet ids;
+    KeySet users;
+    HuntMeta meta;
+} HuntIndexes;
+
+static int id_index_path(char *path, size_t size, const char *hunt_id, int sharded) {
+    if (sharded)
+        return path_format(path, size, "%s/%s.idx", SHARD_DIR, hunt_id);
+    return path_format(path, size, "%s/%s", hunt_id, INDEX_FILE);
+}
+
+static void hunt_indexes_free(HuntIndexes *hi) {
+    key_set_free(&hi->ids);
+    key_set_free(&hi->users);
+}
+
+static int hunt_meta_write(const char *hunt_id, const HuntMeta *meta) {
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, META_FILE) == -1 ? -1 :
+             open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1 || write_full(fd, meta, sizeof(*meta)) == -1) {
+        perror("write hunt meta");
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* Takes the lock that serialises writers of a directory hunt; close the
+   returned descriptor to release it. */
+static int lock_hunt_dir(const char *hunt_id) {
+    int dir_fd = open(hunt_id, O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1 || flock(dir_fd, LOCK_EX) == -1) {
+        perror("lock hunt directory");
+        if (dir_fd != -1)
+            close(dir_fd);
+        return -1;
+    }
+    return dir_fd;
+}
+
+/* Change journal of a directory hunt (changes.log), read by sync to ship
+   only what changed since a replica was last brought up to date. Every
+   change to treasures.dat gets the next sequence number:
+
+     APPEND n          n records were appended
+     EDIT   positions  records rewritten in place (positions before the change)
+     DROP   positions  records removed, the rest keeping their order
+     RESET             anything else (e.g. a sort); replicas copy the file
+
+   Writers hold the hunt's directory lock. The journal id changes whenever
+   the journal is recreated (a new or restored hunt), so a replica synced
+   against an older journal is never matched against this one. */
+#define CHANGE_LOG "changes.log"
+#define CHANGE_LOG_MAGIC "HCL1"
+
+enum { CHANGE_APPEND = 1, CHANGE_EDIT, CHANGE_DROP, CHANGE_RESET };
+
+typedef struct {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t journal_id;
+    uint64_t next_seq;
+} ChangeLogHeader;
+
+typedef struct {
+    uint64_t seq;
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t count;         /* APPEND: records; EDIT/DROP: uint64 positions that follow */
+} ChangeEntry;
+
+/* A replica hunt remembers which journal and sequence number it was last
+   synced to, and how much of the source's log it already holds. */
+#define SYNC_STATE "sync.state"
+#define SYNC_STATE_MAGIC "HSY1"
+
+typedef struct {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t journal_id;
+    uint64_t synced_seq;
+    uint64_t records;
+    uint64_t log_bytes;
+} SyncState;
+
+static int change_log_append(const char *hunt_id, uint32_t kind, const uint64_t *positions, uint64_t count) {
+    char path[PATH_MAX];
+    int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, CHANGE_LOG) == -1 ? -1 :
+             open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("open change log");
+        return -1;
+    }
+
+    ChangeLogHeader header;
+    struct stat st;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, CHANGE_LOG_MAGIC, 4) != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHANGE_LOG_MAGIC, 4);
+        header.journal_id = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)getpid() << 16);
+        header.next_seq = 1;
+        if (ftruncate(fd, sizeof(header)) == -1) {
+            perror("write change log");
+            close(fd);
+            return -1;
+        }
+    }
+
+    ChangeEntry entry = { header.next_seq, kind, 0, count };
+    size_t positions_size = positions ? count * sizeof(uint64_t) : 0;
+    int status = fstat(fd, &st) == -1 ||
+                 pwrite(fd, &entry, sizeof(entry), st.st_size) != sizeof(entry) ||
+                 (positions_size && pwrite(fd, positions, positions_size, st.st_size + sizeof(entry)) !=
+                                        (ssize_t)positions_size) ? -1 : 0;
+    if (status == 0) {
+        header.next_seq++;
+        if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+            status = -1;
+    }
+    if (status == -1)
+        perror("write change log");
+    close(fd);
+    return status;
+}
+
+static void record_file_stat(const char *hunt_id, struct stat *st) {
+    char record_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1 ||
+        stat(record_path, st) == -1)
+        memset(st, 0, sizeof(*st));
+}
+
+static void key_set_stamp(KeySet *set, uint64_t ino, uint64_t records, const HuntSlot *slot) {
+    set->header->source_ino = ino;
+    set->header->records = records;
+    set->header->generation = slot ? slot->generation : 0;
+}
+
+static int key_set_current(const KeySet *set, uint64_t ino, uint64_t records, const HuntSlot *slot) {
+    const KeySetHeader *h = set->header;
+    return h->records == records && (slot ? h->generation == slot->generation : h->source_ino == ino);
+}
+
+#define CLUE_LOG_MIN 1024
+
+static int compare_clue_pairs(const void *a, const void *b) {
+    const CluePair *x = a, *y = b;
+    if (x->token != y->token)
+        return x->token < y->token ? -1 : 1;
+    return (x->treasure_id > y->treasure_id) - (x->treasure_id < y->treasure_id);
+}
+
+static int clue_pairs_add(CluePair **pairs, size_t *count, size_t *capacity, const Treasure *t) {
+    uint64_t tokens[CLUE_MAX_TOKENS];
+    size_t n = clue_tokenize(t->clue, CLUE_LEN, tokens, CLUE_MAX_TOKENS);
+    if (*count + n > *capacity) {
+        size_t bigger = *capacity ? *capacity * 2 : 4096;
+        while (bigger < *count + n)
+            bigger *= 2;
+        CluePair *grown = realloc(*pairs, bigger * sizeof(CluePair));
+        if (!grown)
+            return -1;
+        *pairs = grown;
+        *capacity = bigger;
+    }
+    for (size_t i = 0; i < n; i++) {
+        (*pairs)[*count].token = tokens[i];
+        (*pairs)[(*count)++].treasure_id = t->treasure_id;
+    }
+    return 0;
+}
+
+/* Writes a clue index holding pairs (sorted here) through a temporary file
+   and a rename, so readers never see a partial table. */
+static int clue_index_write(const char *path, CluePair *pairs, size_t count, const ClueIndexHeader *stamp) {
+    qsort(pairs, count, sizeof(CluePair), compare_clue_pairs);
+
+    ClueIndexHeader header = *stamp;
+    memcpy(header.magic, CLUE_INDEX_MAGIC, 4);
+    header.token_count = 0;
+    header.posting_count = 0;
+    header.log_count = 0;
+    ClueToken *tokens = malloc((count + 1) * sizeof(ClueToken));
+    int32_t *ids = malloc((count + 1) * sizeof(int32_t));
+    if (!tokens || !ids) {
+        free(tokens);
+        free(ids);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && pairs[i].token == pairs[i - 1].token && pairs[i].treasure_id == pairs[i - 1].treasure_id)
+            continue;
+        if (header.token_count == 0 || tokens[header.token_count - 1].token != pairs[i].token) {
+            ClueToken *tok = &tokens[header.token_count++];
+            tok->token = pairs[i].token;
+            tok->first = header.posting_count;
+            tok->count = 0;
+            tok->reserved = 0;
+        }
+        tokens[header.token_count - 1].count++;
+        ids[header.posting_count++] = pairs[i].treasure_id;
+    }
+
+    char temp_path[PATH_MAX];
+    int fd = path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1 ? -1 :
+             open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = fd == -1 ||
+                 write_full(fd, &header, sizeof(header)) == -1 ||
+                 write_full(fd, tokens, header.token_count * sizeof(ClueToken)) == -1 ||
+                 write_full(fd, ids, header.posting_count * sizeof(int32_t)) == -1 ? -1 : 0;
+    if (fd != -1)
+        close(fd);
+    if (status == 0 && rename(temp_path, path) == -1)
+        status = -1;
+    if (status == -1)
+        unlink(temp_path);
+    free(tokens);
+    free(ids);
+    return status;
+}
+
+/* Adds the tokens of a just appended record to the clue index log. Returns
+   1 when the log has grown enough that the index should be rebuilt, 0
+   otherwise; an index that did not cover the previous records is left
+   alone for the next load to rebuild. */
+static int clue_index_append(const char *hunt_id, const HuntSlot *slot, const Treasure *t, uint64_t records) {
+    char path[PATH_MAX];
+    int fd = clue_index_path(path, sizeof(path), hunt_id, slot != NULL) == -1 ? -1 : open(path, O_RDWR);
+    if (fd == -1)
+        return 0;
+
+    ClueIndexHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, CLUE_INDEX_MAGIC, 4) != 0 || header.records + 1 != records) {
+        close(fd);
+        return 0;
+    }
+
+    uint64_t tokens[CLUE_MAX_TOKENS];
+    CluePair pairs[CLUE_MAX_TOKENS];
+    size_t n = clue_tokenize(t->clue, CLUE_LEN, tokens, CLUE_MAX_TOKENS);
+    for (size_t i = 0; i < n; i++) {
+        pairs[i].token = tokens[i];
+        pairs[i].treasure_id = t->treasure_id;
+    }
+    off_t end = sizeof(header) + header.token_count * sizeof(ClueToken) +
+                header.posting_count * sizeof(int32_t) + header.log_count * sizeof(CluePair);
+    if (pwrite(fd, pairs, n * sizeof(CluePair), end) != (ssize_t)(n * sizeof(CluePair))) {
+        close(fd);
+        return 0;
+    }
+    header.log_count += n;
+    header.records = records;
+    pwrite(fd, &header, sizeof(header), 0);
+    close(fd);
+    return header.log_count > CLUE_LOG_MIN && header.log_count * 4 > header.posting_count;
+}
+
+/* Writes a directory hunt's block checksums through a temporary file and
+   a rename. */
+static int checksum_write(const char *hunt_id, uint64_t ino, uint64_t records, const uint32_t *crcs) {
+    char path[PATH_MAX], temp_path[PATH_MAX];
+    if (checksum_path(path, sizeof(path), hunt_id) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1)
+        return -1;
+
+    ChecksumHeader header = { .magic = CHECKSUM_MAGIC, .block_records = CHECKSUM_BLOCK_RECORDS,
+                              .source_ino = ino, .records = records };
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = fd == -1 ||
+                 write_full(fd, &header, sizeof(header)) == -1 ||
+                 write_full(fd, crcs, checksum_blocks(records) * sizeof(uint32_t)) == -1 ? -1 : 0;
+    if (fd != -1)
+        close(fd);
+    if (status == 0 && rename(temp_path, path) == -1)
+        status = -1;
+    if (status == -1)
+        unlink(temp_path);
+    return status;
+}
+
+/* Extends the checksums after add appended t as record number records.
+   Returns 1 when they do not describe the records before it, so the
+   caller rebuilds them. */
+static int checksum_append(const char *hunt_id, const Treasure *t, uint64_t ino, uint64_t records) {
+    char path[PATH_MAX];
+    int fd = checksum_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDWR);
+    if (fd == -1)
+        return 1;
+
+    ChecksumHeader header;
+    uint64_t position = records - 1;
+    off_t slot = sizeof(header) + (position / CHECKSUM_BLOCK_RECORDS) * sizeof(uint32_t);
+    uint32_t crc = 0;
+    int stale = pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                memcmp(header.magic, CHECKSUM_MAGIC, 4) != 0 || header.source_ino != ino ||
+                header.records != position ||
+                (position % CHECKSUM_BLOCK_RECORDS && pread(fd, &crc, sizeof(crc), slot) != sizeof(crc));
+    if (!stale) {
+        crc = crc32c(crc, t, sizeof(*t));
+        header.records = records;
+        stale = pwrite(fd, &crc, sizeof(crc), slot) != sizeof(crc) ||
+                pwrite(fd, &header, sizeof(header), 0) != sizeof(header);
+    }
+    close(fd);
+    return stale;
+}
+
+typedef struct {
+    int32_t id;
+    int64_t added;
+} IdTime;
+
+static int compare_id_times(const void *a, const void *b) {
+    const IdTime *x = a, *y = b;
+    if (x->id != y->id)
+        return x->id < y->id ? -1 : 1;
+    return x->added < y->added ? -1 : x->added > y->added;
+}
+
+/* Time of id in pairs sorted by compare_id_times (the latest when an ID was
+   added more than once), or 0. */
+static int64_t id_time_find(const IdTime *pairs, size_t count, int32_t id) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pairs[mid].id <= id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 && pairs[lo - 1].id == id ? pairs[lo - 1].added : 0;
+}
+
+static int id_times_add(IdTime **pairs, size_t *count, size_t *capacity, int32_t id, int64_t added) {
+    if (*count == *capacity) {
+        size_t bigger = *capacity ? *capacity * 2 : 256;
+        IdTime *grown = realloc(*pairs, bigger * sizeof(IdTime));
+        if (!grown)
+            return -1;
+        *pairs = grown;
+        *capacity = bigger;
+    }
+    (*pairs)[(*count)++] = (IdTime){ id, added };
+    return 0;
+}
+
+/* Collects the times of the "Added treasure ID" entries of a hunt's log,
+   each of which follows the ctime() line log_operation wrote for it. */
+static int log_added_times(const char *hunt_id, IdTime **pairs, size_t *count, size_t *capacity) {
+    static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, LOG_FILE) == -1)
+        return -1;
+    FILE *log = fopen(path, "r");
+    if (!log)
+        return errno == ENOENT ? 0 : -1;
+
+    char line[512];
+    int64_t last = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), log)) {
+        char weekday[4], month[4];
+        struct tm tm;
+        int32_t id;
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(line, "%3s %3s %d %d:%d:%d %d", weekday, month, &tm.tm_mday,
+                   &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &tm.tm_year) == 7) {
+            tm.tm_mon = -1;
+            for (int m = 0; m < 12; m++) {
+                if (strcmp(month, months[m]) == 0)
+                    tm.tm_mon = m;
+            }
+            tm.tm_year -= 1900;
+            tm.tm_isdst = -1;
+            time_t t = tm.tm_mon == -1 ? (time_t)-1 : mktime(&tm);
+            last = t == (time_t)-1 ? 0 : t;
+        } else if (sscanf(line, ": Added treasure ID %d", &id) == 1 && last != 0) {
+            status = id_times_add(pairs, count, capacity, id, last);
+        }
+    }
+    fclose(log);
+    return status;
+}
+
+/* Writes a directory hunt's times through a temporary file and a rename. */
+static int times_write(const char *hunt_id, uint64_t ino, uint64_t records,
+                       const int32_t *ids, const int64_t *added) {
+    char path[PATH_MAX], temp_path[PATH_MAX];
+    if (times_path(path, sizeof(path), hunt_id) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1)
+        return -1;
+
+    TimesHeader header = { .magic = TIMES_MAGIC, .block_records = TIME_BLOCK_RECORDS,
+                           .source_ino = ino, .records = records };
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = fd == -1 || write_full(fd, &header, sizeof(header)) == -1 ? -1 : 0;
+    static TimeBlock block;
+    for (uint64_t first = 0; status == 0 && first < records; first += TIME_BLOCK_RECORDS) {
+        time_block_init(&block);
+        for (unsigned i = 0; i < TIME_BLOCK_RECORDS && first + i < records; i++)
+            time_block_set(&block, i, ids[first + i], added[first + i]);
+        status = write_full(fd, &block, sizeof(block));
+    }
+    if (fd != -1)
+        close(fd);
+    if (status == 0 && rename(temp_path, path) == -1)
+        status = -1;
+    if (status == -1)
+        unlink(temp_path);
+    return status;
+}
+
+/* Brings a directory hunt's times in line with its records (ids, in file
+   order). A file written for other records still knows when each of its
+   treasure IDs was added, so the times carry over by ID; IDs it lacks
+   take the time of their entry in the log. */
+static int times_rebuild(const char *hunt_id, uint64_t ino, const int32_t *ids, uint64_t records) {
+    char path[PATH_MAX];
+    if (times_path(path, sizeof(path), hunt_id) == -1)
+        return -1;
+    int fd = open(path, O_RDONLY);
+    TimesHeader header;
+    int valid = fd != -1 && read(fd, &header, sizeof(header)) == sizeof(header) &&
+                memcmp(header.magic, TIMES_MAGIC, 4) == 0 && header.block_records == TIME_BLOCK_RECORDS;
+    if (valid && header.source_ino == ino && header.records == records) {
+        close(fd);
+        return 0;
+    }
+
+    IdTime *known = NULL, *logged = NULL;
+    size_t known_count = 0, known_capacity = 0, logged_count = 0, logged_capacity = 0;
+    static TimeBlock block;
+    int status = 0;
+    for (uint64_t first = 0; valid && status == 0 && first < header.records; first += TIME_BLOCK_RECORDS) {
+        if (read_full(fd, &block, sizeof(block)) != 1)
+            break;
+        for (unsigned i = 0; i < TIME_BLOCK_RECORDS && first + i < header.records && status == 0; i++) {
+            if (block.added[i] != 0)
+                status = id_times_add(&known, &known_count, &known_capacity, block.ids[i], block.added[i]);
+        }
+    }
+    if (fd != -1)
+        close(fd);
+    qsort(known, known_count, sizeof(IdTime), compare_id_times);
+
+    int64_t *added = malloc((records ? records : 1) * sizeof(int64_t));
+    int logged_loaded = 0;
+    if (!added)
+        status = -1;
+    for (uint64_t i = 0; status == 0 && i < records; i++) {
+        added[i] = id_time_find(known, known_count, ids[i]);
+        if (added[i] == 0 && !logged_loaded) {
+            logged_loaded = 1;
+            status = log_added_times(hunt_id, &logged, &logged_count, &logged_capacity);
+            qsort(logged, logged_count, sizeof(IdTime), compare_id_times);
+        }
+        if (added[i] == 0)
+            added[i] = id_time_find(logged, logged_count, ids[i]);
+    }
+    if (status == 0)
+        status = times_write(hunt_id, ino, records, ids, added);
+    free(known);
+    free(logged);
+    free(added);
+    return status;
+}
+
+/* Records the time add appended t as record number records (or stamps it
+   again once a rebuild has already counted it). Returns 1 when the times
+   do not describe the records before it, so the caller rebuilds them. */
+static int times_append(const char *hunt_id, const Treasure *t, uint64_t ino, uint64_t records, int64_t added) {
+    char path[PATH_MAX];
+    int fd = times_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDWR);
+    if (fd == -1)
+        return 1;
+
+    TimesHeader header;
+    TimeBlock block;
+    uint64_t position = records - 1;
+    off_t offset = sizeof(header) + (position / TIME_BLOCK_RECORDS) * sizeof(TimeBlock);
+    int stale = pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                memcmp(header.magic, TIMES_MAGIC, 4) != 0 || header.source_ino != ino ||
+                (header.records != position && header.records != records);
+    if (!stale && position % TIME_BLOCK_RECORDS == 0 && header.records == position)
+        time_block_init(&block);
+    else if (!stale)
+        stale = pread(fd, &block, sizeof(block), offset) != sizeof(block);
+    if (!stale) {
+        time_block_set(&block, position % TIME_BLOCK_RECORDS, t->treasure_id, added);
+        header.records = records;
+        stale = pwrite(fd, &block, sizeof(block), offset) != sizeof(block) ||
+                pwrite(fd, &header, sizeof(header), 0) != sizeof(header);
+    }
+    close(fd);
+    return stale;
+}
+
+/* Writes a directory hunt's sketches through a temporary file and a rename. */
+static int sketch_write(const char *hunt_id, uint64_t ino, const HuntSketch *sk) {
+    char path[PATH_MAX], temp_path[PATH_MAX];
+    if (sketch_path(path, sizeof(path), hunt_id) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1)
+        return -1;
+
+    SketchHeader header = { .magic = SKETCH_MAGIC, .top_k = SKETCH_TOP_K,
+                            .source_ino = ino, .records = sk->records };
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = fd == -1 || write_full(fd, &header, sizeof(header)) == -1 ||
+                 write_full(fd, sk, sizeof(*sk)) == -1 ? -1 : 0;
+    if (fd != -1)
+        close(fd);
+    if (status == 0 && rename(temp_path, path) == -1)
+        status = -1;
+    if (status == -1)
+        unlink(temp_path);
+    return status;
+}
+
+/* Folds the record add appended as number records into the sketches.
+   Returns 1 when they do not describe the records before it, so the
+   caller rebuilds them. */
+static int sketch_append(const char *hunt_id, const Treasure *t, uint64_t ino, uint64_t records) {
+    char path[PATH_MAX];
+    int fd = sketch_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDWR);
+    if (fd == -1)
+        return 1;
+
+    SketchHeader header;
+    static HuntSketch sk;
+    int stale = pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                memcmp(header.magic, SKETCH_MAGIC, 4) != 0 || header.top_k != SKETCH_TOP_K ||
+                header.source_ino != ino || header.records != records - 1 ||
+                pread(fd, &sk, sizeof(sk), sizeof(header)) != sizeof(sk);
+    if (!stale) {
+        sketch_add(&sk, t);
+        header.records = records;
+        /* Header last: an interrupted update leaves the sketches stale. */
+        stale = pwrite(fd, &sk, sizeof(sk), sizeof(header)) != sizeof(sk) ||
+                pwrite(fd, &header, sizeof(header), 0) != sizeof(header);
+    }
+    close(fd);
+    return stale;
+}
+
+/* Rebuilds a hunt's sidecars from its records (slot is the hunt's table
+   entry for sharded hunts, NULL for directory hunts). Returns the number
+   of records whose ID was already taken, or -1. */
+static long hunt_indexes_build(const char *hunt_id, const HuntSlot *slot, HuntIndexes *hi) {
+    memset(hi, 0, sizeof(*hi));
+    if (key_set_init(&hi->ids, KEY_SET_MIN_CAPACITY) == -1 ||
+        key_set_init(&hi->users, KEY_SET_MIN_CAPACITY) == -1) {
+        perror("calloc");
+        hunt_indexes_free(hi);
+        return -1;
+    }
+
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if (!slot)
+        record_file_stat(hunt_id, &st);
+
+    RecordStream rs;
+    CluePair *pairs = NULL;
+    size_t pair_count = 0, pair_capacity = 0;
+    uint32_t *crcs = NULL;
+    size_t crc_capacity = 0;
+    int32_t *ids = NULL;
+    size_t id_capacity = 0;
+    static HuntSketch sketch;
+    sketch_init(&sketch);
+    long duplicates = 0;
+    int result = 0;
+    if (record_stream_open(&rs, hunt_id) == 0) {
+        Treasure t;
+        uint64_t position = 0;
+        while ((result = record_stream_next(&rs, &t)) == 1) {
+            int new_id = key_set_insert(&hi->ids, treasure_key(t.treasure_id));
+            int new_user = key_set_insert(&hi->users, user_key(t.username));
+            if (new_id == -1 || new_user == -1 ||
+                clue_pairs_add(&pairs, &pair_count, &pair_capacity, &t) == -1) {
+                result = -1;
+                break;
+            }
+            if (!slot) {
+                uint64_t index = position++;
+                if (index == id_capacity) {
+                    id_capacity = id_capacity ? id_capacity * 2 : 1024;
+                    int32_t *grown = realloc(ids, id_capacity * sizeof(int32_t));
+                    if (!grown) {
+                        result = -1;
+                        break;
+                    }
+                    ids = grown;
+                }
+                ids[index] = t.treasure_id;
+                size_t block = index / CHECKSUM_BLOCK_RECORDS;
+                if (block == crc_capacity) {
+                    crc_capacity = crc_capacity ? crc_capacity * 2 : 64;
+                    uint32_t *grown = realloc(crcs, crc_capacity * sizeof(uint32_t));
+                    if (!grown) {
+                        result = -1;
+                        break;
+                    }
+                    crcs = grown;
+                }
+                crcs[block] = crc32c(index % CHECKSUM_BLOCK_RECORDS ? crcs[block] : 0, &t, sizeof(t));
+                sketch_add(&sketch, &t);
+            }
+            if (new_id == 0)
+                duplicates++;
+            hunt_stats_add(&hi->meta.stats, &t, new_user);
+        }
+        record_stream_close(&rs);
+    } else if (errno != ENOENT) {
+        result = -1;
+    }
+    if (result == -1) {
+        perror("read treasures file");
+        free(pairs);
+        free(crcs);
+        free(ids);
+        hunt_indexes_free(hi);
+        return -1;
+    }
+
+    uint64_t records = hi->meta.stats.records;
+    key_set_stamp(&hi->ids, st.st_ino, records, slot);
+    key_set_stamp(&hi->users, st.st_ino, records, slot);
+    int paths_status = 0;
+    if (id_index_path(hi->ids.path, sizeof(hi->ids.path), hunt_id, slot != NULL) == -1 ||
+        path_format(hi->users.path, sizeof(hi->users.path), "%s/%s", hunt_id, USERS_FILE) == -1)
+        paths_status = -1;
+
+    char clue_path[PATH_MAX];
+    ClueIndexHeader clue_stamp;
+    memset(&clue_stamp, 0, sizeof(clue_stamp));
+    clue_stamp.source_ino = slot ? 0 : st.st_ino;
+    clue_stamp.records = records;
+    clue_stamp.generation = slot ? slot->generation : 0;
+    int clue_status = clue_index_path(clue_path, sizeof(clue_path), hunt_id, slot != NULL) == -1 ? -1 :
+                      clue_index_write(clue_path, pairs, pair_count, &clue_stamp);
+    free(pairs);
+    int checksum_status = slot ? 0 : checksum_write(hunt_id, st.st_ino, records, crcs);
+    free(crcs);
+    int times_status = slot ? 0 : times_rebuild(hunt_id, st.st_ino, ids, records);
+    free(ids);
+    int sketch_status = slot ? 0 : sketch_write(hunt_id, st.st_ino, &sketch);
+
+    if (paths_status == -1 || key_set_save(&hi->ids) == -1 || (!slot && key_set_save(&hi->users) == -1) ||
+        clue_status == -1 ||
+        checksum_status == -1 || times_status == -1 || sketch_status == -1) {
+        perror("write index file");
+        hunt_indexes_free(hi);
+        return -1;
+    }
+
+    if (!slot) {
+        /* A sorted layout written for this very file survives the rebuild. */
+        HuntMeta old;
+        uint64_t sorted_count = hunt_meta_read(hunt_id, &old, &st) == 0 ? old.sorted_count : 0;
+        memcpy(hi->meta.magic, META_MAGIC, 4);
+        hi->meta.version = META_VERSION;
+        hi->meta.source_ino = st.st_ino;
+        hi->meta.sorted_count = sorted_count;
+        if (hunt_meta_write(hunt_id, &hi->meta) == -1) {
+            hunt_indexes_free(hi);
+            return -1;
+        }
+    }
+    return duplicates;
+}
+
+/* Opens a hunt's sidecars, rebuilding them when they are missing or no
+   longer match the records. */
+static int hunt_indexes_load(const char *hunt_id, const HuntSlot *slot, HuntIndexes *hi) {
+    memset(hi, 0, sizeof(*hi));
+
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    uint64_t records;
+    if (slot) {
+        records = slot->record_count;
+    } else {
+        record_file_stat(hunt_id, &st);
+        records = st.st_size / sizeof(Treasure);
+    }
+
+    char path[PATH_MAX];
+    int current = id_index_path(path, sizeof(path), hunt_id, slot != NULL) == 0 &&
+                  key_set_open(&hi->ids, path) == 0 && key_set_current(&hi->ids, st.st_ino, records, slot);
+    if (current) {
+        ClueIndex ci;
+        current = clue_index_path(path, sizeof(path), hunt_id, slot != NULL) == 0 &&
+                  clue_index_open(&ci, path, st.st_ino, records, slot ? slot->generation : 0, slot != NULL) == 0;
+        if (current)
+            clue_index_close(&ci);
+    }
+    if (current && !slot) {
+        current = path_format(path, sizeof(path), "%s/%s", hunt_id, USERS_FILE) == 0 &&
+                  key_set_open(&hi->users, path) == 0 &&
+                  key_set_current(&hi->users, st.st_ino, records, NULL) &&
+                  hunt_meta_read(hunt_id, &hi->meta, &st) == 0 && hi->meta.stats.records == records;
+    }
+    if (current && !slot) {
+        ChecksumHeader header;
+        uint32_t *crcs = checksum_load(hunt_id, st.st_ino, &header);
+        current = crcs && header.records == records;
+        free(crcs);
+    }
+    if (current && !slot) {
+        TimesHeader header;
+        int fd = times_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDONLY);
+        current = fd != -1 && read(fd, &header, sizeof(header)) == sizeof(header) &&
+                  memcmp(header.magic, TIMES_MAGIC, 4) == 0 && header.source_ino == (uint64_t)st.st_ino &&
+                  header.records == records;
+        if (fd != -1)
+            close(fd);
+    }
+    if (current && !slot) {
+        SketchHeader header;
+        int fd = sketch_path(path, sizeof(path), hunt_id) == -1 ? -1 : open(path, O_RDONLY);
+        current = fd != -1 && read(fd, &header, sizeof(header)) == sizeof(header) &&
+                  memcmp(header.magic, SKETCH_MAGIC, 4) == 0 && header.top_k == SKETCH_TOP_K &&
+                  header.source_ino == (uint64_t)st.st_ino && header.records == records;
+        if (fd != -1)
+            close(fd);
+    }
+    if (current)
+        return 0;
+
+    hunt_indexes_free(hi);
+    return hunt_indexes_build(hunt_id, slot, hi) == -1 ? -1 : 0;
+}
+
+/* In daemon mode each worker keeps the indexes of the directory hunts it
+   last added to, still mapped. An entry is reused only while the record
+   file and both key set files are the very ones it was saved against, so
+   any change by another worker or process sends add back through
+   hunt_indexes_load. */
+#define INDEX_CACHE_SIZE 16
+
+typedef struct {
+    char hunt_id[256];
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    ino_t ids_ino, users_ino;
+    HuntIndexes hi;
+    int used;
+} CachedIndexes;
+
+static CachedIndexes index_cache[INDEX_CACHE_SIZE];
+static int index_cache_next;
+static int index_cache_enabled;
+
+static int index_cache_stamp(const char *hunt_id, const HuntIndexes *hi, CachedIndexes *c) {
+    char path[PATH_MAX];
+    struct stat st, ids_st, users_st;
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 || stat(path, &st) == -1 ||
+        stat(hi->ids.path, &ids_st) == -1 || stat(hi->users.path, &users_st) == -1)
+        return -1;
+    c->dev = st.st_dev;
+    c->ino = st.st_ino;
+    c->size = st.st_size;
+    c->mtime = st.st_mtim;
+    c->ids_ino = ids_st.st_ino;
+    c->users_ino = users_st.st_ino;
+    return 0;
+}
+
+/* Loads a directory hunt's indexes, from the worker's cache when they are
+   still current. */
+static int hunt_indexes_take(const char *hunt_id, HuntIndexes *hi) {
+    for (int i = 0; index_cache_enabled && i < INDEX_CACHE_SIZE; i++) {
+        CachedIndexes *c = &index_cache[i];
+        if (!c->used || strcmp(c->hunt_id, hunt_id) != 0)
+            continue;
+        CachedIndexes now;
+        int current = index_cache_stamp(hunt_id, &c->hi, &now) == 0 && now.dev == c->dev &&
+                      now.ino == c->ino && now.size == c->size && now.mtime.tv_sec == c->mtime.tv_sec &&
+                      now.mtime.tv_nsec == c->mtime.tv_nsec && now.ids_ino == c->ids_ino &&
+                      now.users_ino == c->users_ino;
+        c->used = 0;
+        if (current) {
+            *hi = c->hi;
+            return 0;
+        }
+        hunt_indexes_free(&c->hi);
+        break;
+    }
+    return hunt_indexes_load(hunt_id, NULL, hi);
+}
+
+/* Hands indexes back after a successful add: cached in daemon mode, freed
+   otherwise. Called with the hunt still locked. */
+static void hunt_indexes_keep(const char *hunt_id, HuntIndexes *hi) {
+    if (!index_cache_enabled || !hi->ids.mapped || !hi->users.mapped || strlen(hunt_id) >= 256) {
+        hunt_indexes_free(hi);
+        return;
+    }
+    CachedIndexes *c = &index_cache[index_cache_next];
+    index_cache_next = (index_cache_next + 1) % INDEX_CACHE_SIZE;
+    if (c->used)
+        hunt_indexes_free(&c->hi);
+    c->used = 0;
+    if (index_cache_stamp(hunt_id, hi, c) == -1) {
+        hunt_indexes_free(hi);
+        return;
+    }
+    snprintf(c->hunt_id, sizeof(c->hunt_id), "%s", hunt_id);
+    c->hi = *hi;
+    c->used = 1;
+}
+
+#define USER_INDEX_BATCH 128
+#define USER_INDEX_LOCK USER_INDEX_DIR "/lock"
+
+/* New entries for a hunt's records, one list per bucket. */
+typedef struct {
+    UserIndexEntry *entries;
+    size_t count;
+    size_t capacity;
+} UserIndexList;
+
+typedef int (*UserEntryFilter)(const UserIndexEntry *e, void *arg);
+
+/* Serializes writers of the buckets, so that an add appending an entry
+   is not lost to a bucket rewrite renamed over it. */
+static int user_index_lock(void) {
+    if (mkdir(USER_INDEX_DIR, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir user index");
+        return -1;
+    }
+    int fd = open(USER_INDEX_LOCK, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || flock(fd, LOCK_EX) == -1) {
+        perror("lock user index");
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int user_index_append(uint32_t bucket, const UserIndexEntry *entries, size_t count) {
+    char path[PATH_MAX];
+    int fd = user_index_path(path, sizeof(path), bucket) == -1 ? -1 :
+             open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        perror("open user index");
+        return -1;
+    }
+    int status = write_full(fd, entries, count * sizeof(UserIndexEntry));
+    if (status == -1)
+        perror("write user index");
+    close(fd);
+    return status;
+}
+
+/* Copies a bucket without the entries drop matches and with the entries
+   of list after them, through a temporary file and a rename so readers
+   see either the old or the new bucket. Buckets that lose and gain
+   nothing are left alone. */
+static int user_index_rewrite(uint32_t bucket, const UserIndexList *list, UserEntryFilter drop, void *arg) {
+    char path[PATH_MAX], temp_path[PATH_MAX];
+    if (user_index_path(path, sizeof(path), bucket) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1) {
+        perror("user index path");
+        return -1;
+    }
+    int in_fd = open(path, O_RDONLY);
+    if (in_fd == -1 && errno != ENOENT) {
+        perror("open user index");
+        return -1;
+    }
+    if (in_fd == -1 && list->count == 0)
+        return 0;
+    int out_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror("create user index");
+        if (in_fd != -1)
+            close(in_fd);
+        return -1;
+    }
+
+    UserIndexEntry chunk[USER_INDEX_BATCH];
+    size_t dropped = 0;
+    int status = 0;
+    ssize_t n = 0;
+    while (in_fd != -1 && status == 0 && (n = read(in_fd, chunk, sizeof(chunk))) > 0) {
+        size_t kept = 0;
+        for (size_t i = 0; i < n / sizeof(UserIndexEntry); i++) {
+            if (drop(&chunk[i], arg))
+                dropped++;
+            else
+                chunk[kept++] = chunk[i];
+        }
+        status = write_full(out_fd, chunk, kept * sizeof(UserIndexEntry));
+    }
+    if (n == -1 ||
+        (status == 0 && write_full(out_fd, list->entries, list->count * sizeof(UserIndexEntry)) == -1))
+        status = -1;
+    if (in_fd != -1)
+        close(in_fd);
+    close(out_fd);
+
+    if (status == 0 && (dropped > 0 || list->count > 0)) {
+        if (rename(temp_path, path) == 0)
+            return 0;
+        status = -1;
+    }
+    if (status == -1)
+        perror("write user index");
+    unlink(temp_path);
+    return status;
+}
+
+/* Brings the buckets up to date with lists: with drop set the entries it
+   matches are replaced by those in lists, otherwise lists are appended. */
+static int user_index_write(const UserIndexList *lists, UserEntryFilter drop, void *arg) {
+    int lock_fd = user_index_lock();
+    if (lock_fd == -1)
+        return -1;
+    int status = 0;
+    for (uint32_t b = 0; b < USER_INDEX_BUCKETS && status == 0; b++) {
+        if (drop)
+            status = user_index_rewrite(b, &lists[b], drop, arg);
+        else if (lists[b].count > 0)
+            status = user_index_append(b, lists[b].entries, lists[b].count);
+    }
+    close(lock_fd);
+    return status;
+}
+
+static void user_index_lists_free(UserIndexList *lists) {
+    for (uint32_t b = 0; lists && b < USER_INDEX_BUCKETS; b++)
+        free(lists[b].entries);
+    free(lists);
+}
+
+static void user_entry_fill(UserIndexEntry *e, const char *hunt_id, const Treasure *t,
+                            uint64_t source, uint64_t position, uint32_t flags) {
+    memset(e, 0, sizeof(*e));
+    memcpy(e->username, t->username, USERNAME_LEN);
+    strncpy(e->hunt_id, hunt_id, HUNT_ID_LEN - 1);
+    e->source = source;
+    e->position = position;
+    e->treasure_id = t->treasure_id;
+    e->flags = flags;
+}
+
+/* Indexes one newly appended record. */
+static void user_index_add(const char *hunt_id, const Treasure *t, uint64_t source,
+                           uint64_t position, uint32_t flags) {
+    if (strlen(hunt_id) >= HUNT_ID_LEN)
+        return;
+    UserIndexEntry e;
+    user_entry_fill(&e, hunt_id, t, source, position, flags);
+    int lock_fd = user_index_lock();
+    if (lock_fd == -1 || user_index_append(user_index_bucket(t->username), &e, 1) == -1)
+        fprintf(stderr, "Warning: user index not updated; run reindex_users\n");
+    if (lock_fd != -1)
+        close(lock_fd);
+}
+
+static int user_index_put(UserIndexList *lists, const char *hunt_id, const Treasure *t,
+                          uint64_t source, uint64_t position, uint32_t flags) {
+    UserIndexList *list = &lists[user_index_bucket(t->username)];
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        UserIndexEntry *grown = realloc(list->entries, capacity * sizeof(UserIndexEntry));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    user_entry_fill(&list->entries[list->count++], hunt_id, t, source, position, flags);
+    return 0;
+}
+
+/* Adds entries for every current record of a hunt to lists. Hunt ids too
+   long for an entry are not indexed. */
+static int user_index_collect(UserIndexList *lists, const char *hunt_id) {
+    if (strlen(hunt_id) >= HUNT_ID_LEN)
+        return 0;
+
+    char path[PATH_MAX];
+    int status = 0;
+    if (hunt_is_sharded(hunt_id)) {
+        ShardTableHeader header;
+        HuntSlot slot = {0};
+        int table_fd = shard_table_open(O_RDONLY, &header);
+        long index = table_fd == -1 ? -1 : shard_find(table_fd, &header, hunt_id, &slot, NULL);
+        if (table_fd != -1)
+            close(table_fd);
+        int fd = -1;
+        if (index != -1 && shard_path(path, sizeof(path), &header, hunt_id) == 0)
+            fd = open(path, O_RDONLY);
+
+        ShardRecord chunk[SHARD_READ_RECORDS];
+        uint64_t position = 0;
+        ssize_t n;
+        while (fd != -1 && status == 0 && (n = read(fd, chunk, sizeof(chunk))) > 0) {
+            for (size_t i = 0; i < n / sizeof(ShardRecord); i++, position++) {
+                const ShardRecord *r = &chunk[i];
+                if ((long)r->slot != index || r->generation != slot.generation ||
+                    (r->flags & SHARD_RECORD_REMOVED))
+                    continue;
+                if (user_index_put(lists, hunt_id, &r->treasure, slot.generation,
+                                   position, USER_ENTRY_SHARDED) == -1)
+                    status = -1;
+            }
+        }
+        if (fd != -1)
+            close(fd);
+    } else {
+        int fd = path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+                 open(path, O_RDONLY);
+        struct stat st;
+        if (fd != -1 && fstat(fd, &st) == 0) {
+            Treasure chunk[256];
+            uint64_t position = 0;
+            ssize_t n;
+            while (status == 0 && (n = read(fd, chunk, sizeof(chunk))) > 0) {
+                for (size_t i = 0; i < n / sizeof(Treasure); i++, position++) {
+                    if (user_index_put(lists, hunt_id, &chunk[i], st.st_ino, position, 0) == -1)
+                        status = -1;
+                }
+            }
+        }
+        if (fd != -1)
+            close(fd);
+    }
+    return status;
+}
+
+static int user_entry_of_hunt(const UserIndexEntry *e, void *arg) {
+    return strncmp(e->hunt_id, arg, HUNT_ID_LEN) == 0;
+}
+
+static int user_entry_sharded(const UserIndexEntry *e, void *arg) {
+    (void)arg;
+    return (e->flags & USER_ENTRY_SHARDED) != 0;
+}
+
+/* Replaces a hunt's user index entries with entries for its current
+   records, e.g. after a rewrite moved them or the hunt was removed. */
+static int user_index_emit_hunt(const char *hunt_id) {
+    if (strlen(hunt_id) >= HUNT_ID_LEN)
+        return 0;
+    UserIndexList *lists = calloc(USER_INDEX_BUCKETS, sizeof(UserIndexList));
+    if (!lists) {
+        perror("malloc");
+        return -1;
+    }
+    int status = user_index_collect(lists, hunt_id);
+    if (status == 0)
+        status = user_index_write(lists, user_entry_of_hunt, (void *)hunt_id);
+    user_index_lists_free(lists);
+    return status;
+}
+
+int shard_add_treasure(const char *hunt_id, const Treasure *treasure) {
+    if (strlen(hunt_id) >= HUNT_ID_LEN) {
+        fprintf(stderr, "Hunt id '%s' is too long for sharded storage\n", hunt_id);
+        return -1;
+    }
+
+    ShardTableHeader header;
+    int table_fd = shard_table_lock(&header);
+    if (table_fd == -1)
+        return -1;
+
+    HuntSlot slot;
+    long free_slot;
+    long index = shard_find(table_fd, &header, hunt_id, &slot, &free_slot);
+    if (index == -1) {
+        if (free_slot == -1) {
+            fprintf(stderr, "Shard table is full\n");
+            close(table_fd);
+            return -1;
+        }
+        index = free_slot;
+        if (pread(table_fd, &slot, sizeof(slot), shard_slot_offset(index)) != sizeof(slot)) {
+            perror("read shard table");
+            close(table_fd);
+            return -1;
+        }
+        uint32_t generation = slot.generation + 1;
+        memset(&slot, 0, sizeof(slot));
+        strncpy(slot.hunt_id, hunt_id, HUNT_ID_LEN - 1);
+        slot.state = SLOT_LIVE;
+        slot.generation = generation;
+    }
+
+    HuntIndexes hi;
+    if (hunt_indexes_load(hunt_id, &slot, &hi) == -1) {
+        close(table_fd);
+        return -1;
+    }
+    if (key_set_contains(&hi.ids, treasure_key(treasure->treasure_id))) {
+        fprintf(stderr, "Treasure ID %d already exists in hunt '%s'.\n", treasure->treasure_id, hunt_id);
+        hunt_indexes_free(&hi);
+        close(table_fd);
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    int fd = shard_path(path, sizeof(path), &header, hunt_id) == -1 ? -1 :
+             open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        perror("open shard file");
+        hunt_indexes_free(&hi);
+        close(table_fd);
+        return -1;
+    }
+
+    ShardRecord record;
+    record.slot = index;
+    record.generation = slot.generation;
+    record.flags = 0;
+    record.treasure = *treasure;
+    struct stat st;
+    if (write(fd, &record, sizeof(record)) != sizeof(record) || fstat(fd, &st) == -1) {
+        perror("write treasure record");
+        close(fd);
+        hunt_indexes_free(&hi);
+        close(table_fd);
+        return -1;
+    }
+    close(fd);
+
+    slot.record_count++;
+    if (pwrite(table_fd, &slot, sizeof(slot), shard_slot_offset(index)) != sizeof(slot)) {
+        perror("write shard table");
+        hunt_indexes_free(&hi);
+        close(table_fd);
+        return -1;
+    }
+    key_set_insert(&hi.ids, treasure_key(treasure->treasure_id));
+    key_set_stamp(&hi.ids, 0, slot.record_count, &slot);
+    int rebuild = clue_index_append(hunt_id, &slot, treasure, slot.record_count);
+    user_index_add(hunt_id, treasure, slot.generation, st.st_size / sizeof(ShardRecord) - 1,
+                   USER_ENTRY_SHARDED);
+    hunt_indexes_free(&hi);
+    if (rebuild && hunt_indexes_build(hunt_id, &slot, &hi) != -1)
+        hunt_indexes_free(&hi);
+    close(table_fd);
+    return 0;
+}
+
+int add_treasure(const char *hunt_id) {
+    if (hunt_is_archived(hunt_id)) {
+        fprintf(stderr, "Hunt '%s' is archived. Restore it first.\n", hunt_id);
+        return -1;
+    }
+
+    Treasure treasure;
+    if (read_treasure(&treasure) == -1)
+        return -1;
+
+    if (hunt_is_sharded(hunt_id)) {
+        if (shard_add_treasure(hunt_id, &treasure) == -1)
+            return -1;
+    } else {
+        if (mkdir(hunt_id, 0755) == -1) {
+            if (errno != EEXIST) {
+                perror("mkdir");
+                return -1;
+            }
+        }
+
+        if (create_symlink_for_log(hunt_id) == -1) {
+            fprintf(stderr, "Warning: Failed to create symlink for logged_hunt\n");
+        }
+
+        /* The directory lock serialises the uniqueness check and the append. */
+        int dir_fd = lock_hunt_dir(hunt_id);
+        if (dir_fd == -1)
+            return -1;
+
+        HuntIndexes hi;
+        if (hunt_indexes_take(hunt_id, &hi) == -1) {
+            close(dir_fd);
+            return -1;
+        }
+        if (key_set_contains(&hi.ids, treasure_key(treasure.treasure_id))) {
+            fprintf(stderr, "Treasure ID %d already exists in hunt '%s'.\n", treasure.treasure_id, hunt_id);
+            hunt_indexes_free(&hi);
+            close(dir_fd);
+            return -1;
+        }
+
+        char record_path[PATH_MAX];
+        int fd = path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1 ? -1 :
+                 store_open(record_path, O_WRONLY | O_CREAT | O_APPEND);
+        if (fd == -1) {
+            perror("open treasures file");
+            hunt_indexes_free(&hi);
+            close(dir_fd);
+            return -1;
+        }
+
+        ssize_t written = write(fd, &treasure, sizeof(Treasure));
+        struct stat st;
+        if (written != sizeof(Treasure) || fstat(fd, &st) == -1) {
+            perror("write treasure record");
+            store_close(fd);
+            hunt_indexes_free(&hi);
+            close(dir_fd);
+            return -1;
+        }
+        store_close(fd);
+
+        uint64_t records = st.st_size / sizeof(Treasure);
+        key_set_insert(&hi.ids, treasure_key(treasure.treasure_id));
+        int new_user = key_set_insert(&hi.users, user_key(treasure.username)) == 1;
+        key_set_stamp(&hi.ids, st.st_ino, records, NULL);
+        key_set_stamp(&hi.users, st.st_ino, records, NULL);
+        hunt_stats_add(&hi.meta.stats, &treasure, new_user);
+        hi.meta.source_ino = st.st_ino;
+        hunt_meta_write(hunt_id, &hi.meta);
+        user_index_add(hunt_id, &treasure, st.st_ino, records - 1, 0);
+        change_log_append(hunt_id, CHANGE_APPEND, NULL, 1);
+        time_t added = time(NULL);
+        int rebuild = checksum_append(hunt_id, &treasure, st.st_ino, records);
+        rebuild |= times_append(hunt_id, &treasure, st.st_ino, records, added);
+        rebuild |= sketch_append(hunt_id, &treasure, st.st_ino, records);
+        rebuild |= clue_index_append(hunt_id, NULL, &treasure, records);
+        if (!rebuild) {
+            hunt_indexes_keep(hunt_id, &hi);
+        } else {
+            hunt_indexes_free(&hi);
+            /* The log line for this record is not written yet, so a rebuild
+               cannot recover its time; stamp it again afterwards. */
+            if (hunt_indexes_build(hunt_id, NULL, &hi) != -1) {
+                times_append(hunt_id, &treasure, st.st_ino, records, added);
+                hunt_indexes_keep(hunt_id, &hi);
+            }
+        }
+        close(dir_fd);
+    }
+
+    char log_details[256];
+    snprintf(log_details, sizeof(log_details), "Added treasure ID %d by user %s", 
+             treasure.treasure_id, treasure.username);
+    log_operation(hunt_id, log_details);
+
+    printf("Treasure added successfully.\n");
+    return 0;
+}
+
+int list_treasures(const char *hunt_id) {
+    RecordStream rs;
+    if (record_stream_open(&rs, hunt_id) == -1) {
+        perror("open treasures file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(rs.fd, &st) == -1) {
+        perror("stat");
+        record_stream_close(&rs);
+        return -1;
+    }
+
+    printf("Hunt: %s%s\n", hunt_id, rs.archived ? " (archived)" : "");
+    printf("Total file size: %ld bytes\n", (long)st.st_size);
+
+    printf("\nTreasure List:\n");
+    int count = 0;
+    while (1) {
+        Treasure treasure;
+        int result = record_stream_next(&rs, &treasure);
+
+        if (result == 0)
+            break;
+        if (result == -1) {
+            fprintf(stderr, "Incomplete record read. File may be corrupted.\n");
+            break;
+        }
+
+        count++;
+        printf("Treasure #%d:\n", count);
+        printf("  ID        : %d\n", treasure.treasure_id);
+        printf("  Username  : %s\n", treasure.username);
+        printf("  Latitude  : %.6f\n", treasure.latitude);
+        printf("  Longitude : %.6f\n", treasure.longitude);
+        printf("  Clue      : %s\n", treasure.clue);
+        printf("  Value     : %d\n", treasure.value);
+        printf("\n");
+    }
+    record_stream_close(&rs);
+
+    if (count == 0) {
+        printf("No treasures found in hunt '%s'.\n", hunt_id);
+    }
+    return 0;
+}
+
+static int print_timed_treasure(const Treasure *treasure, int64_t added, void *arg) {
+    char when[32];
+    printf("Treasure #%lu:\n", ++*(unsigned long *)arg);
+    printf("  ID        : %d\n", treasure->treasure_id);
+    printf("  Username  : %s\n", treasure->username);
+    printf("  Latitude  : %.6f\n", treasure->latitude);
+    printf("  Longitude : %.6f\n", treasure->longitude);
+    printf("  Clue      : %s\n", treasure->clue);
+    printf("  Value     : %d\n", treasure->value);
+    printf("  Added     : %s\n", format_time(added, when, sizeof(when)));
+    printf("\n");
+    return 0;
+}
+
+/* list with --since/--until: only the blocks of treasures.ts whose time
+   range overlaps the window are read. Times missing or left stale by an
+   older tool are rebuilt first. */
+static int list_treasures_window(const char *hunt_id, const TimeWindow *w) {
+    if (hunt_is_archived(hunt_id) || hunt_is_sharded(hunt_id)) {
+        fprintf(stderr, "Hunt '%s' keeps no insertion times; --since/--until need a directory hunt.\n", hunt_id);
+        return -1;
+    }
+
+    char since[32], until[32];
+    printf("Hunt: %s, added %s .. %s\n", hunt_id,
+           w->since > 1 ? format_time(w->since, since, sizeof(since)) : "(start)",
+           w->until < INT64_MAX ? format_time(w->until, until, sizeof(until)) : "(now)");
+    printf("\nTreasure List:\n");
+
+    unsigned long count = 0;
+    TimeScanStats stats;
+    int status = time_scan(hunt_id, w, print_timed_treasure, &count, &stats);
+    if (status == -1 && errno == ENODATA) {
+        int dir_fd = lock_hunt_dir(hunt_id);
+        if (dir_fd == -1)
+            return -1;
+        HuntIndexes hi;
+        if (hunt_indexes_load(hunt_id, NULL, &hi) == 0) {
+            hunt_indexes_free(&hi);
+            status = time_scan(hunt_id, w, print_timed_treasure, &count, &stats);
+        }
+        close(dir_fd);
+    }
+    if (status == -1) {
+        perror("Error reading treasure times");
+        return -1;
+    }
+
+    printf("%lu treasure(s) added in the window (read %llu of %llu blocks).\n", count,
+           (unsigned long long)stats.blocks_read, (unsigned long long)stats.blocks);
+    return 0;
+}
+
+static void print_treasure(const Treasure *treasure) {
+    printf("  ID        : %d\n", treasure->treasure_id);
+    printf("  Username  : %s\n", treasure->username);
+    printf("  Latitude  : %.6f\n", treasure->latitude);
+    printf("  Longitude : %.6f\n", treasure->longitude);
+    printf("  Clue      : %s\n", treasure->clue);
+    printf("  Value     : %d\n", treasure->value);
+}
+
+/* Opens a directory hunt's record file when its hunt.meta says it is
+   sorted; -1 otherwise. */
+static int open_sorted(const char *hunt_id, struct stat *st, HuntMeta *meta) {
+    char record_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1)
+        return -1;
+    int fd = open(record_path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, st) == -1 || hunt_meta_read(hunt_id, meta, st) == -1 || meta->sorted_count == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int view_treasure(const char *hunt_id, int target_id) {
+    Treasure treasure;
+    int found = 0;
+
+    struct stat st;
+    HuntMeta meta;
+    int fd = open_sorted(hunt_id, &st, &meta);
+    if (fd != -1) {
+        found = sorted_find(fd, &st, &meta, target_id, &treasure) == 1;
+        close(fd);
+    } else {
+        RecordStream rs;
+        if (record_stream_open(&rs, hunt_id) == -1) {
+            perror("Error opening treasures file");
+            return -1;
+        }
+        while (record_stream_next(&rs, &treasure) == 1) {
+            if (treasure.treasure_id == target_id) {
+                found = 1;
+                break;
+            }
+        }
+        record_stream_close(&rs);
+    }
+
+    if (found) {
+        printf("Treasure Details:\n");
+        print_treasure(&treasure);
+    }
+
+    if (!found) {
+        fprintf(stderr, "Treasure with ID %d not found in hunt '%s'.\n", target_id, hunt_id);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Lists the treasures with min_id <= treasure_id <= max_id. Sorted hunts
+   seek straight to min_id and stop after max_id (plus a tail scan); other
+   hunts are filtered in one pass. */
+int range_treasures(const char *hunt_id, int min_id, int max_id) {
+    Treasure t;
+    int count = 0;
+    struct stat st;
+    HuntMeta meta;
+    int fd = open_sorted(hunt_id, &st, &meta);
+
+    if (fd != -1) {
+        int64_t pos = sorted_lower_bound(fd, meta.sorted_count, min_id);
+        uint64_t total = st.st_size / sizeof(Treasure);
+        while (pos >= 0 && (uint64_t)pos < total &&
+               pread(fd, &t, sizeof(t), pos * sizeof(Treasure)) == sizeof(t)) {
+            if ((uint64_t)pos < meta.sorted_count && t.treasure_id > max_id)
+                pos = meta.sorted_count;
+            else
+                pos++;
+            if (t.treasure_id < min_id || t.treasure_id > max_id)
+                continue;
+            printf("Treasure #%d:\n", ++count);
+            print_treasure(&t);
+        }
+        close(fd);
+    } else {
+        RecordStream rs;
+        if (record_stream_open(&rs, hunt_id) == -1) {
+            perror("Error opening treasures file");
+            return -1;
+        }
+        while (record_stream_next(&rs, &t) == 1) {
+            if (t.treasure_id < min_id || t.treasure_id > max_id)
+                continue;
+            printf("Treasure #%d:\n", ++count);
+            print_treasure(&t);
+        }
+        record_stream_close(&rs);
+    }
+
+    if (count == 0)
+        printf("No treasures with IDs %d..%d in hunt '%s'.\n", min_id, max_id, hunt_id);
+    return 0;
+}
+
+/* A batch of changes applied by one pass over a hunt. Edits are sorted by
+   treasure_id; with remove set matching records are dropped, otherwise the
+   fields flagged in each edit are overwritten. */
+enum { EDIT_USERNAME = 1, EDIT_LATITUDE = 2, EDIT_LONGITUDE = 4, EDIT_CLUE = 8, EDIT_VALUE = 16 };
+
+typedef struct {
+    int treasure_id;
+    unsigned fields;
+    Treasure values;
+    int matched;
+    size_t order;           /* position in the request, for merging */
+} TreasureEdit;
+
+typedef struct {
+    TreasureEdit *edits;
+    size_t count;
+    size_t capacity;
+    int remove;
+    size_t applied;         /* records removed or updated */
+} EditSet;
+
+static int compare_edits(const void *a, const void *b) {
+    const TreasureEdit *x = a, *y = b;
+    return (x->treasure_id > y->treasure_id) - (x->treasure_id < y->treasure_id);
+}
+
+static int compare_edits_ordered(const void *a, const void *b) {
+    const TreasureEdit *x = a, *y = b;
+    int c = compare_edits(a, b);
+    return c ? c : (x->order > y->order) - (x->order < y->order);
+}
+
+/* Sorts the edits by treasure ID and folds edits of the same ID into one,
+   later assignments winning, so every ID is looked up exactly once. */
+static void edit_sort(EditSet *set) {
+    qsort(set->edits, set->count, sizeof(TreasureEdit), compare_edits_ordered);
+    size_t kept = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        TreasureEdit *e = &set->edits[i];
+        TreasureEdit *last = kept ? &set->edits[kept - 1] : NULL;
+        if (!last || last->treasure_id != e->treasure_id) {
+            set->edits[kept++] = *e;
+            continue;
+        }
+        if (e->fields & EDIT_USERNAME)
+            memcpy(last->values.username, e->values.username, USERNAME_LEN);
+        if (e->fields & EDIT_LATITUDE)
+            last->values.latitude = e->values.latitude;
+        if (e->fields & EDIT_LONGITUDE)
+            last->values.longitude = e->values.longitude;
+        if (e->fields & EDIT_CLUE)
+            memcpy(last->values.clue, e->values.clue, CLUE_LEN);
+        if (e->fields & EDIT_VALUE)
+            last->values.value = e->values.value;
+        last->fields |= e->fields;
+    }
+    set->count = kept;
+}
+
+static TreasureEdit *edit_add(EditSet *set, int treasure_id) {
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        TreasureEdit *grown = realloc(set->edits, capacity * sizeof(TreasureEdit));
+        if (!grown) {
+            perror("realloc");
+            return NULL;
+        }
+        set->edits = grown;
+        set->capacity = capacity;
+    }
+    TreasureEdit *e = &set->edits[set->count];
+    memset(e, 0, sizeof(*e));
+    e->treasure_id = treasure_id;
+    e->order = set->count++;
+    return e;
+}
+
+static TreasureEdit *edit_find(EditSet *set, int treasure_id) {
+    TreasureEdit key = { .treasure_id = treasure_id };
+    return bsearch(&key, set->edits, set->count, sizeof(TreasureEdit), compare_edits);
+}
+
+/* What a rewrite does with one record. */
+enum { RECORD_KEEP, RECORD_CHANGED, RECORD_DROP };
+typedef int (*RecordFilter)(Treasure *t, void *arg);
+
+static int edit_record(Treasure *t, void *arg) {
+    EditSet *set = arg;
+    TreasureEdit *e = edit_find(set, t->treasure_id);
+    if (!e)
+        return RECORD_KEEP;
+    e->matched = 1;
+    set->applied++;
+    if (set->remove)
+        return RECORD_DROP;
+
+    if (e->fields & EDIT_USERNAME)
+        memcpy(t->username, e->values.username, USERNAME_LEN);
+    if (e->fields & EDIT_LATITUDE)
+        t->latitude = e->values.latitude;
+    if (e->fields & EDIT_LONGITUDE)
+        t->longitude = e->values.longitude;
+    if (e->fields & EDIT_CLUE)
+        memcpy(t->clue, e->values.clue, CLUE_LEN);
+    if (e->fields & EDIT_VALUE)
+        t->value = e->values.value;
+    return RECORD_CHANGED;
+}
+
+/* Parses one "field=value" assignment of an update. */
+static int parse_assignment(TreasureEdit *e, const char *assignment) {
+    const char *value = strchr(assignment, '=');
+    if (!value) {
+        fprintf(stderr, "Expected field=value, got '%s'.\n", assignment);
+        return -1;
+    }
+    size_t key_len = value - assignment;
+    value++;
+
+    if (key_len == 8 && strncmp(assignment, "username", 8) == 0) {
+        snprintf(e->values.username, USERNAME_LEN, "%s", value);
+        e->fields |= EDIT_USERNAME;
+    } else if (key_len == 8 && strncmp(assignment, "latitude", 8) == 0) {
+        e->values.latitude = strtof(value, NULL);
+        e->fields |= EDIT_LATITUDE;
+    } else if (key_len == 9 && strncmp(assignment, "longitude", 9) == 0) {
+        e->values.longitude = strtof(value, NULL);
+        e->fields |= EDIT_LONGITUDE;
+    } else if (key_len == 4 && strncmp(assignment, "clue", 4) == 0) {
+        snprintf(e->values.clue, CLUE_LEN, "%s", value);
+        e->fields |= EDIT_CLUE;
+    } else if (key_len == 5 && strncmp(assignment, "value", 5) == 0) {
+        e->values.value = atoi(value);
+        e->fields |= EDIT_VALUE;
+    } else {
+        fprintf(stderr, "Unknown field '%.*s' (username, latitude, longitude, clue, value).\n",
+                (int)key_len, assignment);
+        return -1;
+    }
+    return 0;
+}
+
+/* Parses the treasure ID at the start of text. The ID must be followed by
+   the end of the string or by one of the characters in stop. */
+static int parse_treasure_id(const char *text, const char *stop, char **end, int *id) {
+    errno = 0;
+    long value = strtol(text, end, 10);
+    if (*end == text || (**end != '\0' && !strchr(stop, **end)) || errno == ERANGE ||
+        value < INT_MIN || value > INT_MAX) {
+        fprintf(stderr, "Invalid treasure ID '%.*s'.\n", (int)strcspn(text, stop), text);
+        return -1;
+    }
+    *id = (int)value;
+    return 0;
+}
+
+/* Reads "<id>[,<id>...]" or, with from_file set, the IDs in the file arg
+   names (separated by commas or whitespace). */
+static int parse_id_list(EditSet *set, const char *arg, int from_file) {
+    char *text = NULL;
+    if (from_file) {
+        FILE *file = fopen(arg, "r");
+        if (!file) {
+            perror("open ID file");
+            return -1;
+        }
+        size_t size = 0;
+        FILE *mem = open_memstream(&text, &size);
+        char buf[4096];
+        size_t n;
+        while (mem && (n = fread(buf, 1, sizeof(buf), file)) > 0)
+            fwrite(buf, 1, n, mem);
+        fclose(file);
+        if (!mem) {
+            perror("open_memstream");
+            return -1;
+        }
+        fclose(mem);
+    } else {
+        text = strdup(arg);
+    }
+    if (!text) {
+        perror("strdup");
+        return -1;
+    }
+
+    char *save;
+    for (char *tok = strtok_r(text, ", \t\n", &save); tok; tok = strtok_r(NULL, ", \t\n", &save)) {
+        char *end;
+        int id;
+        if (parse_treasure_id(tok, "", &end, &id) == -1 || !edit_add(set, id)) {
+            free(text);
+            return -1;
+        }
+    }
+    free(text);
+    return 0;
+}
+
+/* Reads update lines "<id> field=value ..." from path. A clue= assignment
+   takes the rest of its line, so clues may contain spaces. */
+static int parse_update_file(EditSet *set, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("open update file");
+        return -1;
+    }
+
+    char line[1024];
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *p = line + strspn(line, " \t");
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        int id;
+        TreasureEdit *e = NULL;
+        if (parse_treasure_id(p, " \t", &p, &id) == 0)
+            e = edit_add(set, id);
+        if (!e) {
+            status = -1;
+            break;
+        }
+        while (status == 0 && *(p += strspn(p, " \t")) != '\0') {
+            char *end = strncmp(p, "clue=", 5) == 0 ? p + strlen(p) : p + strcspn(p, " \t");
+            char saved = *end;
+            *end = '\0';
+            status = parse_assignment(e, p);
+            *end = saved;
+            p = end;
+        }
+    }
+    fclose(file);
+    return status;
+}
+
+/* Runs a sharded hunt's records through filter in place: dropped records
+   are flagged as removed, changed ones are rewritten where they are.
+   Returns the number of records changed or dropped. */
+static long shard_rewrite_hunt(const char *hunt_id, RecordFilter filter, void *arg) {
+    ShardTableHeader header;
+    int table_fd = shard_table_lock(&header);
+    if (table_fd == -1)
+        return -1;
+
+    HuntSlot slot;
+    long index = shard_find(table_fd, &header, hunt_id, &slot, NULL);
+    if (index == -1) {
+        fprintf(stderr, "Hunt '%s' not found.\n", hunt_id);
+        close(table_fd);
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    int fd = shard_path(path, sizeof(path), &header, hunt_id) == -1 ? -1 : open(path, O_RDWR);
+    if (fd == -1) {
+        perror("Error opening shard file");
+        close(table_fd);
+        return -1;
+    }
+
+    ShardRecord records[SHARD_READ_RECORDS];
+    off_t offset = 0;
+    ssize_t n;
+    long changed = 0, dropped = 0;
+    while ((n = pread(fd, records, sizeof(records), offset)) > 0) {
+        size_t count = n / sizeof(ShardRecord);
+        for (size_t i = 0; i < count; i++) {
+            ShardRecord *r = &records[i];
+            if (r->slot != index || r->generation != slot.generation ||
+                (r->flags & SHARD_RECORD_REMOVED))
+                continue;
+
+            int action = filter(&r->treasure, arg);
+            if (action == RECORD_KEEP)
+                continue;
+            if (action == RECORD_DROP) {
+                r->flags |= SHARD_RECORD_REMOVED;
+                dropped++;
+            }
+            changed++;
+            if (pwrite(fd, r, sizeof(*r), offset + i * sizeof(ShardRecord)) != sizeof(*r)) {
+                perror("Error updating shard file");
+                close(fd);
+                close(table_fd);
+                return -1;
+            }
+        }
+        offset += count * sizeof(ShardRecord);
+    }
+    close(fd);
+
+    if (dropped > 0) {
+        slot.record_count -= dropped;
+        if (pwrite(table_fd, &slot, sizeof(slot), shard_slot_offset(index)) != sizeof(slot))
+            perror("Error updating shard table");
+    }
+    close(table_fd);
+    return changed;
+}
+
+static int compare_treasure_ids(const void *a, const void *b) {
+    const Treasure *x = a, *y = b;
+    return (x->treasure_id > y->treasure_id) - (x->treasure_id < y->treasure_id);
+}
+
+/* Output side of rewrite_hunt: filtered records are written in blocks. */
+typedef struct {
+    RecordFilter filter;
+    void *arg;
+    int fd;
+    long changed;
+    uint64_t written;
+    size_t pending;
+    Treasure out[256];
+    uint64_t position;          /* input position, for the change journal */
+    uint64_t *edited, *dropped;
+    size_t edited_count, dropped_count, edited_cap, dropped_cap;
+    int untracked;              /* a position list could not grow */
+} Rewriter;
+
+static void rewriter_track(Rewriter *w, uint64_t **list, size_t *count, size_t *cap, uint64_t position) {
+    if (*count == *cap) {
+        size_t bigger = *cap ? *cap * 2 : 256;
+        uint64_t *grown = realloc(*list, bigger * sizeof(uint64_t));
+        if (!grown) {
+            w->untracked = 1;
+            return;
+        }
+        *list = grown;
+        *cap = bigger;
+    }
+    (*list)[(*count)++] = position;
+}
+
+static int rewriter_flush(Rewriter *w) {
+    if (write_full(w->fd, w->out, w->pending * sizeof(Treasure)) == -1) {
+        perror("Error writing record to temporary file");
+        return -1;
+    }
+    w->pending = 0;
+    return 0;
+}
+
+static int rewriter_put(Rewriter *w, Treasure t) {
+    int action = w->filter(&t, w->arg);
+    uint64_t position = w->position++;
+    if (action != RECORD_KEEP)
+        w->changed++;
+    if (action == RECORD_DROP)
+        rewriter_track(w, &w->dropped, &w->dropped_count, &w->dropped_cap, position);
+    else if (action == RECORD_CHANGED)
+        rewriter_track(w, &w->edited, &w->edited_count, &w->edited_cap, position);
+    if (action == RECORD_DROP)
+        return 0;
+    w->out[w->pending++] = t;
+    w->written++;
+    return w->pending == sizeof(w->out) / sizeof(w->out[0]) ? rewriter_flush(w) : 0;
+}
+
+/* Streams a directory hunt's records through filter into a temporary file,
+   makes it durable and renames it over treasures.dat, so readers see either
+   the old or the new file and never a partial one.
+
+   Sorted hunts (and any hunt when sort is set) come out fully sorted: the
+   unsorted tail is sorted in memory and merged with the sorted prefix as
+   it streams past. Returns the number of records changed, dropped or
+   moved; the file is left alone when that is zero. */
+static long rewrite_hunt(const char *hunt_id, RecordFilter filter, void *arg, int sort) {
+    char record_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+
+    if (path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s/%s", hunt_id, TEMP_FILE) == -1) {
+        perror("Error opening treasure file for reading");
+        return -1;
+    }
+
+    int fd_in = open(record_path, O_RDONLY);
+    struct stat st;
+    if (fd_in == -1 || fstat(fd_in, &st) == -1) {
+        perror("Error opening treasure file for reading");
+        if (fd_in != -1)
+            close(fd_in);
+        return -1;
+    }
+
+    HuntMeta meta;
+    int merging = sort || (hunt_meta_read(hunt_id, &meta, &st) == 0 && meta.sorted_count > 0);
+    uint64_t total = st.st_size / sizeof(Treasure);
+    uint64_t prefix = total;
+    Treasure *tail = NULL;
+    size_t tail_count = 0;
+    if (merging) {
+        prefix = sort && hunt_meta_read(hunt_id, &meta, &st) == -1 ? 0 : meta.sorted_count;
+        tail_count = total - prefix;
+        tail = malloc(tail_count ? tail_count * sizeof(Treasure) : 1);
+        if (!tail || pread(fd_in, tail, tail_count * sizeof(Treasure), prefix * sizeof(Treasure)) !=
+                         (ssize_t)(tail_count * sizeof(Treasure))) {
+            perror("Error reading treasure file");
+            free(tail);
+            close(fd_in);
+            return -1;
+        }
+        qsort(tail, tail_count, sizeof(Treasure), compare_treasure_ids);
+    }
+
+    int fd_out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_out == -1) {
+        perror("Error opening temporary file for writing");
+        free(tail);
+        close(fd_in);
+        return -1;
+    }
+
+    static Rewriter w;
+    static Treasure in[256];
+    w.filter = filter;
+    w.arg = arg;
+    w.fd = fd_out;
+    w.changed = 0;
+    w.written = 0;
+    w.pending = 0;
+    w.position = 0;
+    w.edited_count = 0;
+    w.dropped_count = 0;
+    w.untracked = 0;
+
+    size_t tail_pos = 0;
+    uint64_t remaining = prefix * sizeof(Treasure);
+    ssize_t bytes_read = 0;
+    int status = 0;
+    while (status == 0 && remaining > 0 &&
+           (bytes_read = read(fd_in, in, remaining < sizeof(in) ? remaining : sizeof(in))) > 0) {
+        remaining -= bytes_read;
+        for (size_t i = 0; status == 0 && i < bytes_read / sizeof(Treasure); i++) {
+            while (status == 0 && tail_pos < tail_count && tail[tail_pos].treasure_id < in[i].treasure_id)
+                status = rewriter_put(&w, tail[tail_pos++]);
+            if (status == 0)
+                status = rewriter_put(&w, in[i]);
+        }
+    }
+    while (status == 0 && tail_pos < tail_count)
+        status = rewriter_put(&w, tail[tail_pos++]);
+    if (status == 0)
+        status = rewriter_flush(&w);
+    free(tail);
+    if (bytes_read == -1) {
+        perror("Error reading treasure file");
+        status = -1;
+    }
+    close(fd_in);
+
+    long changed = w.changed + tail_count;
+    if (status == 0 && changed > 0 && (fsync(fd_out) == -1 || fstat(fd_out, &st) == -1)) {
+        perror("Error syncing temporary file");
+        status = -1;
+    }
+    close(fd_out);
+
+    if (status == -1 || changed == 0) {
+        unlink(temp_path);
+        return status == -1 ? -1 : 0;
+    }
+
+    if (rename(temp_path, record_path) == -1) {
+        perror("Error renaming temporary file to original filename");
+        unlink(temp_path);
+        return -1;
+    }
+
+    int dir_fd = open(hunt_id, O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    if (merging) {
+        HuntMeta sorted = { .magic = META_MAGIC, .version = META_VERSION,
+                            .source_ino = st.st_ino, .sorted_count = w.written };
+        hunt_meta_write(hunt_id, &sorted);
+    }
+
+    /* Positions only line up with the old file when no tail was merged. */
+    if (tail_count > 0 || w.untracked) {
+        change_log_append(hunt_id, CHANGE_RESET, NULL, 0);
+    } else {
+        if (w.edited_count > 0)
+            change_log_append(hunt_id, CHANGE_EDIT, w.edited, w.edited_count);
+        if (w.dropped_count > 0)
+            change_log_append(hunt_id, CHANGE_DROP, w.dropped, w.dropped_count);
+    }
+    return changed;
+}
+
+/* Rebuilds and saves a hunt's sidecars and re-points its user index
+   entries at the current records. Returns the number of records with
+   an already-taken ID, or -1. */
+static long reindex_hunt(const char *hunt_id) {
+    HuntSlot slot;
+    int sharded = hunt_is_sharded(hunt_id);
+    if (sharded) {
+        ShardTableHeader header;
+        int table_fd = shard_table_open(O_RDONLY, &header);
+        long index = table_fd == -1 ? -1 : shard_find(table_fd, &header, hunt_id, &slot, NULL);
+        if (table_fd != -1)
+            close(table_fd);
+        if (index == -1) {
+            fprintf(stderr, "Hunt '%s' not found.\n", hunt_id);
+            return -1;
+        }
+    }
+
+    HuntIndexes hi;
+    long duplicates = hunt_indexes_build(hunt_id, sharded ? &slot : NULL, &hi);
+    if (duplicates == -1)
+        return -1;
+    hunt_indexes_free(&hi);
+    if (user_index_emit_hunt(hunt_id) == -1)
+        fprintf(stderr, "Warning: user index not updated; run reindex_users\n");
+    return duplicates;
+}
+
+/* Called after a hunt's records were rewritten so that sidecar files
+   derived from them do not go stale. */
+static void hunt_rewritten(const char *hunt_id) {
+    if (reindex_hunt(hunt_id) == -1)
+        fprintf(stderr, "Warning: could not rebuild the indexes of hunt '%s'\n", hunt_id);
+}
+
+/* Rewrites a hunt of either backend and brings its sidecar files back in
+   line with the new records. */
+static long filter_hunt(const char *hunt_id, RecordFilter filter, void *arg) {
+    if (hunt_is_archived(hunt_id)) {
+        fprintf(stderr, "Hunt '%s' is archived. Restore it first.\n", hunt_id);
+        return -1;
+    }
+
+    if (hunt_is_sharded(hunt_id)) {
+        long changed = shard_rewrite_hunt(hunt_id, filter, arg);
+        if (changed > 0)
+            hunt_rewritten(hunt_id);
+        return changed;
+    }
+
+    int dir_fd = lock_hunt_dir(hunt_id);
+    if (dir_fd == -1)
+        return -1;
+    long changed = rewrite_hunt(hunt_id, filter, arg, 0);
+    if (changed > 0)
+        hunt_rewritten(hunt_id);
+    close(dir_fd);
+    return changed;
+}
+
+/* Applies a whole edit set to a hunt in one pass and records it with a
+   single log entry. set->applied tells whether anything matched. */
+static int apply_edits(const char *hunt_id, EditSet *set) {
+    edit_sort(set);
+    if (filter_hunt(hunt_id, edit_record, set) == -1)
+        return -1;
+
+    size_t missing = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (!set->edits[i].matched)
+            missing++;
+    }
+    if (set->applied == 0)
+        return 0;
+
+    char log_details[256];
+    if (set->count == 1)
+        snprintf(log_details, sizeof(log_details), "%s treasure ID %d",
+                 set->remove ? "Removed" : "Updated", set->edits[0].treasure_id);
+    else
+        snprintf(log_details, sizeof(log_details), "%s %zu treasures (%zu IDs requested, %zu not found)",
+                 set->remove ? "Removed" : "Updated", set->applied, set->count, missing);
+    log_operation(hunt_id, log_details);
+
+    if (missing > 0)
+        fprintf(stderr, "%zu requested treasure ID(s) not found in hunt '%s'.\n", missing, hunt_id);
+    return 0;
+}
+
+static int drop_duplicate(Treasure *t, void *arg) {
+    int inserted = key_set_insert(arg, treasure_key(t->treasure_id));
+    return inserted == 0 ? RECORD_DROP : RECORD_KEEP;
+}
+
+/* Keeps the first record of every treasure ID and drops the rest. */
+int dedupe_hunt(const char *hunt_id) {
+    KeySet seen;
+    seen.path[0] = '\0';
+    if (key_set_init(&seen, KEY_SET_MIN_CAPACITY) == -1) {
+        perror("calloc");
+        return -1;
+    }
+    long dropped = filter_hunt(hunt_id, drop_duplicate, &seen);
+    key_set_free(&seen);
+    if (dropped == -1)
+        return -1;
+
+    if (dropped > 0) {
+        char log_details[256];
+        snprintf(log_details, sizeof(log_details), "Removed %ld duplicate treasures", dropped);
+        log_operation(hunt_id, log_details);
+    }
+    printf("Removed %ld duplicate treasure(s) from hunt '%s'.\n", dropped, hunt_id);
+    return 0;
+}
+
+static int keep_record(Treasure *t, void *arg) {
+    (void)t;
+    (void)arg;
+    return RECORD_KEEP;
+}
+
+int sort_hunt(const char *hunt_id) {
+    if (hunt_is_archived(hunt_id) || hunt_is_sharded(hunt_id)) {
+        fprintf(stderr, "Only directory hunts can be sorted ('%s' is archived or sharded).\n", hunt_id);
+        return -1;
+    }
+
+    int dir_fd = lock_hunt_dir(hunt_id);
+    if (dir_fd == -1)
+        return -1;
+    long moved = rewrite_hunt(hunt_id, keep_record, NULL, 1);
+    if (moved > 0)
+        hunt_rewritten(hunt_id);
+    close(dir_fd);
+    if (moved == -1)
+        return -1;
+    if (moved > 0)
+        log_operation(hunt_id, "Sorted treasures by ID");
+    printf("Hunt '%s' is sorted by treasure ID (%ld record(s) merged into place).\n", hunt_id, moved);
+    return 0;
+}
+
+int hunt_stats(const char *hunt_id) {
+    HuntStats stats;
+    if (hunt_stats_get(hunt_id, &stats) == -1) {
+        perror("Error reading treasures file");
+        return -1;
+    }
+    print_hunt_stats(stdout, hunt_id, (int)strlen(hunt_id), &stats);
+    return 0;
+}
+
+typedef struct {
+    const ClueQuery *query;
+    unsigned long matches;
+} SearchState;
+
+static int search_hunt(const char *hunt_id, void *arg) {
+    SearchState *state = arg;
+    int32_t *ids;
+    size_t count;
+    if (clue_search(hunt_id, state->query, &ids, &count) == -1) {
+        fprintf(stderr, "Error searching hunt '%s': %s\n", hunt_id, strerror(errno));
+        return -1;
+    }
+    if (count > 0) {
+        printf("%s:", hunt_id);
+        for (size_t i = 0; i < count; i++)
+            printf(" %d", ids[i]);
+        printf("\n");
+    }
+    state->matches += count;
+    free(ids);
+    return 0;
+}
+
+/* Prints the IDs of the treasures whose clue matches the query, per hunt.
+   target is a hunt id or "all". */
+int search_treasures(const char *target, int argc, char *argv[]) {
+    char text[1024] = "";
+    size_t len = 0;
+    for (int i = 0; i < argc && len < sizeof(text); i++)
+        len += snprintf(text + len, sizeof(text) - len, "%s%s", i ? " " : "", argv[i]);
+
+    ClueQuery query;
+    if (clue_query_parse(text, &query) == -1) {
+        fprintf(stderr, "No searchable terms in '%s'.\n", text);
+        return -1;
+    }
+
+    SearchState state = { &query, 0 };
+    int result = strcmp(target, "all") == 0 ? for_each_hunt(search_hunt, &state, 1)
+                                            : search_hunt(target, &state);
+    if (result != 0)
+        return -1;
+    printf("%lu matching treasure(s).\n", state.matches);
+    return 0;
+}
+
+int reindex(const char *hunt_id) {
+    if (hunt_is_archived(hunt_id)) {
+        fprintf(stderr, "Hunt '%s' is archived. Restore it first.\n", hunt_id);
+        return -1;
+    }
+    long duplicates = reindex_hunt(hunt_id);
+    if (duplicates == -1)
+        return -1;
+    printf("Rebuilt ID index of hunt '%s'.\n", hunt_id);
+    if (duplicates > 0)
+        printf("%ld record(s) reuse an existing treasure ID; run 'dedupe %s' to drop them.\n",
+               duplicates, hunt_id);
+    return 0;
+}
+
+int remove_treasure(const char *hunt_id, int target_id) {
+    EditSet set = { .remove = 1 };
+    if (!edit_add(&set, target_id))
+        return -1;
+
+    int status = apply_edits(hunt_id, &set);
+    free(set.edits);
+    if (status == -1)
+        return -1;
+    if (set.applied == 0) {
+        fprintf(stderr, "Treasure with ID %d not found in hunt '%s'.\n", target_id, hunt_id);
+        return -1;
+    }
+
+    printf("Treasure with ID %d removed successfully.\n", target_id);
+    return 0;
+}
+
+/* remove_treasures <hunt_id> <id,id,...> or remove_treasures <hunt_id> --file <path> */
+int remove_treasures(const char *hunt_id, int argc, char *argv[]) {
+    EditSet set = { .remove = 1 };
+    int status;
+    if (argc == 2 && strcmp(argv[0], "--file") == 0) {
+        status = parse_id_list(&set, argv[1], 1);
+    } else if (argc == 1) {
+        status = parse_id_list(&set, argv[0], 0);
+    } else {
+        fprintf(stderr, "Expected <id,id,...> or --file <path>.\n");
+        status = -1;
+    }
+    if (status == 0 && set.count == 0) {
+        fprintf(stderr, "No treasure IDs given.\n");
+        status = -1;
+    }
+    if (status == 0)
+        status = apply_edits(hunt_id, &set);
+    free(set.edits);
+
+    if (status == 0 && set.applied == 0) {
+        fprintf(stderr, "None of the given treasure IDs were found in hunt '%s'.\n", hunt_id);
+        return -1;
+    }
+    if (status == 0)
+        printf("Removed %zu treasure(s) from hunt '%s'.\n", set.applied, hunt_id);
+    return status;
+}
+
+/* update <hunt_id> <treasure_id> field=value... or update <hunt_id> --file <path> */
+int update_treasures(const char *hunt_id, int argc, char *argv[]) {
+    EditSet set = { 0 };
+    int status = 0;
+
+    if (argc == 2 && strcmp(argv[0], "--file") == 0) {
+        status = parse_update_file(&set, argv[1]);
+    } else {
+        char *end;
+        int id;
+        TreasureEdit *e = NULL;
+        if (parse_treasure_id(argv[0], "", &end, &id) == 0)
+            e = edit_add(&set, id);
+        if (!e)
+            status = -1;
+        for (int i = 1; status == 0 && i < argc; i++)
+            status = parse_assignment(e, argv[i]);
+    }
+    if (status == 0 && set.count == 0) {
+        fprintf(stderr, "No updates given.\n");
+        status = -1;
+    }
+    if (status == 0)
+        status = apply_edits(hunt_id, &set);
+    free(set.edits);
+
+    if (status == 0 && set.applied == 0) {
+        fprintf(stderr, "None of the given treasure IDs were found in hunt '%s'.\n", hunt_id);
+        return -1;
+    }
+    if (status == 0)
+        printf("Updated %zu treasure(s) in hunt '%s'.\n", set.applied, hunt_id);
+    return status;
+}
+
+/* Deleting a sharded hunt only retires its slot; its records become
+   garbage that compact_shards reclaims. */
+int shard_remove_hunt(const char *hunt_id) {
+    ShardTableHeader header;
+    int table_fd = shard_table_lock(&header);
+    if (table_fd == -1)
+        return -1;
+
+    HuntSlot slot;
+    long index = shard_find(table_fd, &header, hunt_id, &slot, NULL);
+    if (index == -1) {
+        fprintf(stderr, "Hunt '%s' not found.\n", hunt_id);
+        close(table_fd);
+        return -1;
+    }
+
+    char index_path[PATH_MAX];
+    if (id_index_path(index_path, sizeof(index_path), hunt_id, 1) == 0)
+        unlink(index_path);
+    if (clue_index_path(index_path, sizeof(index_path), hunt_id, 1) == 0)
+        unlink(index_path);
+
+    slot.state = SLOT_DELETED;
+    slot.record_count = 0;
+    if (pwrite(table_fd, &slot, sizeof(slot), shard_slot_offset(index)) != sizeof(slot)) {
+        perror("Failed to update shard table");
+        close(table_fd);
+        return -1;
+    }
+    close(table_fd);
+    if (user_index_emit_hunt(hunt_id) == -1)
+        fprintf(stderr, "Warning: user index not updated; run reindex_users\n");
+
+    printf("Successfully removed sharded hunt: %s\n", hunt_id);
+    return 0;
+}
+
+int remove_hunt(const char *hunt_id) {
+    if (hunt_is_sharded(hunt_id))
+        return shard_remove_hunt(hunt_id);
+
+    char hunt_dir[PATH_MAX], treasure_path[PATH_MAX], log_path[PATH_MAX];
+    if (path_format(hunt_dir, sizeof(hunt_dir), "./%s", hunt_id) == -1 ||
+        path_format(treasure_path, sizeof(treasure_path), "%s/%s", hunt_dir, RECORD_FILE) == -1 ||
+        path_format(log_path, sizeof(log_path), "%s/%s", hunt_dir, LOG_FILE) == -1) {
+        perror("Failed to delete treasures file");
+        return -1;
+    }
+
+    if (unlink(treasure_path) == -1 && errno != ENOENT) {
+        perror("Failed to delete treasures file");
+        return -1;
+    }
+
+    if (unlink(log_path) == -1 && errno != ENOENT) {
+        perror("Failed to delete logged_hunt file");
+        return -1;
+    }
+
+    static const char *sidecars[] = { INDEX_FILE, USERS_FILE, META_FILE, CLUE_INDEX_FILE,
+                                       CHANGE_LOG, SYNC_STATE, CHECKSUM_FILE, DAMAGED_FILE,
+                                       TIMES_FILE, RULES_FILE, SKETCH_FILE };
+    for (size_t i = 0; i < sizeof(sidecars) / sizeof(sidecars[0]); i++) {
+        char sidecar_path[PATH_MAX];
+        if (path_format(sidecar_path, sizeof(sidecar_path), "%s/%s", hunt_dir, sidecars[i]) == -1 ||
+            (unlink(sidecar_path) == -1 && errno != ENOENT)) {
+            perror("Failed to delete hunt index file");
+            return -1;
+        }
+    }
+
+    if (rmdir(hunt_dir) == -1) {
+        perror("Failed to remove hunt directory (not empty?)");
+        return -1;
+    } else {
+        printf("Successfully removed hunt directory: %s\n", hunt_dir);
+    }
+    if (user_index_emit_hunt(hunt_id) == -1)
+        fprintf(stderr, "Warning: user index not updated; run reindex_users\n");
+
+    char symlink_path[PATH_MAX];
+    if (path_format(symlink_path, sizeof(symlink_path), "logged_hunt-%s", hunt_id) == -1 ||
+        (unlink(symlink_path) == -1 && errno != ENOENT)) {
+        perror("Failed to remove symbolic link");
+        return -1;
+    } else {
+        printf("Successfully removed symbolic link: %s\n", symlink_path);
+    }
+
+    return 0;
+}
+
+/* Zeroes the bytes after the terminator of the text fields so that padding
+   compresses to nothing (older records were written from uninitialised
+   stack memory). */
+static void normalize_record(Treasure *t) {
+    size_t len = strnlen(t->username, USERNAME_LEN);
+    memset(t->username + len, 0, USERNAME_LEN - len);
+    len = strnlen(t->clue, CLUE_LEN);
+    memset(t->clue + len, 0, CLUE_LEN - len);
+}
+
+static int read_whole_file(const char *path, unsigned char **data, size_t *size) {
+    *data = NULL;
+    *size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return errno == ENOENT ? 0 : -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    *data = malloc(st.st_size ? st.st_size : 1);
+    if (!*data) {
+        close(fd);
+        return -1;
+    }
+    ssize_t n = read(fd, *data, st.st_size);
+    close(fd);
+    if (n != st.st_size) {
+        free(*data);
+        *data = NULL;
+        errno = EIO;
+        return -1;
+    }
+    *size = st.st_size;
+    return 0;
+}
+
+/* Packs raw into the archive at *offset and fills entry. */
+static int write_packed_block(int fd, const unsigned char *raw, size_t len, uint64_t *offset, BlockEntry *entry) {
+    unsigned char *packed = malloc(block_pack_bound(len));
+    if (!packed)
+        return -1;
+
+    size_t packed_len = block_pack(raw, len, packed);
+    entry->offset = *offset;
+    entry->raw_length = len;
+    entry->packed_length = packed_len;
+    entry->crc = crc32c(0, raw, len);
+
+    int status = pwrite(fd, packed, packed_len, *offset) == (ssize_t)packed_len ? 0 : -1;
+    free(packed);
+    *offset += packed_len;
+    return status;
+}
+
+int init_shards(unsigned shard_count, unsigned slot_count) {
+    if (shard_count == 0 || slot_count == 0) {
+        fprintf(stderr, "Shard and slot counts must be positive\n");
+        return -1;
+    }
+    if (mkdir(SHARD_DIR, 0755) == -1) {
+        perror(errno == EEXIST ? "Sharded storage already initialised" : "mkdir");
+        return -1;
+    }
+
+    int fd = open(SHARD_TABLE, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        perror("create shard table");
+        return -1;
+    }
+
+    ShardTableHeader header;
+    memcpy(header.magic, SHARD_TABLE_MAGIC, 4);
+    header.shard_count = shard_count;
+    header.slot_count = slot_count;
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        ftruncate(fd, shard_slot_offset(slot_count)) == -1) {
+        perror("write shard table");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    printf("Initialised sharded storage: %u shards, %u hunt slots.\n", shard_count, slot_count);
+    return 0;
+}
+
+/* Rewrites every shard file without the records of removed treasures and
+   deleted hunts. */
+int compact_shards(void) {
+    ShardTableHeader header;
+    int table_fd = shard_table_lock(&header);
+    if (table_fd == -1)
+        return -1;
+
+    size_t table_size = header.slot_count * sizeof(HuntSlot);
+    HuntSlot *slots = malloc(table_size);
+    if (!slots || pread(table_fd, slots, table_size, sizeof(header)) != (ssize_t)table_size) {
+        perror("read shard table");
+        free(slots);
+        close(table_fd);
+        return -1;
+    }
+
+    int status = 0;
+    unsigned long kept = 0, dropped = 0;
+    for (uint32_t shard = 0; shard < header.shard_count && status == 0; shard++) {
+        char path[PATH_MAX], temp_path[PATH_MAX];
+        if (path_format(path, sizeof(path), "%s/shard-%03u.dat", SHARD_DIR, shard) == -1 ||
+            path_format(temp_path, sizeof(temp_path), "%s.tmp", path) == -1) {
+            perror("Error naming shard file");
+            status = -1;
+            break;
+        }
+
+        int fd_in = open(path, O_RDONLY);
+        if (fd_in == -1)
+            continue;
+        int fd_out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_out == -1) {
+            perror("Error opening temporary shard file");
+            close(fd_in);
+            status = -1;
+            break;
+        }
+
+        ShardRecord r;
+        while (read(fd_in, &r, sizeof(r)) == sizeof(r)) {
+            if (r.slot >= header.slot_count || slots[r.slot].state != SLOT_LIVE ||
+                slots[r.slot].generation != r.generation || (r.flags & SHARD_RECORD_REMOVED)) {
+                dropped++;
+                continue;
+            }
+            if (write(fd_out, &r, sizeof(r)) != sizeof(r)) {
+                perror("Error writing temporary shard file");
+                status = -1;
+                break;
+            }
+            kept++;
+        }
+        close(fd_in);
+        if (fsync(fd_out) == -1)
+            status = -1;
+        close(fd_out);
+
+        if (status == -1 || rename(temp_path, path) == -1) {
+            perror("Error replacing shard file");
+            unlink(temp_path);
+            status = -1;
+        }
+    }
+
+    /* Compaction moved the records, so the entries of every sharded hunt
+       are replaced in one pass over the buckets. */
+    if (status == 0) {
+        UserIndexList *lists = calloc(USER_INDEX_BUCKETS, sizeof(UserIndexList));
+        int indexed = lists ? 0 : -1;
+        for (uint32_t i = 0; i < header.slot_count && indexed == 0; i++) {
+            if (slots[i].state == SLOT_LIVE)
+                indexed = user_index_collect(lists, slots[i].hunt_id);
+        }
+        if (indexed == -1 || user_index_write(lists, user_entry_sharded, NULL) == -1)
+            fprintf(stderr, "Warning: user index not updated; run reindex_users\n");
+        user_index_lists_free(lists);
+    }
+
+    free(slots);
+    close(table_fd);
+    if (status == 0)
+        printf("Compacted shards: %lu records kept, %lu dropped.\n", kept, dropped);
+    return status;
+}
+
+int archive_hunt(const char *hunt_id) {
+    char record_path[PATH_MAX], log_path[PATH_MAX], archive_path[PATH_MAX], temp_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1 ||
+        path_format(log_path, sizeof(log_path), "%s/%s", hunt_id, LOG_FILE) == -1 ||
+        path_format(archive_path, sizeof(archive_path), "%s%s", hunt_id, ARCHIVE_SUFFIX) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s%s.tmp", hunt_id, ARCHIVE_SUFFIX) == -1) {
+        perror("Error archiving hunt");
+        return -1;
+    }
+
+    if (hunt_is_archived(hunt_id)) {
+        fprintf(stderr, "Hunt '%s' is already archived.\n", hunt_id);
+        return -1;
+    }
+    struct stat dir_st;
+    if (stat(hunt_id, &dir_st) == -1 || !S_ISDIR(dir_st.st_mode)) {
+        fprintf(stderr, "Hunt '%s' has no directory; only directory hunts can be archived.\n", hunt_id);
+        return -1;
+    }
+
+    unsigned char *records, *log;
+    size_t records_size, log_size;
+    if (read_whole_file(record_path, &records, &records_size) == -1) {
+        perror("Error reading treasures file");
+        return -1;
+    }
+    if (read_whole_file(log_path, &log, &log_size) == -1) {
+        perror("Error reading log file");
+        free(records);
+        return -1;
+    }
+    if (records_size % sizeof(Treasure) != 0) {
+        fprintf(stderr, "Incomplete record read. File may be corrupted.\n");
+        free(records);
+        free(log);
+        return -1;
+    }
+
+    size_t record_count = records_size / sizeof(Treasure);
+    for (size_t i = 0; i < record_count; i++)
+        normalize_record((Treasure *)records + i);
+
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.version = ARCHIVE_VERSION;
+    header.record_size = sizeof(Treasure);
+    header.block_records = ARCHIVE_BLOCK_RECORDS;
+    header.record_count = record_count;
+    header.block_count = (record_count + ARCHIVE_BLOCK_RECORDS - 1) / ARCHIVE_BLOCK_RECORDS;
+
+    BlockEntry *blocks = calloc(header.block_count ? header.block_count : 1, sizeof(BlockEntry));
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!blocks || fd == -1) {
+        perror("Error creating archive");
+        free(blocks);
+        free(records);
+        free(log);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    uint64_t offset = sizeof(header) + header.block_count * sizeof(BlockEntry);
+    int status = 0;
+    for (uint32_t b = 0; b < header.block_count && status == 0; b++) {
+        size_t first = (size_t)b * ARCHIVE_BLOCK_RECORDS;
+        size_t count = record_count - first < ARCHIVE_BLOCK_RECORDS ? record_count - first : ARCHIVE_BLOCK_RECORDS;
+        status = write_packed_block(fd, records + first * sizeof(Treasure), count * sizeof(Treasure),
+                                    &offset, &blocks[b]);
+    }
+    if (status == 0)
+        status = write_packed_block(fd, log ? log : (unsigned char *)"", log_size, &offset, &header.log_block);
+
+    size_t table_size = header.block_count * sizeof(BlockEntry);
+    header.crc = crc32c(crc32c(0, &header, sizeof(header)), blocks, table_size);
+    if (status == 0 &&
+        (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+         pwrite(fd, blocks, table_size, sizeof(header)) != (ssize_t)table_size ||
+         fsync(fd) == -1))
+        status = -1;
+
+    close(fd);
+    free(blocks);
+    free(records);
+    free(log);
+
+    if (status == -1 || rename(temp_path, archive_path) == -1) {
+        perror("Error writing archive");
+        unlink(temp_path);
+        return -1;
+    }
+
+    printf("Archived hunt '%s': %zu records, %zu -> %llu bytes.\n", hunt_id, record_count,
+           records_size + log_size, (unsigned long long)offset);
+
+    /* The scoring rules stay next to the archive. */
+    char rules[PATH_MAX], archived_rules[PATH_MAX];
+    if (path_format(rules, sizeof(rules), "%s/%s", hunt_id, RULES_FILE) == -1 ||
+        path_format(archived_rules, sizeof(archived_rules), "%s%s", hunt_id, RULES_SUFFIX) == -1 ||
+        (rename(rules, archived_rules) == -1 && errno != ENOENT))
+        perror("Error keeping scoring rules");
+    return remove_hunt(hunt_id);
+}
+
+int restore_hunt(const char *hunt_id) {
+    char record_path[PATH_MAX], log_path[PATH_MAX], archive_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", hunt_id, RECORD_FILE) == -1 ||
+        path_format(log_path, sizeof(log_path), "%s/%s", hunt_id, LOG_FILE) == -1 ||
+        path_format(archive_path, sizeof(archive_path), "%s%s", hunt_id, ARCHIVE_SUFFIX) == -1) {
+        perror("Error opening archive");
+        return -1;
+    }
+
+    ArchiveHeader header;
+    BlockEntry *blocks;
+    int fd = archive_open(hunt_id, &header, &blocks);
+    if (fd == -1) {
+        perror("Error opening archive");
+        return -1;
+    }
+
+    if (mkdir(hunt_id, 0755) == -1) {
+        perror(errno == EEXIST ? "Hunt directory already exists" : "mkdir");
+        free(blocks);
+        close(fd);
+        return -1;
+    }
+
+    int out = open(record_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    unsigned char *raw = malloc((size_t)header.block_records * sizeof(Treasure) + header.log_block.raw_length + 1);
+    int status = out == -1 || !raw ? -1 : 0;
+
+    for (uint32_t b = 0; b < header.block_count && status == 0; b++) {
+        if (blocks[b].raw_length > header.block_records * sizeof(Treasure) ||
+            archive_read_block(fd, &blocks[b], raw) == -1 ||
+            write(out, raw, blocks[b].raw_length) != (ssize_t)blocks[b].raw_length)
+            status = -1;
+    }
+    if (out != -1 && fsync(out) == -1)
+        status = -1;
+    if (out != -1)
+        close(out);
+
+    if (status == 0) {
+        out = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out == -1 ||
+            archive_read_block(fd, &header.log_block, raw) == -1 ||
+            write(out, raw, header.log_block.raw_length) != (ssize_t)header.log_block.raw_length)
+            status = -1;
+        if (out != -1)
+            close(out);
+    }
+
+    free(raw);
+    free(blocks);
+    close(fd);
+
+    if (status == -1) {
+        perror("Error restoring archive");
+        unlink(record_path);
+        unlink(log_path);
+        rmdir(hunt_id);
+        return -1;
+    }
+
+    if (create_symlink_for_log(hunt_id) == -1) {
+        fprintf(stderr, "Warning: Failed to create symlink for logged_hunt\n");
+    }
+    log_operation(hunt_id, "Restored hunt from archive");
+    change_log_append(hunt_id, CHANGE_RESET, NULL, 0);
+    /* The archive's block CRCs vouched for the records, so the sidecars
+       (checksums included) are built from them right away. */
+    hunt_rewritten(hunt_id);
+
+    char rules[PATH_MAX], archived_rules[PATH_MAX];
+    if (path_format(rules, sizeof(rules), "%s/%s", hunt_id, RULES_FILE) == -1 ||
+        path_format(archived_rules, sizeof(archived_rules), "%s%s", hunt_id, RULES_SUFFIX) == -1 ||
+        (rename(archived_rules, rules) == -1 && errno != ENOENT))
+        perror("Error restoring scoring rules");
+
+    if (unlink(archive_path) == -1) {
+        perror("Failed to remove archive");
+        return -1;
+    }
+    printf("Restored hunt '%s' (%llu records).\n", hunt_id, (unsigned long long)header.record_count);
+    return 0;
+}
+
+typedef struct {
+    UserIndexList *lists;
+    unsigned long hunts;
+} UserReindex;
+
+static int reindex_user_entries(const char *hunt_id, void *arg) {
+    UserReindex *r = arg;
+    r->hunts++;
+    return user_index_collect(r->lists, hunt_id);
+}
+
+static int user_entry_any(const UserIndexEntry *e, void *arg) {
+    (void)e;
+    (void)arg;
+    return 1;
+}
+
+/* Rebuilds the global user index from scratch, dropping the entries that
+   interrupted rewrites left behind. */
+int reindex_users(void) {
+    UserReindex r = { calloc(USER_INDEX_BUCKETS, sizeof(UserIndexList)), 0 };
+    if (!r.lists) {
+        perror("malloc");
+        return -1;
+    }
+    int status = 0;
+    if (for_each_hunt(reindex_user_entries, &r, 0) != 0) {
+        perror("Error rebuilding user index");
+        status = -1;
+    }
+    if (status == 0 && user_index_write(r.lists, user_entry_any, NULL) == -1)
+        status = -1;
+    user_index_lists_free(r.lists);
+    if (status == 0)
+        printf("Rebuilt user index over %lu hunt(s).\n", r.hunts);
+    return status;
+}
+
+/* Copies len bytes at src_offset of src_fd to dst_offset of dst_fd. */
+static int sync_copy_range(int src_fd, off_t src_offset, int dst_fd, off_t dst_offset, uint64_t len) {
+    static char buffer[1 << 16];
+    while (len > 0) {
+        ssize_t n = pread(src_fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer), src_offset);
+        if (n <= 0)
+            return -1;
+        if (pwrite(dst_fd, buffer, n, dst_offset) != n)
+            return -1;
+        src_offset += n;
+        dst_offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Replaces dst_path with a copy of src_path (temp file + rename) and gives
+   it src's mtime. Returns the size copied, or -1. */
+static off_t sync_copy_file(const char *src_path, const char *dst_path) {
+    char temp_path[PATH_MAX];
+    if (path_format(temp_path, sizeof(temp_path), "%s.sync", dst_path) == -1)
+        return -1;
+
+    struct stat st;
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd == -1 || fstat(src_fd, &st) == -1) {
+        if (src_fd != -1)
+            close(src_fd);
+        return -1;
+    }
+    int dst_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst_fd == -1) {
+        close(src_fd);
+        return -1;
+    }
+
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    int status = sync_copy_range(src_fd, 0, dst_fd, 0, st.st_size) == -1 ||
+                 fsync(dst_fd) == -1 || futimens(dst_fd, times) == -1 ? -1 : 0;
+    close(src_fd);
+    close(dst_fd);
+    if (status == 0 && rename(temp_path, dst_path) == -1)
+        status = -1;
+    if (status == -1) {
+        unlink(temp_path);
+        return -1;
+    }
+    return st.st_size;
+}
+
+/* Reads a hunt's change journal. A hunt older than the journal gets one
+   now, starting with a RESET so its replicas take a full copy first. */
+static char *sync_read_journal(const char *hunt_dir, size_t *size) {
+    char path[PATH_MAX];
+    if (path_format(path, sizeof(path), "%s/%s", hunt_dir, CHANGE_LOG) == -1)
+        return NULL;
+    struct stat st;
+    if (stat(path, &st) == -1 && (errno != ENOENT || change_log_append(hunt_dir, CHANGE_RESET, NULL, 0) == -1))
+        return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(ChangeLogHeader)) {
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+    char *journal = malloc(st.st_size);
+    if (!journal || read_full(fd, journal, st.st_size) != 1 ||
+        memcmp(((ChangeLogHeader *)journal)->magic, CHANGE_LOG_MAGIC, 4) != 0) {
+        free(journal);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    *size = st.st_size;
+    return journal;
+}
+
+typedef struct {
+    uint64_t appended, edited, dropped;
+} SyncDelta;
+
+/* Replays the journal entries after state->synced_seq over the replica's
+   record positions. map[i] ends up as the position in the replica of the
+   source's record i, or -1 when it has to come from the source. Returns
+   the map (its length in *count), or NULL when the replica needs a full
+   copy: entries are missing, a RESET happened or the lengths disagree. */
+static int64_t *sync_replay(const char *journal, size_t size, const SyncState *state,
+                            uint64_t src_count, uint64_t *count, SyncDelta *delta) {
+    const ChangeLogHeader *header = (const ChangeLogHeader *)journal;
+    if (header->journal_id != state->journal_id || state->synced_seq >= header->next_seq)
+        return NULL;
+
+    /* Records appended and dropped again between two syncs take the
+       replica past both its old and its new length, so the map is sized
+       for every append still to be replayed. */
+    uint64_t appended = 0;
+    for (size_t offset = sizeof(ChangeLogHeader); offset + sizeof(ChangeEntry) <= size;) {
+        ChangeEntry entry;
+        memcpy(&entry, journal + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (entry.kind == CHANGE_EDIT || entry.kind == CHANGE_DROP) {
+            if (entry.count > (size - offset) / sizeof(uint64_t))
+                break;
+            offset += entry.count * sizeof(uint64_t);
+        } else if (entry.kind == CHANGE_APPEND && entry.seq > state->synced_seq) {
+            appended += entry.count;
+        }
+    }
+
+    uint64_t length = state->records, cap = length + appended;
+    if (cap < length || cap > SIZE_MAX / sizeof(int64_t))
+        return NULL;
+    int64_t *map = malloc((cap ? cap : 1) * sizeof(int64_t));
+    if (!map)
+        return NULL;
+    for (uint64_t i = 0; i < length; i++)
+        map[i] = i;
+
+    uint64_t expected = state->synced_seq + 1;
+    size_t offset = sizeof(ChangeLogHeader);
+    while (offset + sizeof(ChangeEntry) <= size) {
+        ChangeEntry entry;
+        memcpy(&entry, journal + offset, sizeof(entry));
+        offset += sizeof(entry);
+        size_t positions_size = entry.kind == CHANGE_EDIT || entry.kind == CHANGE_DROP ?
+                                entry.count * sizeof(uint64_t) : 0;
+        if (positions_size > size - offset)
+            break;
+        const char *positions = journal + offset;
+        offset += positions_size;
+        if (entry.seq < expected)
+            continue;
+        if (entry.seq != expected++)
+            goto full;
+
+        if (entry.kind == CHANGE_APPEND) {
+            if (length + entry.count > cap)
+                goto full;
+            for (uint64_t i = 0; i < entry.count; i++)
+                map[length++] = -1;
+            delta->appended += entry.count;
+        } else if (entry.kind == CHANGE_EDIT || entry.kind == CHANGE_DROP) {
+            uint64_t kept = 0, next = 0;
+            for (uint64_t i = 0; i < entry.count; i++) {
+                uint64_t p;
+                memcpy(&p, positions + i * sizeof(p), sizeof(p));
+                if (p >= length)
+                    goto full;
+                if (entry.kind == CHANGE_EDIT) {
+                    map[p] = -1;
+                    continue;
+                }
+                if (p < next)
+                    goto full;
+                while (next < p)
+                    map[kept++] = map[next++];
+                next = p + 1;
+            }
+            if (entry.kind == CHANGE_DROP) {
+                while (next < length)
+                    map[kept++] = map[next++];
+                length = kept;
+                delta->dropped += entry.count;
+            } else {
+                delta->edited += entry.count;
+            }
+        } else {
+            goto full;
+        }
+    }
+    if (expected != header->next_seq || length != src_count)
+        goto full;
+    *count = length;
+    return map;
+
+full:
+    free(map);
+    return NULL;
+}
+
+/* Writes the replica's records from the map built by sync_replay: runs
+   still in the replica are copied from its old file, the rest from the
+   source, into a temporary file renamed over treasures.dat. Pure appends
+   are written to the end of the replica's file in place. */
+static int sync_apply(int src_fd, const char *dst_dir, const int64_t *map, uint64_t count, uint64_t old_records) {
+    char record_path[PATH_MAX], temp_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", dst_dir, RECORD_FILE) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s/%s", dst_dir, TEMP_FILE) == -1) {
+        perror("Error naming replica records");
+        return -1;
+    }
+
+    uint64_t unchanged = 0;
+    while (unchanged < count && unchanged < old_records && map[unchanged] == (int64_t)unchanged)
+        unchanged++;
+    int in_place = unchanged == old_records;
+    for (uint64_t i = unchanged; in_place && i < count; i++)
+        in_place = map[i] == -1;
+
+    int old_fd = open(record_path, in_place ? O_WRONLY : O_RDONLY);
+    int out_fd = in_place ? old_fd : open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (old_fd == -1 || out_fd == -1) {
+        perror("Error opening replica records");
+        if (old_fd != -1)
+            close(old_fd);
+        return -1;
+    }
+
+    int status = 0;
+    uint64_t i = in_place ? old_records : 0;
+    while (status == 0 && i < count) {
+        uint64_t run = 1;
+        if (map[i] == -1) {
+            while (i + run < count && map[i + run] == -1)
+                run++;
+            status = sync_copy_range(src_fd, i * sizeof(Treasure), out_fd, i * sizeof(Treasure),
+                                     run * sizeof(Treasure));
+        } else {
+            while (i + run < count && map[i + run] == map[i] + (int64_t)run)
+                run++;
+            status = sync_copy_range(old_fd, map[i] * sizeof(Treasure), out_fd, i * sizeof(Treasure),
+                                     run * sizeof(Treasure));
+        }
+        i += run;
+    }
+    if (status == 0 && (ftruncate(out_fd, count * sizeof(Treasure)) == -1 || fsync(out_fd) == -1))
+        status = -1;
+    if (!in_place)
+        close(out_fd);
+    close(old_fd);
+
+    if (!in_place && status == 0 && rename(temp_path, record_path) == -1)
+        status = -1;
+    if (status == -1) {
+        perror("Error writing replica records");
+        if (!in_place)
+            unlink(temp_path);
+    }
+    return status;
+}
+
+/* Insertion times cannot be rebuilt from the records, so the replica gets
+   the source's treasures.ts re-pointed at its own file. */
+static void sync_times(const char *src_dir, uint64_t src_ino, const char *dst_dir, uint64_t dst_ino,
+                       uint64_t records) {
+    char src_path[PATH_MAX], dst_path[PATH_MAX], temp_path[PATH_MAX];
+    if (path_format(src_path, sizeof(src_path), "%s/%s", src_dir, TIMES_FILE) == -1 ||
+        path_format(dst_path, sizeof(dst_path), "%s/%s", dst_dir, TIMES_FILE) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s.tmp", dst_path) == -1) {
+        perror("Error copying hunt times");
+        return;
+    }
+
+    TimesHeader header;
+    struct stat st;
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd == -1 || fstat(src_fd, &st) == -1 ||
+        read(src_fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, TIMES_MAGIC, 4) != 0 || header.source_ino != src_ino || header.records != records) {
+        if (src_fd != -1)
+            close(src_fd);
+        unlink(dst_path);
+        return;
+    }
+    header.source_ino = dst_ino;
+    int dst_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int status = dst_fd == -1 || write_full(dst_fd, &header, sizeof(header)) == -1 ||
+                 sync_copy_range(src_fd, sizeof(header), dst_fd, sizeof(header), st.st_size - sizeof(header)) == -1 ?
+                 -1 : 0;
+    close(src_fd);
+    if (dst_fd != -1)
+        close(dst_fd);
+    if (status == 0 && rename(temp_path, dst_path) == -1)
+        status = -1;
+    if (status == -1) {
+        perror("Error copying hunt times");
+        unlink(temp_path);
+    }
+}
+
+/* Brings the replica of one directory hunt up to date. Holds the source
+   hunt's directory lock, so the records and the journal agree. */
+static int sync_hunt(const char *src_root, const char *dst_root, const char *hunt_id) {
+    char src_dir[PATH_MAX], dst_dir[PATH_MAX], src_path[PATH_MAX], dst_path[PATH_MAX];
+    char state_path[PATH_MAX], src_log[PATH_MAX], dst_log[PATH_MAX];
+    char src_rules[PATH_MAX], dst_rules[PATH_MAX], meta_path[PATH_MAX], sketch_file[PATH_MAX];
+    if (path_format(src_dir, sizeof(src_dir), "%s/%s", src_root, hunt_id) == -1 ||
+        path_format(dst_dir, sizeof(dst_dir), "%s/%s", dst_root, hunt_id) == -1 ||
+        path_format(src_path, sizeof(src_path), "%s/%s", src_dir, RECORD_FILE) == -1 ||
+        path_format(dst_path, sizeof(dst_path), "%s/%s", dst_dir, RECORD_FILE) == -1 ||
+        path_format(state_path, sizeof(state_path), "%s/%s", dst_dir, SYNC_STATE) == -1 ||
+        path_format(src_log, sizeof(src_log), "%s/%s", src_dir, LOG_FILE) == -1 ||
+        path_format(dst_log, sizeof(dst_log), "%s/%s", dst_dir, LOG_FILE) == -1 ||
+        path_format(src_rules, sizeof(src_rules), "%s/%s", src_dir, RULES_FILE) == -1 ||
+        path_format(dst_rules, sizeof(dst_rules), "%s/%s", dst_dir, RULES_FILE) == -1 ||
+        path_format(meta_path, sizeof(meta_path), "%s/%s", dst_dir, META_FILE) == -1 ||
+        sketch_path(sketch_file, sizeof(sketch_file), dst_dir) == -1) {
+        fprintf(stderr, "%s: %s\n", hunt_id, strerror(ENAMETOOLONG));
+        return -1;
+    }
+    if (mkdir(dst_dir, 0755) == -1 && errno != EEXIST) {
+        perror("Error creating replica hunt directory");
+        return -1;
+    }
+
+    int dir_fd = lock_hunt_dir(src_dir);
+    if (dir_fd == -1)
+        return -1;
+
+    struct stat src_st, dst_st;
+    int src_fd = open(src_path, O_RDONLY);
+    if (src_fd == -1 || fstat(src_fd, &src_st) == -1) {
+        perror("Error opening treasure file for reading");
+        if (src_fd != -1)
+            close(src_fd);
+        close(dir_fd);
+        return -1;
+    }
+    uint64_t src_count = src_st.st_size / sizeof(Treasure);
+
+    SyncState state;
+    int state_fd = open(state_path, O_RDONLY);
+    int have_state = state_fd != -1 && read_full(state_fd, &state, sizeof(state)) == 1 &&
+                     memcmp(state.magic, SYNC_STATE_MAGIC, 4) == 0 &&
+                     stat(dst_path, &dst_st) == 0 && (uint64_t)dst_st.st_size == state.records * sizeof(Treasure);
+    if (state_fd != -1)
+        close(state_fd);
+
+    size_t journal_size = 0;
+    char *journal = sync_read_journal(src_dir, &journal_size);
+    SyncDelta delta = { 0, 0, 0 };
+    uint64_t count = 0;
+    int64_t *map = have_state && journal ?
+                   sync_replay(journal, journal_size, &state, src_count, &count, &delta) : NULL;
+
+    int status = 0;
+    int full = map == NULL;
+    if (full)
+        status = sync_copy_file(src_path, dst_path) == -1 ? -1 : 0;
+    else if (delta.appended || delta.edited || delta.dropped)
+        status = sync_apply(src_fd, dst_dir, map, count, state.records);
+    free(map);
+    close(src_fd);
+    if (status == -1) {
+        perror("Error copying hunt records");
+        free(journal);
+        close(dir_fd);
+        return -1;
+    }
+
+    /* The log only ever grows, so normally just its tail is shipped. */
+    struct stat log_st;
+    uint64_t log_bytes = 0, log_shipped = 0;
+    if (stat(src_log, &log_st) == 0) {
+        log_bytes = log_st.st_size;
+        uint64_t from = have_state && !full && state.log_bytes <= log_bytes ? state.log_bytes : 0;
+        int log_in = open(src_log, O_RDONLY);
+        int log_out = open(dst_log, O_WRONLY | O_CREAT, 0644);
+        if (log_in == -1 || log_out == -1 ||
+            sync_copy_range(log_in, from, log_out, from, log_bytes - from) == -1 ||
+            ftruncate(log_out, log_bytes) == -1) {
+            perror("Error copying hunt log");
+            status = -1;
+        }
+        if (log_in != -1)
+            close(log_in);
+        if (log_out != -1)
+            close(log_out);
+        log_shipped = log_bytes - from;
+    }
+
+    /* hunt.meta, the block checksums and the sketches describe identical
+       records, so they only need re-pointing at the replica's file; the
+       other sidecars are rebuilt on first use. */
+    HuntMeta meta;
+    ChecksumHeader checksums;
+    static HuntSketch sketch;
+    if (status == 0 && stat(dst_path, &dst_st) == 0) {
+        if (hunt_meta_read(src_dir, &meta, &src_st) == 0) {
+            meta.source_ino = dst_st.st_ino;
+            hunt_meta_write(dst_dir, &meta);
+        } else {
+            unlink(meta_path);
+        }
+        uint32_t *crcs = checksum_load(src_dir, src_st.st_ino, &checksums);
+        if (crcs && checksums.records == src_count)
+            checksum_write(dst_dir, dst_st.st_ino, src_count, crcs);
+        free(crcs);
+        sync_times(src_dir, src_st.st_ino, dst_dir, dst_st.st_ino, src_count);
+        if (sketch_read(src_dir, &sketch, &src_st) == 0) {
+            sketch_write(dst_dir, dst_st.st_ino, &sketch);
+        } else {
+            unlink(sketch_file);
+        }
+
+        if (sync_copy_file(src_rules, dst_rules) == -1 && errno == ENOENT)
+            unlink(dst_rules);
+    }
+
+    if (status == 0) {
+        const ChangeLogHeader *header = (const ChangeLogHeader *)journal;
+        SyncState synced = { .magic = SYNC_STATE_MAGIC, .reserved = 0,
+                             .journal_id = header ? header->journal_id : 0,
+                             .synced_seq = header ? header->next_seq - 1 : 0,
+                             .records = src_count, .log_bytes = log_bytes };
+        state_fd = open(state_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (state_fd == -1 || write_full(state_fd, &synced, sizeof(synced)) == -1) {
+            perror("Error writing sync state");
+            status = -1;
+        }
+        if (state_fd != -1)
+            close(state_fd);
+    }
+    free(journal);
+    close(dir_fd);
+
+    if (status == 0) {
+        if (full)
+            printf("%s: full copy (%llu records)\n", hunt_id, (unsigned long long)src_count);
+        else if (delta.appended || delta.edited || delta.dropped || log_shipped)
+            printf("%s: +%llu/-%llu/~%llu records, log +%llu bytes\n", hunt_id,
+                   (unsigned long long)delta.appended, (unsigned long long)delta.dropped,
+                   (unsigned long long)delta.edited, (unsigned long long)log_shipped);
+        else
+            printf("%s: up to date\n", hunt_id);
+    }
+    return status;
+}
+
+/* Removes a replica hunt directory whose source hunt is gone. */
+static int sync_drop_hunt(const char *dst_dir) {
+    DIR *dir = opendir(dst_dir);
+    if (!dir)
+        return -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[PATH_MAX];
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        if (path_format(path, sizeof(path), "%s/%s", dst_dir, entry->d_name) == 0)
+            unlink(path);
+    }
+    closedir(dir);
+    return rmdir(dst_dir);
+}
+
+/* Files kept next to the hunt directories: archives and the scoring
+   rules of hunts without a directory. */
+static int sync_root_file(const char *name) {
+    size_t len = strlen(name);
+    size_t archive = strlen(ARCHIVE_SUFFIX), rules = strlen(RULES_SUFFIX);
+    return (len > archive && strcmp(name + len - archive, ARCHIVE_SUFFIX) == 0) ||
+           (len > rules && strcmp(name + len - rules, RULES_SUFFIX) == 0);
+}
+
+/* Ships the hunts under src_root to the replica at dst_root, which monitor
+   and score_calculator can read directly. Directory hunts send only what
+   their change journal recorded since the last sync; archives are copied
+   when they differ; replica hunts whose source is gone are removed. */
+int sync_hunts(const char *src_root, const char *dst_root) {
+    if (mkdir(dst_root, 0755) == -1 && errno != EEXIST) {
+        perror("Error creating replica directory");
+        return -1;
+    }
+    DIR *dir = opendir(src_root);
+    if (!dir) {
+        perror("Error opening source directory");
+        return -1;
+    }
+
+    unsigned long hunts = 0, archives = 0, removed = 0, failed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char src_path[PATH_MAX], dst_path[PATH_MAX];
+        struct stat src_st, dst_st;
+        if (entry->d_name[0] == '.')
+            continue;
+        if (strcmp(entry->d_name, SHARD_DIR) == 0) {
+            printf("Skipping sharded hunts in %s/%s (not replicated).\n", src_root, SHARD_DIR);
+            continue;
+        }
+        if (sync_root_file(entry->d_name)) {
+            if (path_format(src_path, sizeof(src_path), "%s/%s", src_root, entry->d_name) == -1 ||
+                path_format(dst_path, sizeof(dst_path), "%s/%s", dst_root, entry->d_name) == -1) {
+                perror(entry->d_name);
+                failed++;
+                continue;
+            }
+            if (stat(src_path, &src_st) == -1)
+                continue;
+            if (stat(dst_path, &dst_st) == 0 && dst_st.st_size == src_st.st_size &&
+                dst_st.st_mtim.tv_sec == src_st.st_mtim.tv_sec &&
+                dst_st.st_mtim.tv_nsec == src_st.st_mtim.tv_nsec)
+                continue;
+            if (sync_copy_file(src_path, dst_path) == -1) {
+                perror("Error copying archive");
+                failed++;
+                continue;
+            }
+            printf("%s: copied\n", entry->d_name);
+            archives++;
+            continue;
+        }
+        if (path_format(src_path, sizeof(src_path), "%s/%s/%s", src_root, entry->d_name, RECORD_FILE) == -1) {
+            perror(entry->d_name);
+            failed++;
+            continue;
+        }
+        if (stat(src_path, &src_st) == -1 || !S_ISREG(src_st.st_mode))
+            continue;
+        if (sync_hunt(src_root, dst_root, entry->d_name) == 0)
+            hunts++;
+        else
+            failed++;
+    }
+    closedir(dir);
+
+    /* Only directories sync created (they hold sync.state) are removed. */
+    dir = opendir(dst_root);
+    if (!dir) {
+        perror("Error opening replica directory");
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        char src_path[PATH_MAX], dst_path[PATH_MAX];
+        struct stat st;
+        if (entry->d_name[0] == '.')
+            continue;
+        int archive = sync_root_file(entry->d_name);
+        if (archive) {
+            if (path_format(src_path, sizeof(src_path), "%s/%s", src_root, entry->d_name) == -1 ||
+                path_format(dst_path, sizeof(dst_path), "%s/%s", dst_root, entry->d_name) == -1)
+                continue;
+        } else {
+            if (path_format(src_path, sizeof(src_path), "%s/%s/%s", src_root, entry->d_name, RECORD_FILE) == -1 ||
+                path_format(dst_path, sizeof(dst_path), "%s/%s/%s", dst_root, entry->d_name, SYNC_STATE) == -1 ||
+                stat(dst_path, &st) == -1)
+                continue;
+            path_format(dst_path, sizeof(dst_path), "%s/%s", dst_root, entry->d_name);
+        }
+        if (stat(src_path, &st) == 0 || errno != ENOENT)
+            continue;
+        if ((archive ? unlink(dst_path) : sync_drop_hunt(dst_path)) == -1) {
+            perror("Error removing replica hunt");
+            failed++;
+            continue;
+        }
+        printf("%s: removed\n", entry->d_name);
+        removed++;
+    }
+    closedir(dir);
+
+    printf("Synced %lu hunt(s) and %lu archive(s), removed %lu, to %s.\n", hunts, archives, removed, dst_root);
+    return failed ? -1 : 0;
+}
+
+/* fsck verifies directory hunts in chunks of whole checksum blocks, which
+   worker threads claim from a shared list so that one large hunt is
+   spread over all cores as well. */
+#define FSCK_CHUNK_BLOCKS 64
+#define FSCK_MAX_THREADS 64
+
+enum { BLOCK_CHECKSUM = 1, BLOCK_STRUCTURE = 2, BLOCK_UNREADABLE = 4 };
+
+typedef struct {
+    char hunt_id[256];
+    uint64_t ino;
+    uint64_t records;       /* whole records in the file */
+    uint64_t trailing;      /* bytes of an incomplete last record */
+    uint64_t covered;       /* records the checksums cover */
+    uint32_t *crcs;         /* NULL when missing or stale */
+    uint8_t *damage;        /* BLOCK_* flags per block */
+    int changed;            /* rewritten while being checked */
+} FsckHunt;
+
+typedef struct {
+    uint32_t hunt;
+    uint32_t first_block;
+} FsckJob;
+
+typedef struct {
+    FsckHunt *hunts;
+    size_t hunt_count, hunt_capacity;
+    unsigned long skipped;
+    FsckJob *jobs;
+    size_t job_count;
+    size_t next_job;
+} FsckRun;
+
+typedef struct {
+    FsckRun *run;
+    Treasure *buffer;
+} FsckWorker;
+
+static int fsck_collect(const char *hunt_id, void *arg) {
+    FsckRun *run = arg;
+    char path[PATH_MAX];
+    struct stat st;
+    if (path_format(path, sizeof(path), "%s/%s", hunt_id, RECORD_FILE) == -1) {
+        perror(hunt_id);
+        run->skipped++;
+        return 0;
+    }
+    if (stat(path, &st) == -1) {
+        run->skipped++;     /* sharded */
+        return 0;
+    }
+
+    if (run->hunt_count == run->hunt_capacity) {
+        size_t capacity = run->hunt_capacity ? run->hunt_capacity * 2 : 64;
+        FsckHunt *grown = realloc(run->hunts, capacity * sizeof(FsckHunt));
+        if (!grown)
+            return -1;
+        run->hunts = grown;
+        run->hunt_capacity = capacity;
+    }
+    FsckHunt *h = &run->hunts[run->hunt_count];
+    memset(h, 0, sizeof(*h));
+    snprintf(h->hunt_id, sizeof(h->hunt_id), "%s", hunt_id);
+    h->ino = st.st_ino;
+    h->records = st.st_size / sizeof(Treasure);
+    h->trailing = st.st_size % sizeof(Treasure);
+
+    ChecksumHeader header;
+    h->crcs = checksum_load(hunt_id, st.st_ino, &header);
+    h->covered = h->crcs ? (header.records < h->records ? header.records : h->records) : 0;
+    h->damage = calloc(checksum_blocks(h->records) + 1, 1);
+    if (!h->damage) {
+        free(h->crcs);
+        return -1;
+    }
+    run->hunt_count++;
+    return 0;
+}
+
+static void fsck_check_chunk(FsckHunt *h, uint32_t first_block, Treasure *buffer) {
+    char path[PATH_MAX];
+    int named = path_format(path, sizeof(path), "%s/%s", h->hunt_id, RECORD_FILE) == 0;
+    uint64_t first = (uint64_t)first_block * CHECKSUM_BLOCK_RECORDS;
+    uint64_t count = h->records - first;
+    if (count > FSCK_CHUNK_BLOCKS * CHECKSUM_BLOCK_RECORDS)
+        count = FSCK_CHUNK_BLOCKS * CHECKSUM_BLOCK_RECORDS;
+    uint32_t blocks = checksum_blocks(count);
+
+    struct stat st;
+    int fd = named ? open(path, O_RDONLY) : -1;
+    if (fd != -1 && fstat(fd, &st) == 0 && (uint64_t)st.st_ino != h->ino) {
+        h->changed = 1;
+        close(fd);
+        return;
+    }
+    size_t size = count * sizeof(Treasure), done = 0;
+    while (fd != -1 && done < size) {
+        ssize_t n = pread(fd, (char *)buffer + done, size - done, first * sizeof(Treasure) + done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    if (fd != -1)
+        close(fd);
+    if (done < size) {
+        memset(h->damage + first_block, BLOCK_UNREADABLE, blocks);
+        return;
+    }
+
+    for (uint32_t b = 0; b < blocks; b++) {
+        uint64_t start = (uint64_t)b * CHECKSUM_BLOCK_RECORDS;
+        uint64_t n = count - start < CHECKSUM_BLOCK_RECORDS ? count - start : CHECKSUM_BLOCK_RECORDS;
+        uint8_t damage = 0;
+        for (uint64_t i = start; i < start + n; i++) {
+            if (!memchr(buffer[i].username, '\0', USERNAME_LEN) || !memchr(buffer[i].clue, '\0', CLUE_LEN))
+                damage |= BLOCK_STRUCTURE;
+        }
+        uint64_t position = first + start;
+        if (h->crcs && position < h->covered) {
+            uint64_t checked = h->covered - position < n ? h->covered - position : n;
+            if (crc32c(0, buffer + start, checked * sizeof(Treasure)) != h->crcs[first_block + b])
+                damage |= BLOCK_CHECKSUM;
+        }
+        h->damage[first_block + b] = damage;
+    }
+}
+
+static void *fsck_worker(void *arg) {
+    FsckWorker *worker = arg;
+    FsckRun *run = worker->run;
+    size_t j;
+    while ((j = __atomic_fetch_add(&run->next_job, 1, __ATOMIC_RELAXED)) < run->job_count) {
+        FsckJob *job = &run->jobs[j];
+        fsck_check_chunk(&run->hunts[job->hunt], job->first_block, worker->buffer);
+    }
+    return NULL;
+}
+
+/* Prints the damaged record ranges of a checked hunt; returns their number. */
+static unsigned long fsck_report(const FsckHunt *h) {
+    if (h->changed) {
+        printf("%s: changed while being checked; run fsck again\n", h->hunt_id);
+        return 0;
+    }
+
+    unsigned long ranges = 0;
+    uint32_t blocks = checksum_blocks(h->records);
+    for (uint32_t b = 0; b < blocks; ) {
+        if (!h->damage[b]) {
+            b++;
+            continue;
+        }
+        uint32_t end = b;
+        uint8_t damage = 0;
+        while (end < blocks && h->damage[end])
+            damage |= h->damage[end++];
+        uint64_t last = (uint64_t)end * CHECKSUM_BLOCK_RECORDS;
+        if (last > h->records)
+            last = h->records;
+        printf("%s: records %llu-%llu (bytes %llu-%llu) damaged:%s%s%s\n", h->hunt_id,
+               (unsigned long long)b * CHECKSUM_BLOCK_RECORDS, (unsigned long long)last - 1,
+               (unsigned long long)b * CHECKSUM_BLOCK_RECORDS * sizeof(Treasure),
+               (unsigned long long)last * sizeof(Treasure) - 1,
+               damage & BLOCK_CHECKSUM ? " checksum mismatch" : "",
+               damage & BLOCK_STRUCTURE ? " malformed record" : "",
+               damage & BLOCK_UNREADABLE ? " read error" : "");
+        ranges++;
+        b = end;
+    }
+    if (h->trailing) {
+        printf("%s: %llu trailing bytes after record %llu (incomplete record)\n", h->hunt_id,
+               (unsigned long long)h->trailing, (unsigned long long)h->records);
+        ranges++;
+    }
+    if (!h->crcs && h->records > 0)
+        printf("%s: no current checksums (run reindex); checked record structure only\n", h->hunt_id);
+    else if (h->covered < h->records)
+        printf("%s: records %llu-%llu not covered by checksums\n", h->hunt_id,
+               (unsigned long long)h->covered, (unsigned long long)h->records - 1);
+    if (ranges == 0)
+        printf("%s: ok (%llu records)\n", h->hunt_id, (unsigned long long)h->records);
+    return ranges;
+}
+
+/* Rewrites a damaged hunt with the records of its intact blocks only. The
+   records of damaged blocks are appended to treasures.damaged for manual
+   recovery and an incomplete last record is dropped. */
+static int fsck_salvage(const FsckHunt *h) {
+    char record_path[PATH_MAX], temp_path[PATH_MAX], damaged_path[PATH_MAX];
+    if (path_format(record_path, sizeof(record_path), "%s/%s", h->hunt_id, RECORD_FILE) == -1 ||
+        path_format(temp_path, sizeof(temp_path), "%s/%s", h->hunt_id, TEMP_FILE) == -1 ||
+        path_format(damaged_path, sizeof(damaged_path), "%s/%s", h->hunt_id, DAMAGED_FILE) == -1) {
+        perror(h->hunt_id);
+        return -1;
+    }
+
+    int dir_fd = lock_hunt_dir(h->hunt_id);
+    if (dir_fd == -1)
+        return -1;
+    struct stat st;
+    int fd_in = open(record_path, O_RDONLY);
+    if (fd_in == -1 || fstat(fd_in, &st) == -1 || (uint64_t)st.st_ino != h->ino ||
+        (uint64_t)st.st_size != h->records * sizeof(Treasure) + h->trailing) {
+        fprintf(stderr, "%s: changed since it was checked; run fsck again\n", h->hunt_id);
+        if (fd_in != -1)
+            close(fd_in);
+        close(dir_fd);
+        return -1;
+    }
+    int fd_out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int fd_damaged = 0;
+
+    static Treasure block[CHECKSUM_BLOCK_RECORDS];
+    uint64_t kept = 0, moved = 0;
+    int status = fd_out == -1 ? -1 : 0;
+    for (uint32_t b = 0; status == 0 && b < checksum_blocks(h->records); b++) {
+        uint64_t first = (uint64_t)b * CHECKSUM_BLOCK_RECORDS;
+        uint64_t n = h->records - first < CHECKSUM_BLOCK_RECORDS ? h->records - first : CHECKSUM_BLOCK_RECORDS;
+        ssize_t size = n * sizeof(Treasure);
+        ssize_t got = pread(fd_in, block, size, first * sizeof(Treasure));
+        if (got != size && !(h->damage[b] & BLOCK_UNREADABLE)) {
+            status = -1;
+            break;
+        }
+        if (got < 0)
+            got = 0;
+        if (h->damage[b]) {
+            if (!fd_damaged)
+                fd_damaged = open(damaged_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            status = fd_damaged == -1 ? -1 : write_full(fd_damaged, block, got - got % sizeof(Treasure));
+            moved += n;
+        } else {
+            status = write_full(fd_out, block, size);
+            kept += n;
+        }
+    }
+    if (status == 0 && fsync(fd_out) == -1)
+        status = -1;
+    close(fd_in);
+    if (fd_out != -1)
+        close(fd_out);
+    if (fd_damaged > 0)
+        close(fd_damaged);
+    if (status == 0 && rename(temp_path, record_path) == -1)
+        status = -1;
+    if (status == -1) {
+        perror("Error salvaging hunt");
+        unlink(temp_path);
+        close(dir_fd);
+        return -1;
+    }
+    fsync(dir_fd);
+
+    change_log_append(h->hunt_id, CHANGE_RESET, NULL, 0);
+    hunt_rewritten(h->hunt_id);
+    close(dir_fd);
+
+    char details[256];
+    snprintf(details, sizeof(details), "fsck salvage: kept %llu records, moved %llu to %s",
+             (unsigned long long)kept, (unsigned long long)moved, DAMAGED_FILE);
+    log_operation(h->hunt_id, details);
+    printf("%s: salvaged, kept %llu records, moved %llu to %s/%s\n", h->hunt_id, (unsigned long long)kept,
+           (unsigned long long)moved, h->hunt_id, DAMAGED_FILE);
+    return 0;
+}
+
+/* Verifies the records of one hunt or of all directory hunts against their
+   block checksums, in parallel on all cores, and reports damaged record
+   ranges. With salvage, damaged hunts keep only their intact blocks. */
+int fsck_hunts(const char *target, int salvage) {
+    FsckRun run;
+    memset(&run, 0, sizeof(run));
+    int status = 0;
+    if (strcmp(target, "all") == 0) {
+        status = for_each_hunt(fsck_collect, &run, 0);
+    } else if (hunt_is_sharded(target) || hunt_is_archived(target)) {
+        fprintf(stderr, "Hunt '%s' is not a directory hunt; fsck checks treasures.dat files only.\n", target);
+        return -1;
+    } else {
+        status = fsck_collect(target, &run);
+        if (status == 0 && run.hunt_count == 0) {
+            fprintf(stderr, "Hunt '%s' not found.\n", target);
+            return -1;
+        }
+    }
+
+    uint64_t total_records = 0;
+    for (size_t i = 0; status == 0 && i < run.hunt_count; i++)
+        run.job_count += (checksum_blocks(run.hunts[i].records) + FSCK_CHUNK_BLOCKS - 1) / FSCK_CHUNK_BLOCKS;
+    run.jobs = malloc((run.job_count + 1) * sizeof(FsckJob));
+    if (status == 0 && run.jobs) {
+        size_t j = 0;
+        for (size_t i = 0; i < run.hunt_count; i++) {
+            total_records += run.hunts[i].records;
+            for (uint32_t b = 0; b < checksum_blocks(run.hunts[i].records); b += FSCK_CHUNK_BLOCKS)
+                run.jobs[j++] = (FsckJob){ (uint32_t)i, b };
+        }
+    } else {
+        status = -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus < 1 ? 1 : cpus > FSCK_MAX_THREADS ? FSCK_MAX_THREADS : (size_t)cpus;
+    if (thread_count > run.job_count)
+        thread_count = run.job_count ? run.job_count : 1;
+    static FsckWorker workers[FSCK_MAX_THREADS];
+    pthread_t threads[FSCK_MAX_THREADS];
+    size_t started = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    crc32c(0, NULL, 0);     /* picks the implementation before the threads race for it */
+    for (size_t t = 0; status == 0 && t < thread_count; t++) {
+        workers[t].run = &run;
+        workers[t].buffer = malloc(FSCK_CHUNK_BLOCKS * CHECKSUM_BLOCK_RECORDS * sizeof(Treasure));
+        if (!workers[t].buffer) {
+            status = -1;
+            break;
+        }
+        if (t > 0 && pthread_create(&threads[t], NULL, fsck_worker, &workers[t]) != 0) {
+            free(workers[t].buffer);
+            break;
+        }
+        started = t + 1;
+    }
+    if (started > 0)
+        fsck_worker(&workers[0]);
+    for (size_t t = 0; t < started; t++) {
+        if (t > 0)
+            pthread_join(threads[t], NULL);
+        free(workers[t].buffer);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (status == -1 || started == 0) {
+        perror("fsck");
+        status = -1;
+    }
+
+    unsigned long ranges = 0, damaged_hunts = 0, salvaged = 0;
+    for (size_t i = 0; status == 0 && i < run.hunt_count; i++) {
+        unsigned long found = fsck_report(&run.hunts[i]);
+        ranges += found;
+        if (found) {
+            damaged_hunts++;
+            if (salvage && fsck_salvage(&run.hunts[i]) == 0)
+                salvaged++;
+        }
+    }
+
+    if (status == 0) {
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        double mb = total_records * sizeof(Treasure) / 1e6;
+        printf("Checked %zu hunt(s), %llu records (%.1f MB) in %.1f ms with %zu thread(s), %.0f MB/s: "
+               "%lu damaged range(s) in %lu hunt(s)",
+               run.hunt_count, (unsigned long long)total_records, mb, ms, started,
+               ms > 0 ? mb / (ms / 1e3) : 0.0, ranges, damaged_hunts);
+        if (salvage)
+            printf(", %lu salvaged", salvaged);
+        printf(".\n");
+        if (run.skipped)
+            printf("Skipped %lu sharded hunt(s).\n", run.skipped);
+    }
+
+    for (size_t i = 0; i < run.hunt_count; i++) {
+        free(run.hunts[i].crcs);
+        free(run.hunts[i].damage);
+    }
+    free(run.hunts);
+    free(run.jobs);
+    if (status == -1)
+        return -1;
+    return damaged_hunts > salvaged ? -1 : 0;
+}
+
+int run_command(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "init_shards") == 0) {
+        unsigned shards = argc >= 3 ? (unsigned)atoi(argv[2]) : 16;
+        unsigned slots = argc >= 4 ? (unsigned)atoi(argv[3]) : 65536;
+        return init_shards(shards, slots);
+    }
+    if (argc >= 2 && strcmp(argv[1], "compact_shards") == 0) {
+        return compact_shards();
+    }
+    if (argc >= 2 && strcmp(argv[1], "reindex_users") == 0) {
+        return reindex_users();
+    }
+    if (argc == 4 && strcmp(argv[1], "sync") == 0) {
+        return sync_hunts(argv[2], argv[3]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "fsck") == 0) {
+        const char *target = "all";
+        int salvage = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--salvage") == 0)
+                salvage = 1;
+            else
+                target = argv[i];
+        }
+        return fsck_hunts(target, salvage);
+    }
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage:\n");
+        fprintf(stderr, "  %s add <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s list <hunt_id> [--since <time>] [--until <time>]\n", argv[0]);
+        fprintf(stderr, "  %s view <hunt_id> <treasure_id>\n", argv[0]);
+        fprintf(stderr, "  %s remove_treasure <hunt_id> <treasure_id>\n", argv[0]);
+        fprintf(stderr, "  %s remove_treasures <hunt_id> <id,id,...>\n", argv[0]);
+        fprintf(stderr, "  %s remove_treasures <hunt_id> --file <id_file>\n", argv[0]);
+        fprintf(stderr, "  %s update <hunt_id> <treasure_id> <field=value>...\n", argv[0]);
+        fprintf(stderr, "  %s update <hunt_id> --file <update_file>\n", argv[0]);
+        fprintf(stderr, "  %s remove_hunt <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s range <hunt_id> <min_id> <max_id>\n", argv[0]);
+        fprintf(stderr, "  %s hunt_stats <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s search <hunt_id|all> <term> [AND|OR <term>]...\n", argv[0]);
+        fprintf(stderr, "  %s dedupe <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s sort <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s reindex <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s archive <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s restore <hunt_id>\n", argv[0]);
+        fprintf(stderr, "  %s init_shards [shard_count] [hunt_slots]\n", argv[0]);
+        fprintf(stderr, "  %s compact_shards\n", argv[0]);
+        fprintf(stderr, "  %s reindex_users\n", argv[0]);
+        fprintf(stderr, "  %s sync <src_root> <dst_root>\n", argv[0]);
+        fprintf(stderr, "  %s fsck [hunt_id|all] [--salvage]\n", argv[0]);
+        fprintf(stderr, "  %s serve\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *command = argv[1];
+    const char *hunt_id = argv[2];
+
+    if (strcmp(command, "add") == 0) {
+        return add_treasure(hunt_id);
+    } else if (strcmp(command, "list") == 0 && argc == 3) {
+        return list_treasures(hunt_id);
+    } else if (strcmp(command, "list") == 0) {
+        TimeWindow w;
+        if (parse_time_window(argc - 3, argv + 3, &w) != argc - 3) {
+            fprintf(stderr, "Invalid time window. Times: epoch seconds, now, -30m/-1h/-7d or YYYY-MM-DD[THH:MM[:SS]].\n");
+            return EXIT_FAILURE;
+        }
+        return list_treasures_window(hunt_id, &w);
+    } else if (strcmp(command, "view") == 0 && argc == 4) {
+        int id = atoi(argv[3]);
+        return view_treasure(hunt_id, id);
+    } else if (strcmp(command, "remove_treasure") == 0 && argc == 4) {
+        int id = atoi(argv[3]);
+        return remove_treasure(hunt_id, id);
+    } else if (strcmp(command, "remove_treasures") == 0 && argc >= 4) {
+        return remove_treasures(hunt_id, argc - 3, argv + 3);
+    } else if (strcmp(command, "update") == 0 && argc >= 5) {
+        return update_treasures(hunt_id, argc - 3, argv + 3);
+    } else if (strcmp(command, "remove_hunt") == 0) {
+        return remove_hunt(hunt_id);
+    } else if (strcmp(command, "range") == 0 && argc == 5) {
+        return range_treasures(hunt_id, atoi(argv[3]), atoi(argv[4]));
+    } else if (strcmp(command, "hunt_stats") == 0) {
+        return hunt_stats(hunt_id);
+    } else if (strcmp(command, "search") == 0 && argc >= 4) {
+        return search_treasures(hunt_id, argc - 3, argv + 3);
+    } else if (strcmp(command, "sort") == 0) {
+        return sort_hunt(hunt_id);
+    } else if (strcmp(command, "dedupe") == 0) {
+        return dedupe_hunt(hunt_id);
+    } else if (strcmp(command, "reindex") == 0) {
+        return reindex(hunt_id);
+    } else if (strcmp(command, "archive") == 0) {
+        return archive_hunt(hunt_id);
+    } else if (strcmp(command, "restore") == 0) {
+        return restore_hunt(hunt_id);
+    } else {
+        fprintf(stderr, "Invalid command or arguments.\n");
+        return EXIT_FAILURE;
+    }
+}
+typedef struct {
+    char path[PATH_MAX];
+    int flags;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+} CachedFd;
+
+/* In daemon mode hunt files stay open between requests. An entry is reused
+   only while the path still names the same inode, so files replaced by a
+   rewrite (remove_treasure, restore, ...) are reopened transparently. */
+static CachedFd fd_cache[FD_CACHE_SIZE];
+static int fd_cache_next;
+
+static int cached_open(const char *path, int flags) {
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        CachedFd *c = &fd_cache[i];
+        if (c->fd <= 0 || c->flags != flags || strcmp(c->path, path) != 0)
+            continue;
+        if (exists && c->dev == st.st_dev && c->ino == st.st_ino) {
+            if (lseek(c->fd, 0, SEEK_SET) == -1)
+                break;
+            return c->fd;
+        }
+        close(c->fd);
+        c->fd = 0;
+    }
+
+    int fd = open(path, flags, 0644);
+    if (fd == -1 || fstat(fd, &st) == -1 || strlen(path) >= sizeof(fd_cache[0].path))
+        return fd;
+
+    CachedFd *c = &fd_cache[fd_cache_next];
+    fd_cache_next = (fd_cache_next + 1) % FD_CACHE_SIZE;
+    if (c->fd > 0)
+        close(c->fd);
+    path_format(c->path, sizeof(c->path), "%s", path);
+    c->flags = flags;
+    c->fd = fd;
+    c->dev = st.st_dev;
+    c->ino = st.st_ino;
+    return fd;
+}
+
+static void cached_close(int fd) {
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        if (fd_cache[i].fd == fd)
+            return;
+    }
+    close(fd);
+}
+
+static const char *socket_path(void) {
+    const char *path = getenv("TREASURE_MANAGER_SOCKET");
+    return path ? path : SOCKET_FILE;
+}
+
+static pid_t serve_workers[SERVE_MAX_WORKERS];
+static int serve_worker_count;
+
+static void serve_shutdown(int sig) {
+    (void)sig;
+    unlink(socket_path());
+    for (int i = 0; i < serve_worker_count; i++) {
+        if (serve_workers[i] > 0)
+            kill(serve_workers[i], SIGTERM);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Runs one forwarded invocation in the client's working directory with the
+   client connection as stdin, stdout and stderr, then reports the exit
+   status after a NUL byte (command output is text, so the NUL cannot be
+   confused with it). The request is the client's cwd followed by its argv,
+   each NUL-terminated. */
+static void serve_client(int client) {
+    uint32_t length;
+    if (read_full(client, &length, sizeof(length)) != 1 || length == 0 || length > 65536)
+        return;
+    char *request = malloc(length + 1);
+    if (!request || read_full(client, request, length) != 1) {
+        free(request);
+        return;
+    }
+    request[length] = '\0';
+
+    const char *cwd = request;
+    char *argv[16];
+    int argc = 0;
+    for (char *p = request + strlen(request) + 1; p < request + length && argc < 15; p += strlen(p) + 1)
+        argv[argc++] = p;
+    argv[argc] = NULL;
+
+    /* A client that stops typing must not hold this worker forever. */
+    struct timeval timeout = { SERVE_INPUT_TIMEOUT, 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int saved[3];
+    for (int i = 0; i < 3; i++) {
+        saved[i] = dup(i);
+        dup2(client, i);
+    }
+    __fpurge(stdin);
+    clearerr(stdin);
+
+    int status = EXIT_FAILURE;
+    if (chdir(cwd) == -1)
+        fprintf(stderr, "Cannot change to the client's directory %s: %s\n", cwd, strerror(errno));
+    else if (argc >= 2)
+        status = run_command(argc, argv);
+
+    fflush(stdout);
+    fflush(stderr);
+    __fpurge(stdin);
+    for (int i = 0; i < 3; i++) {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+
+    char trailer[32];
+    int n = snprintf(trailer, sizeof(trailer), "%c%d\n", '\0', status);
+    write_full(client, trailer, n);
+    free(request);
+}
+
+/* A worker serves one client at a time, keeping its own descriptor cache
+   across the requests it handles. */
+static void serve_worker(int listener) {
+    sigset_t term;
+    sigemptyset(&term);
+    sigaddset(&term, SIGTERM);
+    sigaddset(&term, SIGINT);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    sigprocmask(SIG_UNBLOCK, &term, NULL);
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            _exit(EXIT_FAILURE);
+        }
+        serve_client(client);
+        close(client);
+    }
+}
+
+static pid_t serve_spawn_worker(int listener) {
+    pid_t pid = fork();
+    if (pid == 0)
+        serve_worker(listener);
+    if (pid == -1)
+        perror("fork worker");
+    return pid;
+}
+
+/* The daemon pre-forks a pool of workers that accept on the same socket,
+   so one slow client (an interactive add) only holds up its own worker.
+   Writers still serialise on the hunt locks, as separate invocations do.
+   Workers that die are replaced. */
+int serve(void) {
+    const char *path = socket_path();
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listener, 64) == -1) {
+        perror("bind/listen");
+        close(listener);
+        return -1;
+    }
+
+    const char *workers_env = getenv("TREASURE_MANAGER_WORKERS");
+    serve_worker_count = workers_env ? atoi(workers_env) : SERVE_WORKERS;
+    if (serve_worker_count < 1)
+        serve_worker_count = 1;
+    if (serve_worker_count > SERVE_MAX_WORKERS)
+        serve_worker_count = SERVE_MAX_WORKERS;
+
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdin, NULL, _IONBF, 0);
+    store_open = cached_open;
+    store_close = cached_close;
+    index_cache_enabled = 1;
+
+    printf("treasure_manager serving on %s (PID: %d, %d workers)\n", path, getpid(), serve_worker_count);
+    fflush(stdout);
+
+    sigset_t term, old_mask;
+    sigemptyset(&term);
+    sigaddset(&term, SIGTERM);
+    sigaddset(&term, SIGINT);
+    sigprocmask(SIG_BLOCK, &term, &old_mask);
+    signal(SIGINT, serve_shutdown);
+    signal(SIGTERM, serve_shutdown);
+    for (int i = 0; i < serve_worker_count; i++)
+        serve_workers[i] = serve_spawn_worker(listener);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    while (1) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("wait");
+            break;
+        }
+        sigprocmask(SIG_BLOCK, &term, &old_mask);
+        for (int i = 0; i < serve_worker_count; i++) {
+            if (serve_workers[i] == pid)
+                serve_workers[i] = serve_spawn_worker(listener);
+        }
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    }
+    close(listener);
+    unlink(path);
+    return -1;
+}
+
+/* Forwards this invocation to a running daemon. Returns -1 (nothing sent)
+   when no daemon is listening, so the caller runs the command itself. */
+static int forward_to_daemon(int argc, char *argv[], int *status) {
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path());
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    /* The daemon runs the command in this process's working directory. */
+    char request[PATH_MAX + 4096];
+    if (!getcwd(request, PATH_MAX)) {
+        close(sock);
+        return -1;
+    }
+    uint32_t length = strlen(request) + 1;
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        if (length + len > sizeof(request)) {
+            close(sock);
+            return -1;
+        }
+        memcpy(request + length, argv[i], len);
+        length += len;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (write_full(sock, &length, sizeof(length)) == -1 || write_full(sock, request, length) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    char buf[4096], trailer[32];
+    size_t trailer_len = 0;
+    int in_trailer = 0, stdin_open = 1;
+    while (1) {
+        struct pollfd fds[2] = {
+            { sock, POLLIN, 0 },
+            { stdin_open ? STDIN_FILENO : -1, POLLIN, 0 },
+        };
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0 || write_full(sock, buf, n) == -1) {
+                stdin_open = 0;
+                shutdown(sock, SHUT_WR);
+            }
+        }
+        if (fds[0].revents) {
+            ssize_t n = read(sock, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            char *p = buf;
+            if (!in_trailer) {
+                char *nul = memchr(buf, '\0', n);
+                size_t out_len = nul ? (size_t)(nul - buf) : (size_t)n;
+                fwrite(buf, 1, out_len, stdout);
+                fflush(stdout);
+                if (!nul)
+                    continue;
+                in_trailer = 1;
+                p = nul + 1;
+            }
+            size_t rest = buf + n - p;
+            if (trailer_len + rest >= sizeof(trailer))
+                rest = sizeof(trailer) - 1 - trailer_len;
+            memcpy(trailer + trailer_len, p, rest);
+            trailer_len += rest;
+        }
+    }
+    close(sock);
+
+    trailer[trailer_len] = '\0';
+    *status = in_trailer ? atoi(trailer) : EXIT_FAILURE;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0)
+        return serve();
+
+    int status;
+    if (argc >= 2 && !getenv("TREASURE_MANAGER_LOCAL") && forward_to_daemon(argc, argv, &status) == 0)
+        return status;
+    return run_command(argc, argv);
+}
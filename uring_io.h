@@ -0,0 +1,146 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Minimal io_uring wrapper on the raw system calls (liburing is not
+   available to these standalone builds). io_ring_init() fails when the
+   kernel lacks io_uring or it is disabled; callers then keep using plain
+   blocking system calls. */
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned queued;        /* sqes prepared but not yet submitted */
+} IoRing;
+
+static inline int io_ring_init(IoRing *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd == -1)
+        return -1;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->sq_ptr != MAP_FAILED)
+            munmap(r->sq_ptr, r->sq_len);
+        if (r->cq_ptr != MAP_FAILED)
+            munmap(r->cq_ptr, r->cq_len);
+        if (r->sqes != MAP_FAILED)
+            munmap(r->sqes, r->sqes_len);
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+
+    char *sq = r->sq_ptr, *cq = r->cq_ptr;
+    r->entries = p.sq_entries;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static inline void io_ring_exit(IoRing *r) {
+    if (r->fd == -1)
+        return;
+    munmap(r->sq_ptr, r->sq_len);
+    munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sqes, r->sqes_len);
+    close(r->fd);
+    r->fd = -1;
+}
+
+/* Returns a zeroed submission entry, or NULL when the queue is full. */
+static inline struct io_uring_sqe *io_ring_get_sqe(IoRing *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail + r->queued;
+    if (tail - head >= r->entries)
+        return NULL;
+
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->queued++;
+    return sqe;
+}
+
+/* Submits everything queued and waits for at least wait_nr completions. */
+static inline int io_ring_submit(IoRing *r, unsigned wait_nr) {
+    unsigned submit = r->queued;
+    __atomic_store_n(r->sq_tail, *r->sq_tail + submit, __ATOMIC_RELEASE);
+    r->queued = 0;
+
+    while (1) {
+        int n = syscall(__NR_io_uring_enter, r->fd, submit, wait_nr,
+                        wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n >= 0)
+            return n;
+        if (errno != EINTR)
+            return -1;
+        submit = 0;
+    }
+}
+
+/* Pops one completion if available; returns 1 when *cqe was filled. */
+static inline int io_ring_peek(IoRing *r, struct io_uring_cqe *cqe) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+    *cqe = r->cqes[head & *r->cq_mask];
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline void io_prep_statx(struct io_uring_sqe *sqe, const char *path,
+                                 struct statx *buf, uint64_t user_data) {
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)path;
+    sqe->len = STATX_SIZE | STATX_INO;
+    sqe->off = (uintptr_t)buf;
+    sqe->user_data = user_data;
+}
+
+static inline void io_prep_read(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len,
+                                uint64_t offset, uint64_t user_data) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+#endif